@@ -0,0 +1,161 @@
+"""benchmark.py
+Fixed, seeded performance scenarios of exampleB4c with a JSON report,
+and comparison of a report with a stored baseline.
+
+Scenarios:
+  pencil_1e5      pencil beam, 1e5 events, 4 threads
+  pencil_t1/t4/tN pencil beam on 1, 4 and all cores
+  prompt_gamma    camera stage only: isotropic prompt gammas from the beam
+                  path in the Target, replayed from a phase-space file
+  coincidence     prompt gammas aimed at the scatter detector, so that most
+                  events produce scatter-absorber coincidences
+
+Each scenario records events/s, init time (job start to run start), peak
+RSS, output bytes (histograms and columnar tables) and bytes/event.
+
+Usage: python3 benchmark.py [--report bench_report.json] [--scale 0.1]
+                            [--only pencil_t1 ...] [--compare baseline.json]
+       python3 benchmark.py --compare baseline.json --against bench_report.json
+Also available as the bench and bench_compare build targets. A baseline
+is a report kept from a reference build (same machine).
+"""
+import argparse
+import datetime
+import json
+import os
+import platform
+import re
+import shutil
+import sys
+import tempfile
+
+from benchutil import run_simulation, write_phase_space
+
+INIT_RE = re.compile(r"until the run start\s*:\s*([0-9.eE+-]+) s")
+
+# Lower is better for these, higher for events_per_s
+COST_METRICS = ["init_s", "max_rss_mb", "bytes_per_event"]
+
+
+def scenarios(scale):
+    cores = os.cpu_count() or 1
+    pencil = int(1e5 * scale)
+    short = int(2e4 * scale)
+    gammas = int(2e5 * scale)
+    return [
+        ("pencil_1e5", 4, pencil, None),
+        ("pencil_t1", 1, short, None),
+        ("pencil_t4", 4, short, None),
+        ("pencil_tN", cores, short, None),
+        ("prompt_gamma", 4, gammas, "isotropic"),
+        ("coincidence", 4, gammas, "scatter"),
+    ]
+
+
+def directory_bytes(path):
+    return sum(os.path.getsize(os.path.join(root, name))
+               for root, _, names in os.walk(path) for name in names)
+
+
+def run_scenario(exe, name, threads, events, source, seed):
+    workdir = tempfile.mkdtemp(prefix="bench_" + name + "_")
+    output = os.path.join(workdir, "output")
+    os.mkdir(output)
+
+    commands = ["/process/em/verbose 0", "/process/had/verbose 0",
+                "/B4c/output/fileName " + os.path.join(output, "simulation.root"),
+                "/B4c/output/columnDirectory " + os.path.join(output, "columns"),
+                "/B4c/output/rootNtuples false", "/B4c/output/asyncWriter true",
+                "/run/initialize", "/run/printProgress 0"]
+    if source:
+        phsp = os.path.join(workdir, "gammas")
+        write_phase_space(phsp + ".phsp", events, source == "scatter", seed)
+        commands.append("/B4c/gun/replay " + phsp)
+    commands.append("/run/beamOn {}".format(events))
+
+    result = run_simulation(exe, commands, threads=threads, workdir=workdir,
+                            extra_args=["--seed", str(seed)])
+    init = INIT_RE.search(result["stdout"])
+    output_bytes = directory_bytes(output)
+    shutil.rmtree(workdir)
+
+    return {"threads": threads, "events": events,
+            "events_per_s": result.get("events_per_s", 0.0),
+            "init_s": float(init.group(1)) if init else None,
+            "wall_s": result["wall_s"], "max_rss_mb": result["max_rss_mb"],
+            "output_bytes": output_bytes,
+            "bytes_per_event": output_bytes / events if events else 0.0}
+
+
+def compare(baseline, report, tolerance):
+    """Print the relative changes; returns the list of regressions."""
+    regressions = []
+    print("{:<14} {:<16} {:>12} {:>12} {:>8}".format("scenario", "metric", "baseline", "current",
+                                                     "change"))
+    for name, current in report["scenarios"].items():
+        base = baseline["scenarios"].get(name)
+        if not base:
+            continue
+        if base["threads"] != current["threads"] or base["events"] != current["events"]:
+            print("{:<14} not comparable (threads or events differ)".format(name))
+            continue
+        for metric in ["events_per_s"] + COST_METRICS:
+            b, c = base.get(metric), current.get(metric)
+            if not b or c is None:
+                continue
+            change = c / b - 1.
+            worse = change < -tolerance if metric == "events_per_s" else change > tolerance
+            print("{:<14} {:<16} {:>12.4g} {:>12.4g} {:>+7.1%}{}".format(
+                name, metric, b, c, change, "  REGRESSION" if worse else ""))
+            if worse:
+                regressions.append((name, metric, change))
+    return regressions
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--seed", type=int, default=12345)
+parser.add_argument("--scale", type=float, default=1.0, help="factor on the event counts")
+parser.add_argument("--only", nargs="+", help="run these scenarios only")
+parser.add_argument("--report", default="bench_report.json")
+parser.add_argument("--compare", help="baseline report to compare with")
+parser.add_argument("--against", help="compare this report instead of running the scenarios")
+parser.add_argument("--tolerance", type=float, default=0.05, help="relative change flagged")
+args = parser.parse_args()
+
+# Before the scenarios, which take a while
+if args.compare and not os.path.isfile(args.compare):
+    sys.exit("baseline report {} not found: keep the report of a reference build "
+             "(python3 benchmark.py --report baseline.json, or make bench) and pass it "
+             "with --compare (B4C_BENCH_BASELINE for make bench_compare)".format(args.compare))
+
+if args.against:
+    with open(args.against) as f:
+        report = json.load(f)
+else:
+    exe = os.path.abspath(args.exe)
+    report = {"date": datetime.datetime.now().isoformat(timespec="seconds"),
+              "host": platform.node(), "cpus": os.cpu_count(), "exe": exe, "seed": args.seed,
+              "scale": args.scale, "scenarios": {}}
+    for name, threads, events, source in scenarios(args.scale):
+        if args.only and name not in args.only:
+            continue
+        result = run_scenario(exe, name, threads, events, source, args.seed)
+        report["scenarios"][name] = result
+        print("{:<14} {:>3} threads {:>8} events {:>10.1f} events/s  init {:.1f} s  "
+              "RSS {:.0f} MB  {:.0f} bytes/event".format(
+                  name, threads, events, result["events_per_s"], result["init_s"] or 0.,
+                  result["max_rss_mb"], result["bytes_per_event"]), flush=True)
+    with open(args.report, "w") as f:
+        json.dump(report, f, indent=2)
+    print("report written to " + args.report)
+
+if args.compare:
+    with open(args.compare) as f:
+        baseline = json.load(f)
+    print()
+    regressions = compare(baseline, report, args.tolerance)
+    if regressions:
+        print("\n{} regression(s) beyond {:.0%}".format(len(regressions), args.tolerance))
+        sys.exit(1)
+    print("\nno regression beyond {:.0%}".format(args.tolerance))
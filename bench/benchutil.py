@@ -0,0 +1,129 @@
+"""benchutil.py
+Helpers shared by the benchmark scripts: run exampleB4c on a generated
+macro, collect the numbers it prints in its run summary, read and compare
+the histograms of the CSV analysis output, and write the synthetic prompt
+gammas replayed by the camera-stage scenarios.
+"""
+import math
+import os
+import random
+import re
+import struct
+import subprocess
+import tempfile
+import time
+
+RATE_RE = re.compile(r"Run (\d+): (\d+) events in ([0-9.eE+-]+) s(?: \(([0-9.eE+-]+) events/s\))?")
+
+
+def run_simulation(exe, commands, threads=None, workdir=None, extra_args=()):
+    """Run exe on a macro built from the list of commands.
+
+    Returns a dict with the wall time and peak resident memory of the
+    whole process, its stdout and the parsed run summary of the last run.
+    """
+    workdir = workdir or os.getcwd()
+    with tempfile.NamedTemporaryFile("w", suffix=".mac", dir=workdir, delete=False) as macro:
+        macro.write("\n".join(commands) + "\n")
+    args = [exe, "-m", macro.name]
+    if threads:
+        args += ["-t", str(threads)]
+    args += list(extra_args)
+
+    # wait4 gives the resource usage of this child alone
+    with tempfile.TemporaryFile("w+") as out, tempfile.TemporaryFile("w+") as err:
+        start = time.perf_counter()
+        proc = subprocess.Popen(args, cwd=workdir, stdout=out, stderr=err, text=True)
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        out.seek(0)
+        err.seek(0)
+        stdout, stderr = out.read(), err.read()
+    os.unlink(macro.name)
+    if proc.returncode != 0:
+        raise RuntimeError("{} failed:\n{}".format(" ".join(args), stderr[-2000:]))
+
+    result = {"wall_s": wall, "max_rss_mb": usage.ru_maxrss / 1024.0, "stdout": stdout}
+    runs = RATE_RE.findall(stdout)
+    if runs:
+        _, events, seconds, rate = runs[-1]
+        result["events"] = int(events)
+        result["run_s"] = float(seconds)
+        result["events_per_s"] = float(rate) if rate else 0.0
+    return result
+
+
+def timed(args, cwd=None):
+    """Run a command and return its wall time in seconds."""
+    start = time.perf_counter()
+    subprocess.run(args, cwd=cwd, check=True, capture_output=True)
+    return time.perf_counter() - start
+
+
+def read_h1_csv(path):
+    """Return (edges, Sw, Sw2) of a histogram written by the CSV analysis manager."""
+    rows = []
+    axis = None
+    with open(path) as f:
+        for line in f:
+            if line.startswith("#axis"):
+                _, _, nbins, low, high = line.split()[:5]
+                axis = (int(nbins), float(low), float(high))
+            elif not line.startswith("#") and line[0].isdigit():
+                rows.append([float(v) for v in line.split(",")])
+    nbins, low, high = axis
+    width = (high - low) / nbins
+    edges = [low + i * width for i in range(nbins + 1)]
+    inner = rows[1:-1]  # drop underflow and overflow
+    return edges, [r[1] for r in inner], [r[2] for r in inner]
+
+
+def window_sum(edges, values, low, high):
+    """Sum of the bins whose lower edge lies in [low, high)."""
+    return sum(v for e, v in zip(edges, values) if low <= e < high)
+
+
+def rebin(values, factor):
+    return [sum(values[i:i + factor]) for i in range(0, len(values), factor)]
+
+
+def chi2_ndf(first, second, factor):
+    """Chi2/ndf of two spectra (edges, Sw, Sw2), 'factor' bins merged, over
+    the bins filled in either."""
+    _, sw_a, sw2_a = first
+    _, sw_b, sw2_b = second
+    chi2, ndf = 0., 0
+    for a, a2, b, b2 in zip(rebin(sw_a, factor), rebin(sw2_a, factor), rebin(sw_b, factor),
+                            rebin(sw2_b, factor)):
+        if a2 + b2 > 0.:
+            chi2 += (a - b) ** 2 / (a2 + b2)
+            ndf += 1
+    return chi2 / ndf if ndf else 0.
+
+
+# Prompt-gamma lines of the PMMA target, (label, low, high) in MeV
+LINE_WINDOWS = [("2.22", 2.12, 2.32), ("4.44", 4.24, 4.64), ("6.13", 5.93, 6.33)]
+
+
+def write_phase_space(path, nof_events, aim_at_scatter, seed):
+    """Synthetic prompt gammas, one per event, in the phase-space format
+    of PhaseSpace.hh (32-byte header, 40-byte records; mm, MeV, ns)."""
+    rng = random.Random(seed)
+    lines = [(4.44, 0.5), (6.13, 0.3), (2.22, 0.2)]
+    with open(path, "wb") as f:
+        f.write(struct.pack("<8sIIQQ", b"PGPHSP01", 0x01020304, 40, nof_events, 0))
+        for event in range(nof_events):
+            # Emission along the beam path in the Target (x in [-90, 90] mm, z = 100 mm)
+            x, y, z = rng.uniform(-90., 90.), rng.gauss(0., 2.), 100. + rng.gauss(0., 2.)
+            if aim_at_scatter:
+                # Towards a point of the 100 x 100 mm scatter plane at z = 0
+                dx, dy, dz = rng.uniform(-50., 50.) - x, rng.uniform(-50., 50.) - y, -z
+            else:
+                cos_theta, phi = rng.uniform(-1., 1.), rng.uniform(0., 2. * math.pi)
+                sin_theta = math.sqrt(1. - cos_theta ** 2)
+                dx, dy, dz = sin_theta * math.cos(phi), sin_theta * math.sin(phi), cos_theta
+            norm = math.sqrt(dx * dx + dy * dy + dz * dz)
+            energy = rng.choices([e for e, _ in lines], [w for _, w in lines])[0]
+            f.write(struct.pack("<9fi", x, y, z, dx / norm, dy / norm, dz / norm, energy, 0., 1.,
+                                event))
@@ -0,0 +1,76 @@
+"""cuts_benchmark.py
+Throughput and prompt-gamma spectrum (H1 id 2, "Energy") for the region
+production cuts (/B4c/cuts/) and secondary neutron cuts (/B4c/neutron/),
+each setting compared with the default physics at the same seed.
+
+Usage: python3 cuts_benchmark.py [--events N] [--threads T] [--seed S]
+Run from the build directory (where exampleB4c lives).
+"""
+import argparse
+import glob
+import os
+import shutil
+import tempfile
+
+from benchutil import LINE_WINDOWS as WINDOWS, chi2_ndf, read_h1_csv, run_simulation, window_sum
+
+# (name, commands before /run/initialize, commands after it)
+SETTINGS = [
+    ("default", [], []),
+    ("crystals 1 mm", ["/B4c/cuts/Scatter 1 mm", "/B4c/cuts/Absorber 1 mm"], []),
+    ("world 10 mm", ["/B4c/cuts/World 10 mm", "/B4c/cuts/Target 0.7 mm"], []),
+    ("all 10 mm, target 0.7 mm", ["/B4c/cuts/World 10 mm", "/B4c/cuts/Target 0.7 mm",
+                                  "/B4c/cuts/Scatter 10 mm", "/B4c/cuts/Absorber 10 mm"], []),
+    ("n creation time cut 1 us", [], ["/B4c/neutron/creationTimeCut 1 us"]),
+    ("n energy cut 1 MeV", [], ["/B4c/neutron/energyCut 1 MeV"]),
+    ("n roulette <1 MeV p=0.1", [], ["/B4c/neutron/rouletteEnergy 1 MeV",
+                                     "/B4c/neutron/rouletteSurvival 0.1"]),
+]
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--events", type=int, default=20000)
+parser.add_argument("--threads", type=int, default=4)
+parser.add_argument("--seed", type=int, default=12345)
+args = parser.parse_args()
+
+exe = os.path.abspath(args.exe)
+
+header = "{:<28} {:>10} {:>7} {:>9}".format("setting", "events/s", "gain", "yield")
+header += "".join(" {:>8}".format(label) for label, _, _ in WINDOWS) + " {:>9}".format("chi2/ndf")
+print(header)
+
+reference = None
+for name, before, after in SETTINGS:
+    workdir = tempfile.mkdtemp(prefix="cuts_bench_")
+    commands = ["/process/em/verbose 0", "/process/had/verbose 0",
+                "/B4c/output/fileName " + os.path.join(workdir, "sim.csv"),
+                "/B4c/output/rootNtuples false"]
+    commands += before + ["/run/initialize"] + after
+    commands += ["/run/printProgress 0", "/run/beamOn {}".format(args.events)]
+    result = run_simulation(exe, commands, threads=args.threads, workdir=workdir,
+                            extra_args=["--seed", str(args.seed)])
+
+    histo = glob.glob(os.path.join(workdir, "sim*h1_Energy*.csv"))
+    spectrum = read_h1_csv(histo[0])
+    edges, sw, _ = spectrum
+    shutil.rmtree(workdir)
+
+    current = {"rate": result["events_per_s"], "spectrum": spectrum, "yield": sum(sw),
+               "lines": [window_sum(edges, sw, low, high) for _, low, high in WINDOWS]}
+    if reference is None:
+        reference = current
+
+    ratio = lambda a, b: a / b if b else float("nan")
+    line = "{:<28} {:>10.1f} {:>7.2f} {:>9.3f}".format(
+        name, current["rate"], ratio(current["rate"], reference["rate"]),
+        ratio(current["yield"], reference["yield"]))
+    line += "".join(" {:>8.3f}".format(ratio(c, r))
+                    for c, r in zip(current["lines"], reference["lines"]))
+    # 5 keV bins, merged by 10
+    line += " {:>9.2f}".format(chi2_ndf(spectrum, reference["spectrum"], 10))
+    print(line)
+
+print("\ngain, yield and line columns are ratios to the default setting;")
+print("chi2/ndf compares the spectra in 50 keV bins (1 or below when compatible).")
@@ -0,0 +1,119 @@
+"""fastsim_validation.py
+Validates the fast simulation of the crystals (--fastSim) against
+the full simulation: the same seeded prompt gammas, aimed at the scatter,
+are replayed in both modes and the Escat/Eabso spectra and the centroid
+distributions of the coincidences are compared.
+
+Spectra are compared bin by bin (chi2/ndf after rebinning; both modes
+process the same events) and in the prompt-gamma line windows, the
+centroids by the mean and rms of each coordinate. The run fails when a
+spectrum exceeds --max-chi2 or a centroid mean moves by more than
+--max-shift mm.
+
+Usage: python3 fastsim_validation.py [--events N] [--threads T] [--seed S]
+Also available as the validate_fastsim build target.
+"""
+import argparse
+import array
+import glob
+import json
+import math
+import os
+import shutil
+import sys
+import tempfile
+
+from benchutil import (LINE_WINDOWS, chi2_ndf, read_h1_csv, run_simulation, window_sum,
+                       write_phase_space)
+
+COORDINATES = ["scatPosiX", "scatPosiY", "scatPosiZ", "absoPosiX", "absoPosiY", "absoPosiZ"]
+
+
+def read_column(directory, table, column):
+    """Values of a float64 column of the columnar output."""
+    with open(os.path.join(directory, table + ".json")) as f:
+        header = json.load(f)
+    values = array.array("d")
+    for entry in header["columns"]:
+        if entry["name"] == column and header["rows"] > 0:
+            with open(os.path.join(directory, entry["file"]), "rb") as f:
+                values.fromfile(f, header["rows"])
+    return values
+
+
+def run_mode(exe, fast, phsp, events, threads, seed):
+    workdir = tempfile.mkdtemp(prefix="fastsim_")
+    columns = os.path.join(workdir, "columns")
+    commands = ["/process/em/verbose 0", "/process/had/verbose 0",
+                "/B4c/output/fileName " + os.path.join(workdir, "sim.csv"),
+                "/B4c/output/columnDirectory " + columns, "/B4c/output/rootNtuples false",
+                "/run/initialize", "/run/printProgress 0", "/B4c/gun/replay " + phsp,
+                "/run/beamOn {}".format(events)]
+    result = run_simulation(exe, commands, threads=threads, workdir=workdir,
+                            extra_args=["--seed", str(seed)] + (["--fastSim"] if fast else []))
+
+    for name in ("Escat", "Eabso"):
+        result[name] = read_h1_csv(glob.glob(os.path.join(workdir, "sim*h1_" + name + "*.csv"))[0])
+    result["centroids"] = {c: read_column(columns, "Detection", c) for c in COORDINATES}
+    shutil.rmtree(workdir)
+    return result
+
+
+def mean_rms(values):
+    if not values:
+        return 0., 0.
+    mean = sum(values) / len(values)
+    return mean, math.sqrt(max(sum(v * v for v in values) / len(values) - mean * mean, 0.))
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--events", type=int, default=100000)
+parser.add_argument("--threads", type=int, default=4)
+parser.add_argument("--seed", type=int, default=12345)
+parser.add_argument("--rebin", type=int, default=20, help="histogram bins merged for chi2")
+parser.add_argument("--max-chi2", type=float, default=3.0)
+parser.add_argument("--max-shift", type=float, default=1.0, help="centroid mean shift [mm]")
+args = parser.parse_args()
+
+exe = os.path.abspath(args.exe)
+phsp_dir = tempfile.mkdtemp(prefix="fastsim_phsp_")
+phsp = os.path.join(phsp_dir, "gammas")
+write_phase_space(phsp + ".phsp", args.events, True, args.seed)
+full = run_mode(exe, False, phsp, args.events, args.threads, args.seed)
+fast = run_mode(exe, True, phsp, args.events, args.threads, args.seed)
+shutil.rmtree(phsp_dir)
+
+failures = []
+print("{:<10} {:>12} {:>12}".format("", "full", "fast"))
+print("{:<10} {:>12.1f} {:>12.1f}".format("events/s", full["events_per_s"], fast["events_per_s"]))
+print("{:<10} {:>12} {:>12}".format("coincid.", len(full["centroids"]["scatPosiX"]),
+                                    len(fast["centroids"]["scatPosiX"])))
+
+print("\n{:<8} {:>9}".format("spectrum", "chi2/ndf") +
+      "".join(" {:>15}".format(label + " MeV full/fast") for label, _, _ in LINE_WINDOWS))
+for name in ("Escat", "Eabso"):
+    chi2 = chi2_ndf(full[name], fast[name], args.rebin)
+    line = "{:<8} {:>9.2f}".format(name, chi2)
+    for _, low, high in LINE_WINDOWS:
+        line += " {:>7.4f}/{:<7.4f}".format(
+            window_sum(full[name][0], full[name][1], low, high) / args.events,
+            window_sum(fast[name][0], fast[name][1], low, high) / args.events)
+    print(line)
+    if chi2 > args.max_chi2:
+        failures.append("{} chi2/ndf {:.2f}".format(name, chi2))
+
+print("\n{:<10} {:>10} {:>10} {:>10} {:>10}".format("centroid", "full mean", "fast mean",
+                                                    "full rms", "fast rms"))
+for coordinate in COORDINATES:
+    full_mean, full_rms = mean_rms(full["centroids"][coordinate])
+    fast_mean, fast_rms = mean_rms(fast["centroids"][coordinate])
+    print("{:<10} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}".format(
+        coordinate, full_mean, fast_mean, full_rms, fast_rms))
+    if abs(fast_mean - full_mean) > args.max_shift:
+        failures.append("{} mean shifted by {:.2f} mm".format(coordinate, fast_mean - full_mean))
+
+if failures:
+    print("\nfast simulation differs: " + "; ".join(failures))
+    sys.exit(1)
+print("\nfast simulation agrees with the full simulation")
@@ -0,0 +1,95 @@
+"""filter_validation.py
+A/B check of the acceptance filter (/B4c/filter/): the proton beam is
+simulated with and without it and the Escat/Eabso spectra are compared.
+
+The filter changes the random sequence, so the two runs are independent
+samples: spectra are compared by chi2/ndf after rebinning and in the
+prompt-gamma line windows. The run fails when a spectrum exceeds
+--max-chi2. The throughput of both runs and the filter summary (tracks
+killed, steps saved) are printed.
+
+Usage: python3 filter_validation.py [--events N] [--threads T] [--seed S]
+       [--policy gamma=ray ...]
+Also available as the validate_filter build target.
+"""
+import argparse
+import glob
+import os
+import shutil
+import sys
+import tempfile
+
+from benchutil import LINE_WINDOWS, chi2_ndf, read_h1_csv, run_simulation, window_sum
+
+
+def run_mode(exe, commands, events, threads, seed):
+    workdir = tempfile.mkdtemp(prefix="filter_")
+    macro = ["/process/em/verbose 0", "/process/had/verbose 0",
+             "/B4c/output/fileName " + os.path.join(workdir, "sim.csv"),
+             "/B4c/output/rootNtuples false", "/run/initialize", "/run/printProgress 0"]
+    macro += commands + ["/run/beamOn {}".format(events)]
+    result = run_simulation(exe, macro, threads=threads, workdir=workdir,
+                            extra_args=["--seed", str(seed)])
+
+    for name in ("Escat", "Eabso"):
+        result[name] = read_h1_csv(glob.glob(os.path.join(workdir, "sim*h1_" + name + "*.csv"))[0])
+    shutil.rmtree(workdir)
+    return result
+
+
+def filter_summary(stdout):
+    """Lines of the last acceptance filter table printed by the run."""
+    lines = stdout.splitlines()
+    starts = [i for i, line in enumerate(lines) if "Acceptance filter" in line]
+    if not starts:
+        return []
+    summary = []
+    for line in lines[starts[-1] + 1:]:
+        if line.startswith("-----"):
+            break
+        summary.append(line)
+    return summary
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--events", type=int, default=20000)
+parser.add_argument("--threads", type=int, default=4)
+parser.add_argument("--seed", type=int, default=12345)
+parser.add_argument("--policy", action="append", default=[],
+                    help="particle=policy, e.g. electron=keep (see /B4c/filter/)")
+parser.add_argument("--rebin", type=int, default=20, help="histogram bins merged for chi2")
+parser.add_argument("--max-chi2", type=float, default=3.0)
+args = parser.parse_args()
+
+exe = os.path.abspath(args.exe)
+filter_commands = ["/B4c/filter/enable true"]
+filter_commands += ["/B4c/filter/" + " ".join(p.split("=", 1)) for p in args.policy]
+analog = run_mode(exe, [], args.events, args.threads, args.seed)
+filtered = run_mode(exe, filter_commands, args.events, args.threads, args.seed)
+
+print("{:<10} {:>12} {:>12}".format("", "unfiltered", "filtered"))
+print("{:<10} {:>12.1f} {:>12.1f}".format("events/s", analog["events_per_s"],
+                                          filtered["events_per_s"]))
+if analog["events_per_s"] > 0.:
+    print("{:<10} {:>25.2f}".format("speedup", filtered["events_per_s"] / analog["events_per_s"]))
+print("\n".join(filter_summary(filtered["stdout"])))
+
+failures = []
+print("\n{:<8} {:>9}".format("spectrum", "chi2/ndf") +
+      "".join(" {:>15}".format(label + " MeV A/B") for label, _, _ in LINE_WINDOWS))
+for name in ("Escat", "Eabso"):
+    chi2 = chi2_ndf(analog[name], filtered[name], args.rebin)
+    line = "{:<8} {:>9.2f}".format(name, chi2)
+    for _, low, high in LINE_WINDOWS:
+        line += " {:>7.4f}/{:<7.4f}".format(
+            window_sum(analog[name][0], analog[name][1], low, high) / args.events,
+            window_sum(filtered[name][0], filtered[name][1], low, high) / args.events)
+    print(line)
+    if chi2 > args.max_chi2:
+        failures.append("{} chi2/ndf {:.2f}".format(name, chi2))
+
+if failures:
+    print("\nfiltered spectra differ: " + "; ".join(failures))
+    sys.exit(1)
+print("\nfiltered spectra agree with the unfiltered ones")
@@ -0,0 +1,105 @@
+"""macro_benchmark.py
+Before/after throughput of two exampleB4c builds on the same macro
+(run2.mac by default), with the same seed, thread count and event count.
+
+The active commands of the macro are kept; /run/numberOfThreads and
+/run/printProgress are dropped, the seed is set with /random/setSeeds
+and /run/beamOn gets the event count of the benchmark. The seed is set
+in the macro, not with --seed, so that builds older than that option
+run the same events.
+
+Each build runs the macro with --events and with --events / 10 events;
+events/s is the difference of events over the difference of wall times,
+which leaves the initialization out and needs nothing printed by the
+build. The median of --repeat such pairs is reported.
+
+Usage: python3 macro_benchmark.py --baseline-exe old/exampleB4c
+                                  [--exe ./exampleB4c] [--macro run2.mac]
+                                  [--events N] [--threads T] [--seed S]
+                                  [--repeat R] [--report macro_report.json]
+Also available as the bench_run2 build target when B4C_BENCH_BASELINE_EXE
+is set.
+"""
+import argparse
+import datetime
+import json
+import os
+import platform
+import shutil
+import statistics
+import tempfile
+
+from benchutil import run_simulation
+
+DROPPED = ("/run/numberOfThreads", "/run/printProgress", "/run/beamOn")
+
+
+def macro_commands(path, events, seed):
+    """Active commands of the macro, seeded, ending with /run/beamOn events."""
+    commands = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith("#") or line.startswith(DROPPED):
+                continue
+            commands.append(line)
+    return commands + ["/run/printProgress 0", "/random/setSeeds {} {}".format(seed, seed + 1),
+                       "/run/beamOn {}".format(events)]
+
+
+def measure(exe, macro, events, threads, seed):
+    """Events/s of one long and one short run of the macro, and the peak RSS."""
+    walls = []
+    max_rss = 0.
+    for nof_events in (events, events // 10):
+        workdir = tempfile.mkdtemp(prefix="macro_bench_")
+        result = run_simulation(exe, macro_commands(macro, nof_events, seed), threads=threads,
+                                workdir=workdir)
+        shutil.rmtree(workdir)
+        walls.append(result["wall_s"])
+        max_rss = max(max_rss, result["max_rss_mb"])
+    run_s = walls[0] - walls[1]
+    events_per_s = (events - events // 10) / run_s if run_s > 0. else 0.
+    return {"events_per_s": events_per_s, "wall_s": walls[0], "max_rss_mb": max_rss}
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--baseline-exe", required=True, help="build to compare with")
+parser.add_argument("--macro", default="run2.mac")
+parser.add_argument("--events", type=int, default=100000)
+parser.add_argument("--threads", type=int, default=4)
+parser.add_argument("--seed", type=int, default=12345)
+parser.add_argument("--repeat", type=int, default=3)
+parser.add_argument("--report", default="macro_report.json")
+args = parser.parse_args()
+
+macro = os.path.abspath(args.macro)
+builds = [("baseline", os.path.abspath(args.baseline_exe)),
+          ("current", os.path.abspath(args.exe))]
+report = {"date": datetime.datetime.now().isoformat(timespec="seconds"),
+          "host": platform.node(), "cpus": os.cpu_count(), "macro": macro,
+          "events": args.events, "threads": args.threads, "seed": args.seed, "builds": {}}
+
+print("{:<9} {:>12} {:>10} {:>9}".format("build", "events/s", "wall [s]", "RSS [MB]"))
+for name, exe in builds:
+    runs = [measure(exe, macro, args.events, args.threads, args.seed)
+            for _ in range(args.repeat)]
+    result = {"exe": exe,
+              "events_per_s": statistics.median(r["events_per_s"] for r in runs),
+              "wall_s": statistics.median(r["wall_s"] for r in runs),
+              "max_rss_mb": max(r["max_rss_mb"] for r in runs),
+              "runs": runs}
+    report["builds"][name] = result
+    print("{:<9} {:>12.1f} {:>10.1f} {:>9.0f}".format(name, result["events_per_s"],
+                                                      result["wall_s"], result["max_rss_mb"]),
+          flush=True)
+
+before = report["builds"]["baseline"]["events_per_s"]
+after = report["builds"]["current"]["events_per_s"]
+if before > 0.:
+    report["speedup"] = after / before
+    print("\nspeedup {:.3f} ({:+.1%} events/s)".format(after / before, after / before - 1.))
+with open(args.report, "w") as f:
+    json.dump(report, f, indent=2)
+print("report written to " + args.report)
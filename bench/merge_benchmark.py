@@ -0,0 +1,49 @@
+"""merge_benchmark.py
+Compare built-in ntuple merging through the master with per-thread files
+combined afterwards by mergeOutput.
+
+Usage: python3 merge_benchmark.py [--events N] [--threads 1 4 16 32]
+Run from the build directory (where exampleB4c and mergeOutput live).
+"""
+import argparse
+import glob
+import os
+import shutil
+import tempfile
+
+from benchutil import run_simulation, timed
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--merger", default="./mergeOutput")
+parser.add_argument("--events", type=int, default=100000)
+parser.add_argument("--threads", type=int, nargs="+", default=[1, 4, 16, 32])
+args = parser.parse_args()
+
+exe = os.path.abspath(args.exe)
+merger = os.path.abspath(args.merger)
+
+print("{:>8} {:>12} {:>12} {:>12} {:>12}".format("threads", "mode", "run [s]", "merge [s]", "total [s]"))
+for threads in args.threads:
+    for mode in ("builtin", "perThread"):
+        workdir = tempfile.mkdtemp(prefix="merge_bench_")
+        output = os.path.join(workdir, "simulation.root")
+        commands = [
+            "/process/em/verbose 0",
+            "/process/had/verbose 0",
+            "/B4c/output/fileName " + output,
+            "/B4c/output/perThreadFiles " + ("true" if mode == "perThread" else "false"),
+            "/run/initialize",
+            "/run/printProgress 0",
+            "/run/beamOn {}".format(args.events),
+        ]
+        result = run_simulation(exe, commands, threads=threads, workdir=workdir)
+
+        merge_s = 0.0
+        if mode == "perThread":
+            inputs = sorted(glob.glob(os.path.join(workdir, "simulation_run0*.root")))
+            merge_s = timed([merger, "-j", str(threads), os.path.join(workdir, "merged.root")] + inputs)
+
+        print("{:>8} {:>12} {:>12.2f} {:>12.2f} {:>12.2f}".format(
+            threads, mode, result["wall_s"], merge_s, result["wall_s"] + merge_s))
+        shutil.rmtree(workdir)
@@ -0,0 +1,60 @@
+"""physics_benchmark.py
+Same seeded workload under each physics list (exampleB4c -p), side by
+side: events/s, peak RSS, initialization time and the prompt-gamma line
+yields per primary proton.
+
+Usage: python3 physics_benchmark.py [--events N] [--threads T] [--seed S]
+                                    [--lists QGSP_BIC_HP QGSP_BIC ...]
+Also available as the bench_physics build target.
+"""
+import argparse
+import glob
+import os
+import shutil
+import tempfile
+
+from benchutil import LINE_WINDOWS, read_h1_csv, run_simulation, window_sum
+
+# _EMY/_EMZ: reference list with EM option 3/4
+LISTS = ["QGSP_BIC_HP", "QGSP_BIC", "QGSP_BIC_EMY", "QGSP_BIC_HP_EMY", "QGSP_BIC_HP_EMZ",
+         "myPhysicsList"]
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exe", default="./exampleB4c")
+parser.add_argument("--events", type=int, default=20000)
+parser.add_argument("--threads", type=int, default=4)
+parser.add_argument("--seed", type=int, default=12345)
+parser.add_argument("--lists", nargs="+", default=LISTS)
+args = parser.parse_args()
+
+exe = os.path.abspath(args.exe)
+preamble = ["/process/em/verbose 0", "/process/had/verbose 0"]
+
+header = "{:<18} {:>10} {:>9} {:>9}".format("physics list", "events/s", "RSS [MB]", "init [s]")
+header += "".join(" {:>9}".format(label + " MeV") for label, _, _ in LINE_WINDOWS)
+print(header)
+
+for physics in args.lists:
+    extra = ["-p", physics, "--seed", str(args.seed)]
+    workdir = tempfile.mkdtemp(prefix="physics_bench_")
+
+    # Initialization alone (geometry, physics and tables, threads started)
+    init = run_simulation(exe, preamble + ["/run/initialize"], threads=args.threads,
+                          workdir=workdir, extra_args=extra)
+
+    commands = preamble + ["/B4c/output/fileName " + os.path.join(workdir, "sim.csv"),
+                           "/B4c/output/rootNtuples false", "/run/initialize",
+                           "/run/printProgress 0", "/run/beamOn {}".format(args.events)]
+    result = run_simulation(exe, commands, threads=args.threads, workdir=workdir,
+                            extra_args=extra)
+
+    edges, sw, _ = read_h1_csv(glob.glob(os.path.join(workdir, "sim*h1_Energy*.csv"))[0])
+    shutil.rmtree(workdir)
+
+    line = "{:<18} {:>10.1f} {:>9.0f} {:>9.1f}".format(
+        physics, result["events_per_s"], result["max_rss_mb"], init["wall_s"])
+    line += "".join(" {:>9.4f}".format(window_sum(edges, sw, low, high) / args.events)
+                    for _, low, high in LINE_WINDOWS)
+    print(line)
+
+print("\nline columns: weighted prompt gammas per primary in each line window")
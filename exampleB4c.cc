@@ -1,15 +1,24 @@
 #include "ActionInitialization.hh"
+#include "Checkpoint.hh"
 #include "DetectorConstruction.hh"
-#include "QGSP_BIC_HP.hh"
+#include "PhysicsList.hh"
+#include "Sharding.hh"
+#include "Startup.hh"
 
+#include "G4FastSimulationPhysics.hh"
+#include "G4PhysListFactory.hh"
 #include "G4RunManagerFactory.hh"
 #include "G4SteppingVerbose.hh"
 #include "G4UIExecutive.hh"
 #include "G4UIcommand.hh"
 #include "G4UImanager.hh"
-#include "G4VisExecutive.hh"
 #include "Randomize.hh"
 
+#ifndef B4C_HEADLESS
+#include "G4VisExecutive.hh"
+#endif
+
+#include <cstdio>
 #include <ctime>
 #include <unistd.h>
 
@@ -20,8 +29,19 @@ namespace
 void PrintUsage()
 {
   G4cerr << " Usage: " << G4endl;
-  G4cerr << " exampleB4c [-m macro ] [-u UIsession] [-t nThreads] [-vDefault]" << G4endl;
+  G4cerr << " exampleB4c [-m macro ] [-u UIsession] [-t nThreads] [-p physicsList] [-vDefault]"
+         << G4endl;
+  G4cerr << "            [--seed masterSeed] [--shard i/N] [--resume checkpoint]" << G4endl;
+  G4cerr << "            [--tables cacheDirectory] [--fastSim]" << G4endl;
   G4cerr << "   note: -t option is available only for multi-threaded mode." << G4endl;
+  G4cerr << "   -p takes a reference list (default QGSP_BIC_HP; e.g. QGSP_BIC, QGSP_BIC_EMY," << G4endl;
+  G4cerr << "   QGSP_BIC_HP_EMY or QGSP_BIC_HP_EMZ for EM options 3/4) or myPhysicsList" << G4endl;
+  G4cerr << "   --shard i/N runs the i-th of N equal parts of the job; use the same" << G4endl;
+  G4cerr << "   macro and --seed for all parts and combine them with merge_shards.py" << G4endl;
+  G4cerr << "   --resume continues a run from /B4c/output/checkpointFile, same macro" << G4endl;
+  G4cerr << "   --tables stores the physics tables in cacheDirectory at the first run" << G4endl;
+  G4cerr << "   and retrieves them from there in later jobs" << G4endl;
+  G4cerr << "   --fastSim parameterises the electrons in the crystals (/B4c/fast/)" << G4endl;
 }
 }  // namespace
 
@@ -29,20 +49,31 @@ void PrintUsage()
 
 int main(int argc, char** argv)
 {
-  // Evaluate arguments
-  //
-  if (argc > 7) {
-    PrintUsage();
-    return 1;
-  }
+  // Start the startup clock
+  Startup::Instance();
 
+  // Evaluate arguments, every option but -vDefault and --fastSim takes a value
+  //
   G4String macro;
   G4String session;
   G4bool verboseBestUnits = true;
+  G4bool fixedSeed = false;
+  unsigned long long seed = 0;
+  G4int shardIndex = 0;
+  G4int nofShards = 1;
+  G4String resumeFile;
+  G4String physicsListName = "QGSP_BIC_HP";
+  G4String tableDirectory;
+  G4bool fastSimulation = false;
 #ifdef G4MULTITHREADED
   G4int nThreads = 0;
 #endif
   for (G4int i = 1; i < argc; i = i + 2) {
+    auto isFlag = G4String(argv[i]) == "-vDefault" || G4String(argv[i]) == "--fastSim";
+    if (!isFlag && i + 1 >= argc) {
+      PrintUsage();
+      return 1;
+    }
     if (G4String(argv[i]) == "-m")
       macro = argv[i + 1];
     else if (G4String(argv[i]) == "-u")
@@ -52,6 +83,34 @@ int main(int argc, char** argv)
       nThreads = G4UIcommand::ConvertToInt(argv[i + 1]);
     }
 #endif
+    else if (G4String(argv[i]) == "-p") {
+      physicsListName = argv[i + 1];
+    }
+    else if (G4String(argv[i]) == "--seed") {
+      if (std::sscanf(argv[i + 1], "%llu", &seed) != 1) {
+        PrintUsage();
+        return 1;
+      }
+      fixedSeed = true;
+    }
+    else if (G4String(argv[i]) == "--shard") {
+      if (std::sscanf(argv[i + 1], "%d/%d", &shardIndex, &nofShards) != 2 || nofShards < 1
+          || shardIndex < 0 || shardIndex >= nofShards)
+      {
+        PrintUsage();
+        return 1;
+      }
+    }
+    else if (G4String(argv[i]) == "--resume") {
+      resumeFile = argv[i + 1];
+    }
+    else if (G4String(argv[i]) == "--tables") {
+      tableDirectory = argv[i + 1];
+    }
+    else if (G4String(argv[i]) == "--fastSim") {
+      fastSimulation = true;
+      --i;  // this option is not followed with a parameter
+    }
     else if (G4String(argv[i]) == "-vDefault") {
       verboseBestUnits = false;
       --i;  // this option is not followed with a parameter
@@ -62,6 +121,13 @@ int main(int argc, char** argv)
     }
   }
 
+  G4PhysListFactory physListFactory;
+  if (physicsListName != "myPhysicsList" && !physListFactory.IsReferencePhysList(physicsListName)) {
+    G4cerr << " Unknown physics list " << physicsListName << G4endl;
+    PrintUsage();
+    return 1;
+  }
+
   // Detect interactive mode (if no macro provided) and define UI session
   //
   G4UIExecutive* ui = nullptr;
@@ -79,9 +145,32 @@ int main(int argc, char** argv)
   }
 
   // Set random seed
+  // Events are reseeded from the master seed and their global number (see
+  // Sharding), so a run is reproduced by passing the printed seed to --seed.
+  // Without it the seed also depends on the process ID, so that jobs started
+  // in the same second differ.
   //
-  long seed = static_cast<long>(std::time(nullptr));
-  CLHEP::HepRandom::setTheSeed(seed);
+  if (!resumeFile.empty()) {
+    // The events left are seeded as in the interrupted run
+    auto checkpointSeed = Checkpoint::Instance()->LoadResumeFile(resumeFile);
+    if (fixedSeed && seed != checkpointSeed) {
+      G4cerr << " --seed differs from the seed of the checkpoint, " << checkpointSeed << G4endl;
+      return 1;
+    }
+    seed = checkpointSeed;
+    fixedSeed = true;
+  }
+  if (!fixedSeed) {
+    seed = static_cast<unsigned long long>(std::time(nullptr)) * 1000003ULL
+           + static_cast<unsigned long long>(getpid());
+  }
+  if (nofShards > 1 && !fixedSeed) {
+    G4cerr << " --shard requires --seed, all shards must share the master seed" << G4endl;
+    return 1;
+  }
+  Sharding::Instance()->Configure(seed, shardIndex, nofShards);
+  CLHEP::HepRandom::setTheSeed(static_cast<long>(seed & 0x7fffffff));
+  G4cout << "Master seed " << seed << ", shard " << shardIndex << "/" << nofShards << G4endl;
 
   // Construct the default run manager
   //
@@ -95,19 +184,50 @@ int main(int argc, char** argv)
   // Set mandatory initialization classes
   //
   auto detConstruction = new DetectorConstruction();
+  detConstruction->SetFastSimulation(fastSimulation);
   runManager->SetUserInitialization(detConstruction);
 
-  auto PhysicsList = new QGSP_BIC_HP();
-  runManager->SetUserInitialization(PhysicsList);
+  // Reference physics lists by name, the suffixes _EMY/_EMZ replace the
+  // standard EM physics with options 3/4
+  G4VModularPhysicsList* physicsList = nullptr;
+  if (physicsListName == "myPhysicsList") {
+    physicsList = new myPhysicsList();
+  }
+  else {
+    physicsList = physListFactory.GetReferencePhysList(physicsListName);
+  }
+  G4cout << "Physics list " << physicsListName << G4endl;
+
+  // Electrons and positrons may be handed to the fast simulation model of
+  // the crystals (CrystalFastModel, /B4c/fast/). Registered on request only:
+  // the process is paid on every e-/e+ step, even with the model disabled
+  if (fastSimulation) {
+    auto fastSimulationPhysics = new G4FastSimulationPhysics();
+    fastSimulationPhysics->ActivateFastSimulation("e-");
+    fastSimulationPhysics->ActivateFastSimulation("e+");
+    physicsList->RegisterPhysics(fastSimulationPhysics);
+  }
+
+  if (!tableDirectory.empty()) {
+    Startup::Instance()->UsePhysicsTableCache(physicsList, tableDirectory, physicsListName);
+  }
+  runManager->SetUserInitialization(physicsList);
 
   auto actionInitialization = new ActionInitialization();
   runManager->SetUserInitialization(actionInitialization);
 
-  // Initialize visualization
-  auto visManager = new G4VisExecutive;
-  // G4VisExecutive can take a verbosity argument - see /vis/verbose guidance.
-  // auto visManager = new G4VisExecutive("Quiet");
-  visManager->Initialize();
+  // Initialize visualization, only for interactive sessions: batch jobs
+  // do not pay for the registration of the graphics systems. The headless
+  // build (exampleB4c_headless) has no visualization at all.
+#ifndef B4C_HEADLESS
+  G4VisManager* visManager = nullptr;
+  if (!macro.size()) {
+    visManager = new G4VisExecutive;
+    // G4VisExecutive can take a verbosity argument - see /vis/verbose guidance.
+    // auto visManager = new G4VisExecutive("Quiet");
+    visManager->Initialize();
+  }
+#endif
 
   // Get the pointer to the User Interface manager
   auto UImanager = G4UImanager::GetUIpointer();
@@ -121,10 +241,14 @@ int main(int argc, char** argv)
   }
   else {
     // interactive mode : define UI session
+#ifdef B4C_HEADLESS
+    UImanager->ApplyCommand("/run/initialize");
+#else
     UImanager->ApplyCommand("/control/execute init_vis.mac");
     if (ui->IsGUI()) {
       UImanager->ApplyCommand("/control/execute gui.mac");
     }
+#endif
     ui->SessionStart();
     delete ui;
   }
@@ -134,6 +258,8 @@ int main(int argc, char** argv)
   // owned and deleted by the run manager, so they should not be deleted
   // in the main() program !
 
+#ifndef B4C_HEADLESS
   delete visManager;
+#endif
   delete runManager;
 }
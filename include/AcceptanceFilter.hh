@@ -0,0 +1,95 @@
+#ifndef AcceptanceFilter_h
+#define AcceptanceFilter_h 1
+
+#include "ThreadLocalRegistry.hh"
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <array>
+#include <cstdint>
+
+class G4GenericMessenger;
+class G4LogicalVolume;
+class G4ParticleDefinition;
+
+/// Kills tracks that leave the Target and cannot reach the camera,
+/// /B4c/filter/.
+///
+/// When a track steps out of the Target into the World its particle type
+/// picks the policy: keep it, kill it, or test the straight line from the
+/// exit point along its direction against the box around the Scatter and
+/// Absorber, enlarged by a margin, and kill it when the line misses. The
+/// World holds only air, so gammas and neutrons leave it on that line and
+/// default to the ray test. Electrons and positrons are kept by default:
+/// they scatter, and a positron annihilates into two isotropic 511 keV
+/// gammas that may reach the camera; the ray test is opt-in for them. The
+/// filter is off by default.
+///
+/// Every probeInterval-th track to be killed is tracked on instead and its
+/// own remaining steps are counted, not those of its secondaries; the
+/// master prints the tracks killed per type and the steps saved, a lower
+/// bound estimated from these probes, at the end of the run.
+
+class AcceptanceFilter
+{
+  public:
+    static AcceptanceFilter* Instance();
+
+    enum Category { kGamma, kNeutron, kElectron, kOther, kNofCategories };
+    enum Policy { kKeep, kRay, kKill };
+    enum Decision { kPass, kReject, kProbe };
+
+    G4bool IsEnabled() const { return fEnabled; }
+    const G4LogicalVolume* GetTargetLV() const { return fTargetLV; }
+    Category GetCategory(const G4ParticleDefinition* particle) const;
+
+    // Any thread: a track of the category leaves the Target at position
+    // with direction; counts it and returns what to do with it
+    Decision Decide(Category category, const G4ThreeVector& position,
+                    const G4ThreeVector& direction);
+    // Any thread: a probe has ended after steps further steps
+    void CountProbe(Category category, G4int steps);
+
+    // Master (or sequential) thread: the geometry of the run, before the
+    // workers start it, and the summary at its end
+    void BeginRun();
+    void EndRun();
+
+  private:
+    AcceptanceFilter();
+    ~AcceptanceFilter();
+
+    struct Counters
+    {
+        std::array<std::uint64_t, kNofCategories> exits{};
+        std::array<std::uint64_t, kNofCategories> killed{};
+        std::array<std::uint64_t, kNofCategories> probes{};
+        std::array<std::uint64_t, kNofCategories> probeSteps{};
+        std::uint64_t sinceProbe = 0;
+    };
+
+    G4bool HitsCamera(const G4ThreeVector& position, const G4ThreeVector& direction) const;
+    void SetPolicy(Category category, const G4String& policy);
+    void SetGammaPolicy(const G4String& policy) { SetPolicy(kGamma, policy); }
+    void SetNeutronPolicy(const G4String& policy) { SetPolicy(kNeutron, policy); }
+    void SetElectronPolicy(const G4String& policy) { SetPolicy(kElectron, policy); }
+    void SetOtherPolicy(const G4String& policy) { SetPolicy(kOther, policy); }
+    void DefineCommands();
+
+    G4bool fEnabled = false;
+    std::array<Policy, kNofCategories> fPolicy{kRay, kRay, kKeep, kKeep};
+    G4double fMargin;
+    G4int fProbeInterval = 100;
+
+    // Set by BeginRun
+    const G4LogicalVolume* fTargetLV = nullptr;
+    G4ThreeVector fCameraMin;
+    G4ThreeVector fCameraMax;
+
+    ThreadLocalRegistry<Counters> fCounters;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef AdaptiveRun_h
+#define AdaptiveRun_h 1
+
+#include "ThreadLocalRegistry.hh"
+
+#include "globals.hh"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class G4GenericMessenger;
+
+/// Ends a run once a statistic reaches a target precision, /B4c/adaptive/.
+///
+/// Two statistics are available: the coincidences per event whose total
+/// energy lies in the energy window (relative precision), and the distal
+/// falloff of the depth profile along the beam (x) of the prompt gammas
+/// in the window, where the profile drops to half its maximum (precision
+/// in mm); the default window holds the 4.44 MeV line.
+///
+/// Every thread sums its events into batches of batchEvents events, and
+/// hands each full batch over under a lock. A monitor thread on the
+/// master takes them every interval and estimates the uncertainty by
+/// batch means: from the spread of the batch yields, or of the falloff of
+/// 20 groups of batches. Once it is below the target (after minBatches
+/// batches) the threads abort the run softly, each after its current
+/// event; /run/beamOn then gives only the maximum number of events.
+
+class AdaptiveRun
+{
+  public:
+    static AdaptiveRun* Instance();
+
+    G4bool IsActive() const { return fActive; }
+    G4bool IsStopRequested() const { return fStopRequested.load(std::memory_order_relaxed); }
+
+    // Thread processing events, while active
+    void CountCoincidence(G4double totalEnergy, G4double weight);
+    void AddPromptGamma(G4double depth, G4double energy, G4double weight);
+    void EndOfEvent();
+
+    // Master (or sequential) thread, around a run
+    void Start();
+    void Stop();
+
+  private:
+    AdaptiveRun();
+    ~AdaptiveRun();
+
+    enum class Statistic { None, Window, Falloff };
+    static constexpr std::size_t kNofGroups = 20;
+
+    struct Batch
+    {
+        G4int events = 0;
+        G4double count = 0.;
+        std::vector<G4double> depth;  // falloff: weight per depth bin
+    };
+
+    struct Accumulator
+    {
+        G4int run = -1;  // of the batch being filled
+        Batch batch;
+    };
+
+    struct Estimate
+    {
+        G4bool valid = false;
+        G4double value = 0.;
+        G4double error = 0.;  // absolute
+    };
+
+    Accumulator& Local();
+    void ResetBatch(Batch& batch) const;
+    void Collect();
+    Estimate Evaluate() const;
+    G4bool Falloff(const std::vector<G4double>& depth, G4double& position) const;
+    G4bool IsPrecise(const Estimate& estimate) const;
+    void MonitorLoop();
+    void SetStatistic(const G4String& name);
+    void DefineCommands();
+
+    Statistic fStatistic = Statistic::None;
+    G4double fRelativePrecision = 0.01;
+    G4double fFalloffPrecision;
+    G4double fEnergyMin;
+    G4double fEnergyMax;
+    G4int fBatchEvents = 1000;
+    G4int fMinBatches = 20;
+    G4double fInterval;
+
+    // Current run; the depth bins span the Target along x
+    G4bool fActive = false;
+    G4int fRun = 0;
+    G4double fDepthMin = 0.;
+    G4double fDepthBin = 0.;
+    G4int fNofDepthBins = 0;
+    std::atomic<G4bool> fStopRequested{false};
+
+    // Batches handed over by the threads
+    ThreadLocalRegistry<Accumulator> fAccumulators;
+    std::mutex fMutex;
+    std::vector<Batch> fPending;  // guarded by fMutex
+
+    // Monitor thread only, then the master once it has stopped
+    std::vector<G4double> fYields;
+    std::array<std::vector<G4double>, kNofGroups> fGroups;
+    std::size_t fNofBatches = 0;
+
+    std::thread fMonitor;
+    std::mutex fStopMutex;
+    std::condition_variable fStopCondition;
+    G4bool fMonitorStop = false;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
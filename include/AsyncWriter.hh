@@ -0,0 +1,103 @@
+#ifndef AsyncWriter_h
+#define AsyncWriter_h 1
+
+#include "EventAction.hh"
+#include "RingBuffer.hh"
+
+#include "globals.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Output pipeline with a dedicated writer thread.
+///
+/// Every thread processing events pushes its fixed-size records into its
+/// own single-producer ring buffers; the writer thread drains all rings
+/// in batches and performs the file I/O of the columnar output. When a
+/// ring is full the producer waits, and these waits are reported at the
+/// end of the run to size the buffers.
+
+class AsyncWriter
+{
+  public:
+    static AsyncWriter* Instance();
+
+    // Master (or sequential) thread, around a run with open ColumnOutput
+    void Start(G4int detectionTableID, G4int promptTableID, G4int pixelTableID);
+    void Stop();
+    G4bool IsRunning() const { return fRunning.load(std::memory_order_acquire); }
+
+    // Threads processing events
+    void Push(const EventAction::PromptGamma& record);
+    void Push(const EventAction::Detection& record);
+    void Push(const EventAction::PixelRecord& record);
+    // Calls onWritten on the writer thread once every record pushed so far
+    // by this thread has been appended to the files
+    void PushMarker(std::function<void()> onWritten);
+
+    void SetRingCapacity(std::size_t records) { fRingCapacity = records; }
+
+  private:
+    AsyncWriter() = default;
+
+    struct Producer
+    {
+        Producer(std::size_t capacity) : prompt(capacity), detection(capacity), pixel(capacity) {}
+
+        RingBuffer<EventAction::PromptGamma> prompt;
+        RingBuffer<EventAction::Detection> detection;
+        RingBuffer<EventAction::PixelRecord> pixel;
+
+        // backpressure statistics, written by the producer
+        std::uint64_t nofRecords = 0;
+        std::uint64_t nofStalls = 0;
+        std::uint64_t stallNanoseconds = 0;
+        // ring occupancy high-water mark, written by the writer thread
+        std::size_t maxOccupancy = 0;
+
+        // markers: records pushed (producer) and popped (writer) per ring
+        std::uint64_t promptPushed = 0;
+        std::uint64_t detectionPushed = 0;
+        std::uint64_t pixelPushed = 0;
+        std::uint64_t promptPopped = 0;
+        std::uint64_t detectionPopped = 0;
+        std::uint64_t pixelPopped = 0;
+        struct Marker
+        {
+            std::uint64_t promptCount;
+            std::uint64_t detectionCount;
+            std::uint64_t pixelCount;
+            std::function<void()> onWritten;
+        };
+        std::mutex markerMutex;
+        std::deque<Marker> markers;
+    };
+
+    Producer* GetProducer();
+    template<class T>
+    void PushTo(RingBuffer<T>& ring, Producer* producer, const T& record);
+    std::size_t Drain();
+    void WriterLoop();
+    void PrintStatistics() const;
+
+    std::vector<std::unique_ptr<Producer>> fProducers;
+    std::atomic<G4bool> fRunning{false};
+    std::atomic<G4bool> fStopRequested{false};
+    std::thread fWriter;
+    G4int fDetectionTableID = -1;
+    G4int fPromptTableID = -1;
+    G4int fPixelTableID = -1;
+    std::size_t fRingCapacity = 1 << 16;
+    G4int fGeneration = 0;  // invalidates the producers of earlier runs
+
+    static G4ThreadLocal Producer* fProducer;
+    static G4ThreadLocal G4int fProducerGeneration;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef Checkpoint_h
+#define Checkpoint_h 1
+
+#include "globals.hh"
+
+#include "tools/histo/h1d"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Periodic checkpoint of a run, and its resumption (--resume).
+///
+/// Every thread processing events takes a snapshot of its histograms and
+/// of the events it completed every N events or T seconds. The snapshot
+/// becomes durable once the columnar rows of these events are in the
+/// files: when the checkpoint thread has appended the rows the thread
+/// staged so far (synchronous writing), or when the asynchronous writer
+/// reaches a marker pushed behind them. A background thread on the
+/// master periodically writes the durable state (completed events, summed
+/// histograms and row counts of the column tables) to the checkpoint file.
+///
+/// Events are seeded from their global number (see Sharding), so no
+/// engine state is needed: a resumed run skips the completed events and
+/// simulates the others exactly as the interrupted run would have.
+
+class Checkpoint
+{
+  public:
+    static Checkpoint* Instance();
+
+    // main(): load the checkpoint to resume from; returns its master seed
+    std::uint64_t LoadResumeFile(const G4String& fileName);
+
+    // Master (or sequential) thread
+    void BeginRun(G4int runID, G4int nofEvents, G4int eventOffset, G4int nofH1s,
+                  const G4String& fileName, G4int eventsPerSnapshot, G4double interval);
+    G4bool IsResuming() const { return fResuming; }
+    const std::vector<std::uint64_t>& GetResumeRows() const { return fResumeRows; }
+    void RestoreHistograms() const;  // adds the checkpointed H1s, after OpenFile
+    void EndRun();
+
+    // Threads processing events
+    G4bool IsCompleted(G4int eventID) const
+    {
+      auto index = static_cast<std::int64_t>(eventID) - fEventOffset;
+      if (!fCompleted || index < 0 || index >= fNofEvents) return false;
+      return (fCompleted[index >> 6].load(std::memory_order_relaxed) >> (index & 63)) & 1;
+    }
+    void EndOfEvent(G4int eventID);
+    void EndOfThreadRun();
+
+  private:
+    Checkpoint() = default;
+
+    using H1 = tools::histo::h1d;
+
+    struct ThreadState
+    {
+        std::vector<G4int> pendingEvents;
+        std::chrono::steady_clock::time_point lastSnapshot;
+        std::vector<H1> durableH1s;  // guarded by fMutex
+    };
+
+    struct Snapshot
+    {
+        ThreadState* state;
+        std::vector<G4int> events;
+        std::vector<H1> h1s;
+    };
+
+    ThreadState* GetState();
+    void TakeSnapshot(ThreadState* state);
+    void Promote(Snapshot& snapshot);
+    void PromoteDeferred();
+    void CheckpointLoop();
+    void Write();
+
+    // Configuration of the current run, set before the workers start
+    G4String fFileName;
+    G4int fEventsPerSnapshot = 100000;
+    std::chrono::duration<G4double> fInterval{600.};
+    G4int fRunID = -1;
+    G4int fNofEvents = 0;
+    G4int fEventOffset = 0;
+    G4int fNofH1s = 0;
+    G4bool fEnabled = false;
+
+    // Durable state
+    std::mutex fMutex;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> fCompleted;  // bit per event of the run
+    std::size_t fNofWords = 0;
+    std::uint64_t fNofCompleted = 0;
+    std::vector<std::unique_ptr<ThreadState>> fStates;
+    std::vector<std::function<void()>> fDeferred;  // rows to append, then promote
+    G4int fGeneration = 0;
+
+    // Loaded from the resume file
+    G4bool fResuming = false;
+    G4int fResumeRunID = -1;
+    G4int fResumeNofEvents = 0;
+    G4int fResumeShard = 0;
+    std::vector<std::uint64_t> fResumeRows;
+    std::vector<std::uint64_t> fResumeWords;
+    std::vector<H1> fBaseH1s;  // histograms of the interrupted run
+
+    std::thread fWriter;
+    std::mutex fStopMutex;
+    std::condition_variable fStopCondition;
+    G4bool fStopRequested = false;
+
+    static G4ThreadLocal ThreadState* fState;
+    static G4ThreadLocal G4int fStateGeneration;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef ColumnOutput_h
+#define ColumnOutput_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+/// Columnar binary output, written next to the G4AnalysisManager ntuples.
+///
+/// Each column of a table is a raw little-endian file
+/// <directory>/<table>.<column>.bin (int32 or float64) and each table has
+/// a small JSON header <directory>/<table>.json listing its columns and
+/// row count, so that the files can be memory-mapped directly
+/// (see load_columns.py).
+///
+/// The booking and Fill/AddRow interface mirrors the analysis manager.
+/// Rows are staged in thread-local blocks and appended to the shared
+/// files under a lock once a block is full.
+
+class ColumnOutput
+{
+  public:
+    static ColumnOutput* Instance();
+
+    // Booking; calling it again with the same name returns the same ID,
+    // so every thread may book the same layout
+    G4int CreateTable(const G4String& name);
+    G4int CreateIColumn(G4int tableID, const G4String& name);
+    G4int CreateDColumn(G4int tableID, const G4String& name);
+
+    // Master (or sequential) thread, around a run
+    void Open(const G4String& directory);
+    // Reopen the files of an interrupted run for appending: the first
+    // nofRows[table] rows are kept if keepEvent(eventID) is true for them
+    // (first column), everything after them is discarded
+    void Resume(const G4String& directory, const std::vector<std::uint64_t>& nofRows,
+                const std::function<G4bool(G4int)>& keepEvent);
+    void Close();
+    G4bool IsOpen() const { return fOpen.load(std::memory_order_acquire); }
+
+    // Any thread
+    void FillIColumn(G4int tableID, G4int column, G4int value);
+    void FillDColumn(G4int tableID, G4int column, G4double value);
+    void AddRow(G4int tableID);
+    void FlushThread();  // appends the rows still buffered by this thread
+    // Takes the rows buffered by this thread without writing them; the
+    // returned function appends them, on any thread
+    std::function<void()> DetachThread();
+
+    void SetBlockRows(std::size_t rows) { fBlockRows = rows; }
+    std::uint64_t GetBytesWritten() const { return fBytesWritten.load(); }
+    std::size_t GetNofTables() const { return fTables.size(); }
+    std::uint64_t GetNofRows(G4int tableID) const;  // rows appended to the files
+    std::size_t GetRowSize(G4int tableID) const { return fTables.at(tableID).rowSize; }
+
+  private:
+    ColumnOutput() = default;
+
+    enum class Type : char { Int32, Float64 };
+
+    struct Column
+    {
+        G4String name;
+        Type type;
+        std::size_t offset = 0;  // position in the staged row
+        std::FILE* file = nullptr;
+    };
+
+    struct Table
+    {
+        G4String name;
+        std::vector<Column> columns;
+        std::size_t rowSize = 0;
+        std::uint64_t nofRows = 0;
+    };
+
+    // Rows of one table staged by one thread
+    struct Block
+    {
+        std::vector<char> row;
+        std::vector<std::vector<char>> columns;
+        std::size_t nofRows = 0;
+    };
+
+    G4int CreateColumn(G4int tableID, const G4String& name, Type type);
+    Block& GetBlock(G4int tableID);
+    void Append(G4int tableID, Block& block);
+    void WriteHeader(const Table& table) const;
+    std::uint64_t Compact(Table& table, std::uint64_t nofRows,
+                          const std::function<G4bool(G4int)>& keepEvent) const;
+
+    std::vector<Table> fTables;
+    G4String fDirectory;
+    std::atomic<G4bool> fOpen{false};
+    std::atomic<std::uint64_t> fBytesWritten{0};
+    std::size_t fBlockRows = 1 << 16;
+
+    static G4ThreadLocal std::vector<Block>* fBlocks;
+};
+
+#endif
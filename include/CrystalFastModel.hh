@@ -0,0 +1,48 @@
+#ifndef CrystalFastModel_h
+#define CrystalFastModel_h 1
+
+#include "G4VFastSimulationModel.hh"
+#include "globals.hh"
+
+class G4GenericMessenger;
+class G4Region;
+
+/// Parameterised response of the camera crystals, /B4c/fast/.
+///
+/// The gammas are transported by the standard processes, since their
+/// Compton scattering and escape are what the camera measures. The
+/// electrons and positrons they set in motion in the Scatter and Absorber
+/// regions are not: each deposits its kinetic energy at once, at a point
+/// a fraction of its range (Katz-Penfold) along its direction, spread
+/// laterally by a Gaussian, and a positron then emits its two 511 keV
+/// annihilation gammas. Bremsstrahlung escape is neglected. The sensitive
+/// detectors see one step per electron instead of its shower.
+///
+/// One model per thread serves both regions. It exists only when
+/// exampleB4c runs with --fastSim, which registers the fast simulation
+/// process for electrons and positrons; it is then on until disabled.
+
+class CrystalFastModel : public G4VFastSimulationModel
+{
+  public:
+    CrystalFastModel(const G4String& name);
+    ~CrystalFastModel() override;
+
+    // Region whose volumes the model covers
+    void AddEnvelope(G4Region* region);
+
+    G4bool IsApplicable(const G4ParticleDefinition& particle) override;
+    G4bool ModelTrigger(const G4FastTrack& fastTrack) override;
+    void DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep) override;
+
+  private:
+    void DefineCommands();
+
+    G4bool fEnabled = true;
+    G4double fDepthFraction = 0.3;  // of the electron range
+    G4double fLateralFraction = 0.2;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
@@ -3,29 +3,74 @@
 
 #include "G4VUserDetectorConstruction.hh"
 
+#include "G4ThreeVector.hh"
 #include "G4Threading.hh"
 #include "globals.hh"
 
+#include <map>
+
 class G4VPhysicalVolume;
 class G4GlobalMagFieldMessenger;
+class G4GenericMessenger;
+class G4LogicalVolume;
+class G4ProductionCuts;
 
 class DetectorConstruction : public G4VUserDetectorConstruction
 {
   public:
-    DetectorConstruction() = default;
-    ~DetectorConstruction() override = default;
+    DetectorConstruction();
+    ~DetectorConstruction() override;
 
   public:
     G4VPhysicalVolume* Construct() override;
     void ConstructSDandField() override;
 
+    // main(): the fast simulation model of the crystals is built only when
+    // its physics is registered (--fastSim)
+    void SetFastSimulation(G4bool flag) { fFastSimulation = flag; }
+
   private:
     // methods
     //
     void DefineMaterials();
     G4VPhysicalVolume* DefineVolumes();
+    void DefineRegions(G4LogicalVolume* targetLV, G4LogicalVolume* scatterLV,
+                       G4LogicalVolume* absorberLV);
+    void DefineCommands();
+
+    // Replicated pixels of a camera layer (/B4c/camera/), nofPixels x nofPixels
+    struct PixelLayer
+    {
+        G4LogicalVolume* pixelLV = nullptr;  // null for a monolithic layer
+        G4int nofPixels = 0;
+        G4double pitch = 0.;
+        G4ThreeVector firstPixel;  // centre of row 0, column 0
+    };
+    PixelLayer Pixelate(G4LogicalVolume* layerLV, const G4String& name, G4double sizeXY,
+                        G4double thickness, G4double pitch, const G4ThreeVector& center);
+
+    // Production cuts of the Target, Scatter and Absorber regions; the World
+    // is the default region and uses the default cut of the physics list
+    void SetRegionCut(const G4String& regionName, G4double cut);
+    void ApplyRegionCut(const G4String& regionName);
+    void SetTargetCut(G4double cut) { SetRegionCut("Target", cut); }
+    void SetScatterCut(G4double cut) { SetRegionCut("Scatter", cut); }
+    void SetAbsorberCut(G4double cut) { SetRegionCut("Absorber", cut); }
+    void SetWorldCut(G4double cut);
 
     G4bool fCheckOverlaps = true;  // option to activate checking of volumes overlaps
+    G4bool fFastSimulation = false;
+
+    std::map<G4String, G4double> fRegionCuts;
+    std::map<G4String, G4ProductionCuts*> fProductionCuts;
+    G4GenericMessenger* fMessenger = nullptr;
+
+    // Pixel pitch of the camera layers, 0 for a monolithic layer
+    G4double fScatPitch = 0.;
+    G4double fAbsoPitch = 0.;
+    PixelLayer fScatPixels;
+    PixelLayer fAbsoPixels;
+    G4GenericMessenger* fCameraMessenger = nullptr;
 };
 
 #endif
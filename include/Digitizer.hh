@@ -0,0 +1,80 @@
+#ifndef Digitizer_h
+#define Digitizer_h 1
+
+#include "ThreadLocalRegistry.hh"
+
+#include "globals.hh"
+
+#include <array>
+#include <cstdint>
+
+class G4GenericMessenger;
+
+/// Detector response between the sensitive detectors and the output,
+/// /B4c/digi/.
+///
+/// The summed deposit of each detector in a coincidence window is smeared
+/// with the energy resolution of the crystal (FWHM at 662 keV, scaling
+/// as 1/sqrt(E): about 3% for LaBr3, 6% for GAGG) before it fills the
+/// spectra. Coincidences then pass, in this order, the weight check (all
+/// hits of the window must carry the same weight, see
+/// EventAction::Detection), the per-detector thresholds, the total-energy
+/// window and the Compton-kinematics check (full absorption: the
+/// scattering angle computed from the two energies must exist). Rejected
+/// coincidences are not written. All stages but the weight check are off
+/// by default.
+///
+/// Each thread counts the rejections per cut in its own counters; the
+/// master sums them at the end of the run and prints the acceptance and
+/// the output saved.
+
+class Digitizer
+{
+  public:
+    static Digitizer* Instance();
+
+    enum Detector { kScatter, kAbsorber };
+    enum Cut
+    {
+      kMixedWeights,
+      kScatThreshold,
+      kAbsoThreshold,
+      kEnergyWindow,
+      kKinematics,
+      kNofCuts
+    };
+
+    // Any thread: measured energy of a detector
+    G4double Smear(Detector detector, G4double edep) const;
+    // Any thread: counts the coincidence and returns false if a cut rejects it
+    G4bool Accept(G4double scatEnergy, G4double absoEnergy, G4bool mixedWeights);
+
+    // Master (or sequential) thread, at the end of each run; bytesPerRow
+    // is the size of a written coincidence, for the output saved
+    void EndRun(std::size_t bytesPerRow);
+
+  private:
+    Digitizer();
+    ~Digitizer();
+
+    struct Counters
+    {
+        std::uint64_t candidates = 0;
+        std::array<std::uint64_t, kNofCuts> rejected{};
+    };
+
+    G4bool IsActive() const;
+    void DefineCommands();
+
+    std::array<G4double, 2> fResolution{0., 0.};  // FWHM fraction at 662 keV
+    std::array<G4double, 2> fThreshold{0., 0.};
+    G4double fEnergyMin = 0.;
+    G4double fEnergyMax;
+    G4bool fKinematics = false;
+
+    ThreadLocalRegistry<Counters> fCounters;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef EmissionMap_h
+#define EmissionMap_h 1
+
+#include "G4VAccumulable.hh"
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+
+/// Prompt-gamma emission map accumulated during the run.
+///
+/// A 3D voxel grid over the Target box holds, for each prompt-gamma line
+/// (energy window), the summed weight of the gammas emitted per voxel.
+/// Every thread fills its own instance; the instances are reduced into
+/// the master one by G4AccumulableManager at the end of the run, which
+/// then writes the grid and the depth profile along the beam (x) axis.
+
+class EmissionMap : public G4VAccumulable
+{
+  public:
+    EmissionMap();
+    ~EmissionMap() override;
+
+    // Size the grid to the Target box (or a given box); call at the start of
+    // each run on every thread, after the commands have been applied
+    void SetBoxFromTarget();
+    void SetBox(const G4ThreeVector& center, const G4ThreeVector& halfSize);
+
+    void Fill(const G4ThreeVector& position, G4double energy, G4double weight)
+    {
+      if (!fData) return;
+      auto local = position - fMin;
+      auto ix = static_cast<G4int>(local.x() / fVoxelSize.x());
+      auto iy = static_cast<G4int>(local.y() / fVoxelSize.y());
+      auto iz = static_cast<G4int>(local.z() / fVoxelSize.z());
+      if (local.x() < 0. || local.y() < 0. || local.z() < 0. || ix >= fNx || iy >= fNy
+          || iz >= fNz)
+        return;
+      std::size_t voxel = (static_cast<std::size_t>(ix) * fNy + iy) * fNz + iz;
+      for (std::size_t line = 0; line < fLines.size(); ++line) {
+        if (energy >= fLines[line].low && energy < fLines[line].high) {
+          fData[line * fNofVoxels + voxel] += weight;
+        }
+      }
+    }
+
+    void Merge(const G4VAccumulable& other) override;
+    void Reset() override;
+
+    // Master: write <fileName>.bin/.json and the depth profile <fileName>_depth.csv
+    void Write() const;
+    G4bool IsEnabled() const { return !fFileName.empty(); }
+
+    // Total weight and depth profile (along x) of one line
+    G4double GetLineYield(std::size_t line) const;
+    std::vector<G4double> GetDepthProfile(std::size_t line) const;
+
+    struct Line
+    {
+        G4double energy;
+        G4double low;
+        G4double high;
+    };
+    const std::vector<Line>& GetLines() const { return fLines; }
+    G4double GetXMin() const { return fMin.x(); }
+    G4double GetXBinWidth() const { return fVoxelSize.x(); }
+
+  private:
+    void AddLine(G4double energy);
+    void ClearLines();
+    void Allocate();
+    void DefineCommands();
+
+    G4String fFileName;
+    std::vector<Line> fLines;
+    G4double fHalfWidth;
+    G4ThreeVector fRequestedVoxelSize;
+
+    G4ThreeVector fMin;
+    G4ThreeVector fVoxelSize;
+    G4int fNx = 0;
+    G4int fNy = 0;
+    G4int fNz = 0;
+    std::size_t fNofVoxels = 0;
+    std::size_t fSize = 0;
+    G4double* fData = nullptr;  // cache-line aligned, [line][x][y][z]
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
@@ -9,13 +9,15 @@
 #include "globals.hh"
 
 class G4Event;
+class G4GenericMessenger;
+class PixelSD;
 class RunAction;
 
 class EventAction : public G4UserEventAction
 {
   public:
     EventAction(RunAction* runAction);
-    ~EventAction() override = default;
+    ~EventAction() override;
 
     void BeginOfEventAction(const G4Event* event) override;
     void EndOfEventAction(const G4Event* event) override;
@@ -25,21 +27,83 @@ class EventAction : public G4UserEventAction
       G4int eventID = -1;
       G4double energy = 0.;
       G4ThreeVector position{0.,0.,0.};
+      G4ThreeVector direction{0.,0.,1.};
+      G4double time = 0.;
+      G4double weight = 1.;
+      G4int creatorProcess = -1;  // process sub-type
+      G4int parentPDG = 0;
+      G4int spotID = -1;  // treatment-plan spot, -1 without a plan
     };
-    
-    // Called from SteppingAction to add a prompt gamma produced during this event
-    void AddPromptGamma(const PromptGamma& g) { fPromptGammas.push_back(g); }
+
+    // Coincidence of scatter and absorber, with energy-weighted centroids
+    struct Detection {
+      G4int eventID = -1;
+      G4ThreeVector scatPosition{0.,0.,0.};
+      G4ThreeVector absoPosition{0.,0.,0.};
+      G4double scatEdep = 0.;
+      G4double absoEdep = 0.;
+      G4int spotID = -1;
+      G4double time = 0.;  // opening of the coincidence window
+      // Weight of the photon history behind the hits. Secondaries inherit
+      // the weight of their parent, so every hit of one history carries
+      // it; a window whose hits differ in weight mixes histories biased
+      // differently and is rejected (Digitizer, mixedWeights)
+      G4double weight = 1.;
+    };
+
+    // Pixel hit of an accepted coincidence, pixelated camera only
+    struct PixelRecord {
+      G4int eventID = -1;
+      G4int layer = 0;  // 0 scatter, 1 absorber
+      G4int pixelID = -1;
+      G4double edep = 0.;
+      G4double time = 0.;
+    };
+
+    // Called from StackingAction to add a prompt gamma produced during this event
+    void AddPromptGamma(const PromptGamma& g)
+    {
+      fPromptGammas.push_back(g);
+      fPromptGammas.back().spotID = fSpotID;
+    }
+
+    // Append one record to the columnar output from the calling thread
+    static void FillColumns(G4int tableID, const PromptGamma& g);
+    static void FillColumns(G4int tableID, const Detection& detection);
+    static void FillColumns(G4int tableID, const PixelRecord& pixel);
 
   private:
     // methods
+    void WritePromptGammas();
+    void WriteHits(const G4Event* event);
+    void WriteDetection(const Detection& detection);
+    void WritePixel(const PixelRecord& pixel);
+    void DefineCommands();
     TrackerHitsCollection* GetHitsCollection(G4int hcID, const G4Event* event) const;
     void PrintEventStatistics(G4double absoEdep, G4double absoTrackLength, G4double gapEdep,
                               G4double gapTrackLength) const;
 
     // data members
-    G4int fScatHCID = -1;
+    G4bool fDetectorsFound = false;
+    G4int fScatHCID = -1;  // -1 for a pixelated layer
     G4int fAbsoHCID = -1;
+    PixelSD* fPixelSD = nullptr;  // pixelated layers, if any
+    G4int fSpotID = -1;
     std::vector<PromptGamma> fPromptGammas;
+
+    // Hit of a monolithic layer or touched pixel of a pixelated one
+    struct TimedHit
+    {
+        G4ThreeVector position;
+        G4double edep;
+        G4double time;
+        G4double weight;
+        G4int pixelID;  // -1 for a monolithic layer
+        G4bool absorber;
+    };
+    std::vector<TimedHit> fTimedHits;  // reused from event to event
+    G4double fCoincidenceWindow;
+    G4GenericMessenger* fMessenger = nullptr;
     RunAction *fRunAction = nullptr;
 };
 
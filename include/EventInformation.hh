@@ -0,0 +1,24 @@
+#ifndef EventInformation_h
+#define EventInformation_h 1
+
+#include "G4VUserEventInformation.hh"
+
+#include "globals.hh"
+
+/// Treatment-plan spot of an event, written with its output rows.
+
+class EventInformation : public G4VUserEventInformation
+{
+  public:
+    EventInformation(G4int spotID) : fSpotID(spotID) {}
+    ~EventInformation() override = default;
+
+    void Print() const override;
+
+    G4int GetSpotID() const { return fSpotID; }
+
+  private:
+    G4int fSpotID = -1;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef OnlineImage_h
+#define OnlineImage_h 1
+
+#include "ConeKernel.hh"
+#include "ThreadLocalRegistry.hh"
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class G4GenericMessenger;
+
+/// Live simple-backprojection image of the run, /B4c/image/.
+///
+/// Every accepted coincidence is turned into its Compton cone and
+/// backprojected with the cone kernel of the reconstruction library
+/// (recon/) into the image of its thread, each cone adding its weight.
+/// A thread writes only its own image, with relaxed atomic stores, so
+/// filling takes no lock and no shared write. A snapshot thread on the
+/// master sums the thread images every /B4c/image/interval while they are
+/// filled and writes <fileName>_run<R>_<n>.bin/.json in the format of the
+/// emission map; the last snapshot is written at the end of the run.
+/// The grid covers the Target box; with /B4c/image/flat it is the x-z
+/// plane through the Target centre, one voxel across y. Off by default.
+
+class OnlineImage
+{
+  public:
+    static OnlineImage* Instance();
+
+    G4bool IsEnabled() const { return fActive; }
+
+    // Thread processing events: backproject one coincidence
+    void Fill(const G4ThreeVector& scatPosition, const G4ThreeVector& absoPosition,
+              G4double scatEnergy, G4double absoEnergy, G4double weight);
+
+    // Master (or sequential) thread, around a run; Start does nothing
+    // without a file name
+    void Start(G4int runID);
+    void Stop();
+
+  private:
+    OnlineImage();
+    ~OnlineImage();
+
+    struct Image
+    {
+        std::unique_ptr<std::atomic<G4double>[]> data;
+        std::size_t size = 0;
+        std::atomic<std::uint64_t> cones{0};
+        ConeKernel::Projection projection;  // scratch of the owning thread
+    };
+
+    // Only the owning thread writes an image
+    static void Add(std::atomic<G4double>& value, G4double x)
+    {
+      value.store(value.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+    }
+
+    void Allocate(Image& image) const;
+    G4bool SetGridFromTarget();
+    void SnapshotLoop();
+    void WriteSnapshot();
+    void DefineCommands();
+
+    G4String fFileName;
+    G4double fInterval;
+    G4double fVoxelSize;
+    G4double fSigmaAngle;
+    G4bool fFlat = false;
+
+    // Current run; fKernel holds the grid
+    G4bool fActive = false;
+    std::unique_ptr<ConeKernel> fKernel;
+    G4int fRunID = 0;
+    G4int fSnapshot = 0;
+    std::vector<G4double> fSum;
+
+    ThreadLocalRegistry<Image> fImages;
+
+    std::thread fWriter;
+    std::mutex fStopMutex;
+    std::condition_variable fStopCondition;
+    G4bool fStopRequested = false;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef PhaseSpace_h
+#define PhaseSpace_h 1
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/// Prompt-gamma phase-space file.
+///
+/// A phase-space file holds one fixed-size record per prompt gamma emitted
+/// in the Target, so that the camera stage can be re-simulated without
+/// transporting the protons again. The layout is a 32-byte header followed
+/// by packed little-endian records and can be memory-mapped directly
+/// (e.g. numpy.memmap with offset=32).
+
+namespace PhaseSpace
+{
+// "PGPHSP" + format version
+constexpr char kMagic[8] = {'P', 'G', 'P', 'H', 'S', 'P', '0', '1'};
+constexpr std::uint32_t kEndianTag = 0x01020304;
+
+struct Header
+{
+    char magic[8];
+    std::uint32_t endianTag;
+    std::uint32_t recordSize;
+    std::uint64_t nofRecords;
+    std::uint64_t reserved;
+};
+
+// Units: mm, MeV, ns
+struct Record
+{
+    float x, y, z;
+    float dx, dy, dz;
+    float energy;
+    float time;
+    float weight;
+    std::int32_t eventID;
+};
+
+static_assert(sizeof(Header) == 32, "unexpected phase-space header size");
+static_assert(sizeof(Record) == 40, "unexpected phase-space record size");
+}  // namespace PhaseSpace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/// Buffered writer used by one thread; the header record count is
+/// patched when the file is closed.
+
+class PhaseSpaceWriter
+{
+  public:
+    PhaseSpaceWriter(const G4String& fileName);
+    ~PhaseSpaceWriter();
+
+    PhaseSpaceWriter(const PhaseSpaceWriter&) = delete;
+    PhaseSpaceWriter& operator=(const PhaseSpaceWriter&) = delete;
+
+    void Write(G4int eventID, const G4ThreeVector& position, const G4ThreeVector& direction,
+               G4double energy, G4double time, G4double weight);
+    void Close();
+
+    std::uint64_t GetNofRecords() const { return fNofRecords; }
+
+  private:
+    void Flush();
+
+    G4String fFileName;
+    std::FILE* fFile = nullptr;
+    std::vector<PhaseSpace::Record> fBuffer;
+    std::uint64_t fNofRecords = 0;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/// Read-only view of one or more memory-mapped phase-space files.
+/// Records are grouped by their original event ID, one group per
+/// replayed event. Instances are shared between threads via Open().
+
+class PhaseSpaceReader
+{
+  public:
+    struct Group
+    {
+        const PhaseSpace::Record* first = nullptr;
+        std::uint32_t size = 0;
+    };
+
+    ~PhaseSpaceReader();
+
+    PhaseSpaceReader(const PhaseSpaceReader&) = delete;
+    PhaseSpaceReader& operator=(const PhaseSpaceReader&) = delete;
+
+    // Maps <baseName>.phsp, or all <baseName>_t*.phsp, once per process
+    static std::shared_ptr<const PhaseSpaceReader> Open(const G4String& baseName);
+
+    std::size_t GetNofGroups() const { return fGroups.size(); }
+    std::uint64_t GetNofRecords() const { return fNofRecords; }
+    const Group& GetGroup(std::size_t i) const { return fGroups[i]; }
+
+  private:
+    PhaseSpaceReader() = default;
+    void Map(const G4String& fileName);
+
+    struct Mapping
+    {
+        void* address = nullptr;
+        std::size_t length = 0;
+    };
+
+    std::vector<Mapping> fMappings;
+    std::vector<Group> fGroups;
+    std::uint64_t fNofRecords = 0;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef PixelSD_h
+#define PixelSD_h 1
+
+#include "G4ThreeVector.hh"
+#include "G4VSensitiveDetector.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4Step;
+class G4HCofThisEvent;
+class G4LogicalVolume;
+class G4TouchableHistory;
+
+/// Sensitive detector of the pixelated camera layers (/B4c/camera/).
+///
+/// One instance serves all pixelated layers and makes no hits. The
+/// deposits of an event are summed into one flat energy array indexed by
+/// layer offset + row * nofPixels + column, taken from the replica numbers
+/// of the pixel (from the final position of a step of the crystal fast
+/// simulation); the pixels touched are listed with their earliest deposit
+/// time and the weight of the first track. EventAction reads that list
+/// at the end of the event, the pixels are reset when the next one
+/// starts. The cost of an event grows with the pixels it touches, not
+/// with the size of the layers.
+
+class PixelSD : public G4VSensitiveDetector
+{
+  public:
+    PixelSD(const G4String& name);
+    ~PixelSD() override = default;
+
+    // Pixel touched during an event, at the pixel centre
+    struct Pixel
+    {
+        G4int layer = 0;  // 0 scatter, 1 absorber
+        G4int pixelID = -1;  // row * nofPixels + column
+        G4double edep = 0.;
+        G4double time = 0.;
+        G4double weight = 1.;
+        G4ThreeVector position;
+    };
+
+    // Before the detector is registered: layer (0 scatter, 1 absorber) of
+    // nofPixels x nofPixels replicated pixels, the first one (row 0,
+    // column 0) centred at firstPixel
+    void AddLayer(G4int layer, const G4LogicalVolume* pixelLV, G4int nofPixels,
+                  G4double pitch, const G4ThreeVector& firstPixel);
+    G4bool HasLayer(G4int layer) const;
+
+    // Pixels touched during the current event, by their index in the flat
+    // arrays; valid until the next event starts
+    const std::vector<std::size_t>& GetTouched() const { return fTouched; }
+    Pixel GetPixel(std::size_t index) const;
+
+    // methods from base class
+    void Initialize(G4HCofThisEvent* hitCollection) override;
+    G4bool ProcessHits(G4Step* step, G4TouchableHistory* history) override;
+
+  private:
+    struct Layer
+    {
+        G4int layer = 0;
+        const G4LogicalVolume* pixelLV = nullptr;
+        G4int nofPixels = 0;  // per side
+        G4double pitch = 0.;
+        G4ThreeVector firstPixel;
+        std::size_t offset = 0;  // in the flat arrays
+    };
+
+    std::vector<Layer> fLayers;
+
+    // Per-event sums of all pixels, zero when not touched
+    std::vector<G4double> fEdep;
+    std::vector<G4double> fTime;
+    std::vector<G4double> fWeight;
+    std::vector<std::size_t> fTouched;
+};
+
+#endif
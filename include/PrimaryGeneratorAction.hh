@@ -3,8 +3,15 @@
 
 #include "G4VUserPrimaryGeneratorAction.hh"
 
+#include "globals.hh"
+
+#include <memory>
+
 class G4ParticleGun;
 class G4Event;
+class G4GenericMessenger;
+class PhaseSpaceReader;
+class TreatmentPlan;
 
 class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 {
@@ -15,7 +22,31 @@ class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
     void GeneratePrimaries(G4Event* event) override;
 
   private:
+    void GenerateBeam(G4Event* event);
+    G4int GenerateFromPlan(G4Event* event);  // returns the spot ID
+    void GenerateFromPhaseSpace(G4Event* event);
+    G4double SampleBunchTime() const;
+    void CheckWorld();
+    void SetReplayFile(const G4String& baseName);
+    void SetPlanFile(const G4String& fileName);
+    void DefineCommands();
+
     G4ParticleGun* fParticleGun = nullptr;  // G4 particle gun
+    G4bool fWorldChecked = false;
+
+    // beam time structure: protons per event and their times in the bunch
+    G4int fBunchSize = 1;
+    G4bool fPoissonBunch = false;
+    G4double fBunchLength = 0.;
+    G4double fRFPeriod = 0.;
+    G4double fRFWidth = 0.;
+
+    // spot-scanning plan instead of the single pencil beam
+    std::shared_ptr<const TreatmentPlan> fPlan;
+
+    // replay of a prompt-gamma phase space instead of the proton beam
+    std::shared_ptr<const PhaseSpaceReader> fPhaseSpace;
+    G4GenericMessenger* fMessenger = nullptr;
 };
 
 #endif
@@ -0,0 +1,96 @@
+#ifndef Profiler_h
+#define Profiler_h 1
+
+#ifdef B4C_PROFILING
+
+#include "ThreadLocalRegistry.hh"
+
+#include "globals.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+class G4GenericMessenger;
+class G4LogicalVolume;
+class G4ParticleDefinition;
+class G4VProcess;
+
+/// Where the transport time goes: steps, tracks and wall time per
+/// (logical volume, particle, creator process), /B4c/profile/.
+///
+/// Built with the B4C_PROFILING option (on by default). Enabling it adds
+/// a ProfilingAction stepping action to every thread at the next run;
+/// without it no stepping action is installed, so a disabled profiler
+/// costs nothing. The time of a step is the wall time since the previous
+/// step of the thread; the first step of each event is not timed. The
+/// threads fill their own tables, the master sums them at the end of the
+/// run, prints the hotspots and writes them to a CSV file.
+
+class Profiler
+{
+  public:
+    static Profiler* Instance();
+
+    G4bool IsEnabled() const { return fEnabled; }
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Key
+    {
+        const G4LogicalVolume* volume;
+        const G4ParticleDefinition* particle;
+        const G4VProcess* creator;  // null for primaries
+
+        G4bool operator==(const Key& other) const
+        {
+          return volume == other.volume && particle == other.particle && creator == other.creator;
+        }
+    };
+
+    struct Entry
+    {
+        std::uint64_t steps = 0;
+        std::uint64_t tracks = 0;
+        Clock::duration time{0};
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const
+        {
+          auto hash = reinterpret_cast<std::uintptr_t>(key.volume);
+          hash = hash * 31 + reinterpret_cast<std::uintptr_t>(key.particle);
+          hash = hash * 31 + reinterpret_cast<std::uintptr_t>(key.creator);
+          return std::hash<std::uintptr_t>()(hash);
+        }
+    };
+
+    using Table = std::unordered_map<Key, Entry, KeyHash>;
+
+    // Thread processing events: its own table, registered at the first call
+    Table* GetThreadTable() { return &fTables.Local(); }
+
+    // Master (or sequential) thread, at the end of each run
+    void EndRun();
+
+  private:
+    Profiler();
+    ~Profiler();
+
+    void DefineCommands();
+
+    G4bool fEnabled = false;
+    G4String fFileName = "profile.csv";
+    G4int fNofPrinted = 20;
+
+    ThreadLocalRegistry<Table> fTables;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef ProfilingAction_h
+#define ProfilingAction_h 1
+
+#ifdef B4C_PROFILING
+
+#include "Profiler.hh"
+
+#include "G4UserSteppingAction.hh"
+
+/// Stepping action of the profiling mode: charges every step, and the
+/// wall time since the previous step, to its Profiler table entry.
+/// Installed by RunAction only while /B4c/profile/enable is set; the
+/// stepping action it replaces is called after it, and owned by it.
+
+class ProfilingAction : public G4UserSteppingAction
+{
+  public:
+    ProfilingAction(G4UserSteppingAction* next);
+    ~ProfilingAction() override;
+
+    void UserSteppingAction(const G4Step* step) override;
+
+    // A stepping action installed after the profiling one, owned from now on
+    void SetNext(G4UserSteppingAction* next);
+
+  private:
+    G4UserSteppingAction* fNext;
+    Profiler::Table* fTable;
+    Profiler::Key fLastKey{nullptr, nullptr, nullptr};
+    Profiler::Entry* fLastEntry = nullptr;  // kept across runs, entries are never erased
+    Profiler::Clock::time_point fLastTime;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef RingBuffer_h
+#define RingBuffer_h 1
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/// Bounded lock-free ring buffer for one producer and one consumer thread.
+/// The capacity is rounded up to a power of two.
+
+template<class T>
+class RingBuffer
+{
+  public:
+    explicit RingBuffer(std::size_t capacity)
+    {
+      std::size_t size = 1;
+      while (size < capacity) size <<= 1;
+      fSlots.resize(size);
+      fMask = size - 1;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Producer side; false when the buffer is full
+    bool TryPush(const T& item)
+    {
+      auto tail = fTail.load(std::memory_order_relaxed);
+      if (tail - fCachedHead > fMask) {
+        fCachedHead = fHead.load(std::memory_order_acquire);
+        if (tail - fCachedHead > fMask) return false;
+      }
+      fSlots[tail & fMask] = item;
+      fTail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side; hands up to maxItems items to consume(const T&)
+    template<class F>
+    std::size_t PopBatch(std::size_t maxItems, F&& consume)
+    {
+      auto head = fHead.load(std::memory_order_relaxed);
+      auto available = fTail.load(std::memory_order_acquire) - head;
+      auto n = available < maxItems ? available : maxItems;
+      for (std::size_t i = 0; i < n; ++i) {
+        consume(fSlots[(head + i) & fMask]);
+      }
+      fHead.store(head + n, std::memory_order_release);
+      return n;
+    }
+
+    // Approximate, callable from either side
+    std::size_t Size() const
+    {
+      return fTail.load(std::memory_order_acquire) - fHead.load(std::memory_order_acquire);
+    }
+    std::size_t Capacity() const { return fMask + 1; }
+
+  private:
+    std::vector<T> fSlots;
+    std::size_t fMask = 0;
+
+    // consumer and producer indices live on separate cache lines
+    alignas(64) std::atomic<std::size_t> fHead{0};
+    alignas(64) std::atomic<std::size_t> fTail{0};
+    std::size_t fCachedHead = 0;  // producer's last view of fHead
+};
+
+#endif
@@ -3,23 +3,77 @@
 
 #include "G4UserRunAction.hh"
 
+#include "G4Timer.hh"
+#include "globals.hh"
+
 class G4Run;
+class G4GenericMessenger;
+class EmissionMap;
+class PhaseSpaceWriter;
+class ProfilingAction;
 
 class RunAction : public G4UserRunAction
 {
   public:
     RunAction();
-    ~RunAction() override = default;
+    ~RunAction() override;
 
     void BeginOfRunAction(const G4Run*) override;
     void EndOfRunAction(const G4Run*) override;
 
     G4int GetDetectionNtupleID() const {return fDetectionNtupleID;}
     G4int GetPromptNtupleID() const {return fPromptNtupleID;}
+    G4int GetDetectionTableID() const {return fDetectionTableID;}
+    G4int GetPromptTableID() const {return fPromptTableID;}
+    G4int GetPixelNtupleID() const {return fPixelNtupleID;}
+    G4int GetPixelTableID() const {return fPixelTableID;}
+    G4bool GetRootNtuples() const {return fRootNtuples;}
+    G4bool GetPromptRows() const {return fPromptRows;}
+    G4bool GetPixelRows() const {return fPixelRows;}
+
+    // Thread-local emission map, null unless /B4c/emission/fileName is set
+    EmissionMap* GetEmissionMap() const;
+
+    // Open only on worker threads while a phase-space file is requested
+    PhaseSpaceWriter* GetPhaseSpaceWriter() const { return fPhaseSpaceWriter; }
 
   private:
+    void BookColumns();
+    void DefineCommands();
+
     G4int fDetectionNtupleID = -1;
     G4int fPromptNtupleID = -1;
+    G4int fDetectionTableID = -1;
+    G4int fPromptTableID = -1;
+    G4int fPixelNtupleID = -1;
+    G4int fPixelTableID = -1;
+
+    G4Timer fTimer;  // run wall time for the throughput summary
+    G4bool fFiltering = false;  // SteppingAction of the acceptance filter installed
+#ifdef B4C_PROFILING
+    ProfilingAction* fProfilingAction = nullptr;  // installed on this thread
+#endif
+
+    G4String fOutputFileName = "../output/simulation.root";
+    G4bool fPerThreadFiles = false;
+    G4String fColumnDirectory;
+    G4bool fRootNtuples = true;
+    G4bool fPromptRows = true;
+    G4bool fPixelRows = true;
+    G4bool fAsyncWriter = false;
+    G4int fRingCapacity = 1 << 16;
+
+    G4String fCheckpointFile;
+    G4int fCheckpointEvents = 100000;
+    G4double fCheckpointInterval;
+
+    G4String fMetricsFile;
+    G4double fMetricsInterval;
+
+    G4String fPhaseSpaceFileName;
+    PhaseSpaceWriter* fPhaseSpaceWriter = nullptr;
+    EmissionMap* fEmissionMap = nullptr;
+    G4GenericMessenger* fMessenger = nullptr;
 };
 
 #endif
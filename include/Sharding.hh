@@ -0,0 +1,56 @@
+#ifndef Sharding_h
+#define Sharding_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <cstdint>
+
+class G4Event;
+
+/// Reproducible event seeding and splitting of a job over processes.
+///
+/// Every event is reseeded from (master seed, run ID, global event number)
+/// before its primaries are generated, so an event is the same whichever
+/// thread or process simulates it. With --shard i/N each process runs the
+/// events [i*n, (i+1)*n) of a run of N*n events, n being the /run/beamOn
+/// count, and tags its output files with _shard<i>. The column tables of
+/// the shards are combined with merge_shards.py.
+
+class Sharding
+{
+  public:
+    static Sharding* Instance();
+
+    // main(), before the run manager is created
+    void Configure(std::uint64_t masterSeed, G4int shardIndex, G4int nofShards);
+
+    // Master (or sequential) thread, at the start of each run
+    void BeginRun(G4int runID, G4int nofEvents);
+
+    // Any thread, at the start of each event: converts the event ID to the
+    // global event number and reseeds the engine from it
+    void SeedEvent(G4Event* event) const;
+
+    // Inserts _shard<i> before the extension of the last path component;
+    // returns the name unchanged when the job is not sharded
+    G4String TagFileName(const G4String& name) const;
+
+    std::uint64_t GetMasterSeed() const { return fMasterSeed; }
+    G4int GetShardIndex() const { return fShardIndex; }
+    G4int GetNofShards() const { return fNofShards; }
+    G4int GetEventOffset() const { return fEventOffset.load(); }
+
+  private:
+    Sharding() = default;
+
+    std::uint64_t fMasterSeed = 0;
+    G4int fShardIndex = 0;
+    G4int fNofShards = 1;
+
+    // Set by the master before the workers start the run
+    std::atomic<G4int> fRunID{0};
+    std::atomic<G4int> fEventOffset{0};
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef StackingAction_h
+#define StackingAction_h 1
+
+#include "G4UserStackingAction.hh"
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+class G4GenericMessenger;
+class G4LogicalVolume;
+class G4Track;
+class G4ParticleDefinition;
+class EventAction;
+
+/// Tags prompt gammas once, when they are pushed on the stack: a gamma
+/// produced by a secondary interaction inside the Target.
+///
+/// Optionally kills secondary neutrons created late or with low energy,
+/// and plays Russian roulette with low-energy neutrons; the survivors
+/// carry the compensating weight on to their secondaries.
+///
+/// With /B4c/bias/coneProbability the gammas of nuclear de-excitation are
+/// sent into the cone that covers the scatter with that probability, and
+/// isotropically outside it otherwise. The weight (cone solid angle over
+/// probability) keeps the camera response unbiased for isotropic
+/// emission. Prompt gammas are recorded before, as emitted.
+
+class StackingAction : public G4UserStackingAction
+{
+  public:
+    StackingAction(EventAction* eventAction);
+    ~StackingAction() override;
+
+    G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track* track) override;
+
+  private:
+    G4ClassificationOfNewTrack ClassifyNeutron(const G4Track* track) const;
+    void BiasDirection(G4Track* track) const;
+    void SetCamera();
+    void DefineCommands();
+
+    EventAction* fEventAction = nullptr;
+
+    // cached on first use, the geometry does not exist yet at construction
+    const G4ParticleDefinition* fGamma = nullptr;
+    const G4ParticleDefinition* fNeutron = nullptr;
+    const G4LogicalVolume* fTargetLV = nullptr;
+
+    // neutron cuts, 0 disables
+    G4double fNeutronCreationTimeCut = 0.;
+    G4double fNeutronEnergyCut = 0.;
+    G4double fRouletteEnergy = 0.;
+    G4double fRouletteSurvival = 0.1;
+    G4GenericMessenger* fMessenger = nullptr;
+
+    // directional biasing of the prompt gammas, 0 disables
+    G4double fConeProbability = 0.;
+    G4ThreeVector fCameraCenter;
+    G4double fCameraRadius = 0.;  // of the sphere around the scatter face
+    G4GenericMessenger* fBiasMessenger = nullptr;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef Startup_h
+#define Startup_h 1
+
+#include "G4ApplicationState.hh"
+#include "globals.hh"
+
+#include <atomic>
+#include <chrono>
+
+class G4VUserPhysicsList;
+
+/// Startup time breakdown and cache of the physics tables.
+///
+/// The stages are timed on the master from its application state changes:
+/// setup (run manager, physics list, UI) until /run/initialize, geometry,
+/// physics construction, then the physics tables, built at the first run
+/// initialization (the BeamOn(0) of /run/initialize in MT). The breakdown
+/// is printed at the start of the first run, and the time to the first
+/// completed event once it is known.
+///
+/// With --tables <dir> the tables of the physics list are stored in
+/// <dir>/<physicsList> at the first run and retrieved from there by later
+/// jobs. Processes whose tables cannot be retrieved, e.g. after a change
+/// of the production cuts, build them as usual.
+
+class Startup
+{
+  public:
+    static Startup* Instance();  // first call, at the top of main(), starts the clock
+
+    // main(), once the physics list is created; returns true when the
+    // tables are retrieved from the cache
+    G4bool UsePhysicsTableCache(G4VUserPhysicsList* physicsList, const G4String& directory,
+                                const G4String& physicsListName);
+
+    // DetectorConstruction::Construct() on the master
+    void GeometryDone();
+
+    // Master (or sequential) thread, at the start of each run: prints the
+    // breakdown and fills the table cache at the first run
+    void BeginRun();
+
+    // Any thread, at the end of each event
+    void EndOfEvent()
+    {
+      if (fReported.load(std::memory_order_relaxed) && !fFirstEventDone.load(std::memory_order_relaxed))
+      {
+        FirstEvent();
+      }
+    }
+
+  private:
+    Startup();
+
+    using Clock = std::chrono::steady_clock;
+
+    class StateObserver;
+    void StateChanged(G4ApplicationState previousState, G4ApplicationState newState);
+    void FirstEvent();
+    void StorePhysicsTables();
+
+    Clock::time_point fStart;
+    Clock::time_point fInitStart;
+    Clock::time_point fGeometryDone;
+    Clock::time_point fPhysicsDone;
+    Clock::time_point fTablesStart;
+    Clock::time_point fTablesDone;
+    Clock::time_point fRunStart;
+    G4int fStage = 0;  // stages completed: init started, physics, tables started, tables
+
+    G4VUserPhysicsList* fPhysicsList = nullptr;
+    G4String fTableDirectory;
+    G4bool fTablesCached = false;
+
+    std::atomic<G4bool> fReported{false};
+    std::atomic<G4bool> fFirstEventDone{false};
+};
+
+#endif
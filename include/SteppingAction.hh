@@ -1,25 +1,33 @@
 #ifndef SteppingAction_h
 #define SteppingAction_h 1
 
+#include "AcceptanceFilter.hh"
+
 #include "G4UserSteppingAction.hh"
 
-class G4Step;
+class G4Track;
 
-class DetectorConstruction;
-class EventAction;
+/// Applies the AcceptanceFilter to the step that takes a track out of the
+/// Target, and follows the filter probes to their end. Installed by
+/// RunAction from the first run with /B4c/filter/enable on; other steps
+/// cost two pointer comparisons.
 
 class SteppingAction : public G4UserSteppingAction
 {
   public:
-    SteppingAction(EventAction* eventAction);
+    SteppingAction();
     ~SteppingAction() override = default;
 
     void UserSteppingAction(const G4Step* step) override;
 
   private:
-    EventAction* fEventAction = nullptr;
-};
+    AcceptanceFilter* fFilter;
 
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+    // Track spared by the filter to count its remaining steps
+    const G4Track* fProbe = nullptr;
+    G4int fProbeID = 0;
+    G4int fProbeStart = 0;
+    AcceptanceFilter::Category fProbeCategory = AcceptanceFilter::kOther;
+};
 
 #endif
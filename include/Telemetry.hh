@@ -0,0 +1,90 @@
+#ifndef Telemetry_h
+#define Telemetry_h 1
+
+#include "ThreadLocalRegistry.hh"
+
+#include "globals.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/// Live throughput metrics of a run (/B4c/output/metricsFile).
+///
+/// Every thread counts into its own cache line with relaxed stores, so
+/// counting costs no lock and no shared write. A sampler thread on the
+/// master sums the counters every /B4c/output/metricsInterval and appends
+/// one JSON line to the metrics file: events done, and the rates of events,
+/// steps, prompt gammas, coincidences and output bytes (columnar tables and
+/// phase space; ROOT files are not counted).
+
+class Telemetry
+{
+  public:
+    static Telemetry* Instance();
+
+    // Any thread
+    void CountEvent() { Add(fCounters.Local().events, 1); }
+    void CountSteps(G4int steps) { Add(fCounters.Local().steps, steps); }
+    void CountPromptGammas(std::size_t n) { Add(fCounters.Local().promptGammas, n); }
+    void CountCoincidence() { Add(fCounters.Local().coincidences, 1); }
+    void CountBytes(std::size_t n) { Add(fCounters.Local().bytes, n); }
+
+    // Master (or sequential) thread; Start does nothing for an empty name
+    void Start(const G4String& fileName, G4double interval, G4int runID, G4int nofEvents);
+    void Stop();
+
+  private:
+    Telemetry() = default;
+    ~Telemetry();
+
+    struct alignas(64) Counters
+    {
+        std::atomic<std::uint64_t> events{0};
+        std::atomic<std::uint64_t> steps{0};
+        std::atomic<std::uint64_t> promptGammas{0};
+        std::atomic<std::uint64_t> coincidences{0};
+        std::atomic<std::uint64_t> bytes{0};
+    };
+
+    struct Totals
+    {
+        std::uint64_t events = 0;
+        std::uint64_t steps = 0;
+        std::uint64_t promptGammas = 0;
+        std::uint64_t coincidences = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    // Only the owning thread writes a counter
+    static void Add(std::atomic<std::uint64_t>& counter, std::uint64_t n)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    Totals Sum();
+    void SampleLoop();
+    void WriteSample(G4bool last);
+
+    ThreadLocalRegistry<Counters> fCounters;
+
+    // Sampler of the current run
+    std::FILE* fFile = nullptr;
+    std::chrono::duration<G4double> fInterval{10.};
+    G4int fRunID = 0;
+    G4int fNofEvents = 0;
+    std::chrono::steady_clock::time_point fRunStart;
+    std::chrono::steady_clock::time_point fLastTime;
+    Totals fRunBase;
+    Totals fLast;
+
+    std::thread fSampler;
+    std::mutex fStopMutex;
+    std::condition_variable fStopCondition;
+    G4bool fStopRequested = false;
+};
+
+#endif
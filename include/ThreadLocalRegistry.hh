@@ -0,0 +1,61 @@
+#ifndef ThreadLocalRegistry_h
+#define ThreadLocalRegistry_h 1
+
+#include "globals.hh"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// One T per thread, made at its first use in the thread, for the
+/// singletons that count or accumulate per thread without a lock.
+///
+/// The registry owns all of them until the end of the job, so that the
+/// values of finished threads still add up; ForEach visits them under the
+/// registry lock, e.g. on the master at the end of a run to sum and reset
+/// them. The thread-local pointer is shared by all registries of one T:
+/// each T has a single registry, held by its singleton.
+
+template <class T>
+class ThreadLocalRegistry
+{
+  public:
+    // Calling thread's T; a new one is passed to init under the registry
+    // lock, so that ForEach never sees it half made
+    template <class Init>
+    T& Local(Init&& init)
+    {
+      if (!fLocal) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fAll.push_back(std::make_unique<T>());
+        fLocal = fAll.back().get();
+        init(*fLocal);
+      }
+      return *fLocal;
+    }
+    T& Local()
+    {
+      return Local([](T&) {});
+    }
+
+    // Calls f(T&) for the T of every thread
+    template <class F>
+    void ForEach(F&& f)
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      for (auto& local : fAll) {
+        f(*local);
+      }
+    }
+
+  private:
+    std::mutex fMutex;
+    std::vector<std::unique_ptr<T>> fAll;  // guarded by fMutex
+
+    static G4ThreadLocal T* fLocal;
+};
+
+template <class T>
+G4ThreadLocal T* ThreadLocalRegistry<T>::fLocal = nullptr;
+
+#endif
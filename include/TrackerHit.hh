@@ -30,16 +30,25 @@ class TrackerHit : public G4VHit
     void SetTrackID(G4int track) { fTrackID = track; };
     void SetEdep(G4double de) { fEdep = de; };
     void SetPos(G4ThreeVector xyz) { fPos = xyz; };
+    void SetTime(G4double time) { fTime = time; };
+    void SetNofInteractions(G4int n) { fNofInteractions = n; };
+    void SetWeight(G4double weight) { fWeight = weight; };
 
     // Get methods
     G4int GetTrackID() const { return fTrackID; };
     G4double GetEdep() const { return fEdep; };
     G4ThreeVector GetPos() const { return fPos; };
+    G4double GetTime() const { return fTime; };
+    G4int GetNofInteractions() const { return fNofInteractions; };
+    G4double GetWeight() const { return fWeight; };
 
   private:
     G4int fTrackID = -1;
     G4double fEdep = 0.;
     G4ThreeVector fPos;
+    G4double fTime = 0.;  // global time, of the earliest deposit for a cluster
+    G4int fNofInteractions = 1;  // > 1 for a cluster of merged steps
+    G4double fWeight = 1.;  // track weight, of the first deposit for a cluster
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -6,23 +6,68 @@
 #include "G4VSensitiveDetector.hh"
 #include "globals.hh"
 
+#include <array>
+
 class G4Step;
 class G4HCofThisEvent;
 class G4TouchableHistory;
+class G4GenericMessenger;
+
+/// Sensitive detector of one camera layer.
+///
+/// By default every energy-depositing step becomes a TrackerHit. In the
+/// clustering modes the steps are accumulated in a fixed-size per-event
+/// buffer instead and only one hit per cluster is created at the end of
+/// the event:
+///  - single: one energy-weighted cluster for the whole detector
+///  - multi:  a step joins the nearest cluster if it lies within the
+///            merge distance of its centroid, otherwise it opens a new
+///            one (up to kMaxClusters, then it joins the nearest)
+/// In both modes a step joins only clusters started less than mergeTime
+/// before or after it, so that the protons of a bunch (see
+/// PrimaryGeneratorAction) are not merged; mergeTime is unlimited by
+/// default.
 
 class TrackerSD : public G4VSensitiveDetector
 {
   public:
     TrackerSD(const G4String& name, const G4String& hitsCollectionName);
-    ~TrackerSD() override = default;
+    ~TrackerSD() override;
 
     // methods from base class
     void Initialize(G4HCofThisEvent* hitCollection) override;
     G4bool ProcessHits(G4Step* step, G4TouchableHistory* history) override;
     void EndOfEvent(G4HCofThisEvent* hitCollection) override;
 
+    static constexpr std::size_t kMaxClusters = 16;
+
   private:
+    enum class Clustering { None, Single, Multi };
+
+    struct Cluster
+    {
+        G4double edep = 0.;
+        G4ThreeVector weightedPos;  // sum of edep * position
+        G4int nofInteractions = 0;
+        G4int trackID = -1;  // first contributing track
+        G4double time = 0.;  // earliest deposit
+        G4double weight = 1.;  // of the first contributing track
+    };
+
+    void AddToClusters(G4int trackID, G4double edep, const G4ThreeVector& pos, G4double time,
+                       G4double weight);
+    void SetClustering(const G4String& mode);
+    void DefineCommands();
+
     TrackerHitsCollection* fHitsCollection = nullptr;
+
+    Clustering fClustering = Clustering::None;
+    G4double fMergeDistance = 0.;
+    G4double fMergeTime = DBL_MAX;
+    std::array<Cluster, kMaxClusters> fClusters;
+    std::size_t fNofClusters = 0;
+
+    G4GenericMessenger* fMessenger = nullptr;
 };
 
 #endif
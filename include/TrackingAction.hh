@@ -0,0 +1,18 @@
+#ifndef TrackingAction_h
+#define TrackingAction_h 1
+
+#include "G4UserTrackingAction.hh"
+
+/// Counts the steps of each finished track for the live metrics
+/// (see Telemetry), without a stepping action.
+
+class TrackingAction : public G4UserTrackingAction
+{
+  public:
+    TrackingAction() = default;
+    ~TrackingAction() override = default;
+
+    void PostUserTrackingAction(const G4Track* track) override;
+};
+
+#endif
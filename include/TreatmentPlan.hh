@@ -0,0 +1,62 @@
+#ifndef TreatmentPlan_h
+#define TreatmentPlan_h 1
+
+#include "globals.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Spot-scanning treatment plan, /B4c/gun/plan.
+///
+/// A plain-text file with one spot per line ('#' starts a comment):
+///
+///   energy[MeV] y[mm] z[mm] weight[MU] [sigmaE[MeV] sigmaY[mm] sigmaZ[mm] divY[mrad] divZ[mrad]]
+///
+/// Spots are positioned relative to the nominal beam axis (y = 0, z = 100
+/// mm) in the source plane x = -140 mm; the beam goes along +x. Missing
+/// optional columns default to no energy spread, a 1 mm Gaussian spot
+/// and no divergence. Spots are drawn in proportion to their monitor
+/// units through an alias table, so that drawing a spot is O(1) whatever
+/// the size of the plan; a whole plan runs as a single job.
+
+class TreatmentPlan
+{
+  public:
+    struct Spot
+    {
+        G4double energy;
+        G4double y, z;
+        G4double weight;
+        G4double energySpread;
+        G4double sigmaY, sigmaZ;
+        G4double divergenceY, divergenceZ;
+    };
+
+    // Read once and shared by all threads
+    static std::shared_ptr<const TreatmentPlan> Load(const G4String& fileName);
+
+    std::size_t GetNofSpots() const { return fSpots.size(); }
+    const Spot& GetSpot(std::size_t index) const { return fSpots[index]; }
+
+    // Spot index drawn with probability weight / total weight, from two
+    // uniform numbers in [0, 1)
+    std::size_t Sample(G4double u1, G4double u2) const
+    {
+      auto index = std::min(static_cast<std::size_t>(u1 * fSpots.size()), fSpots.size() - 1);
+      return u2 < fProbability[index] ? index : fAlias[index];
+    }
+
+  private:
+    TreatmentPlan() = default;
+
+    void Read(const G4String& fileName);
+    void BuildAliasTable();
+
+    std::vector<Spot> fSpots;
+    std::vector<G4double> fProbability;  // of keeping the column's own spot
+    std::vector<std::uint32_t> fAlias;
+};
+
+#endif
@@ -0,0 +1,53 @@
+"""load_columns.py
+Zero-copy loader for the columnar output written with
+/B4c/output/columnDirectory: every column is returned as a numpy.memmap
+of its raw little-endian file, nothing is read until it is used.
+
+    from load_columns import load_table
+    prompt = load_table("../output/columns", "PromptGamma")
+    energy = prompt["Energy"]
+
+The emission map written with /B4c/emission/fileName, and the images of
+the comptonRecon tool, are loaded the same way with load_emission_map.
+"""
+import json
+import os
+import sys
+
+import numpy as np
+
+
+def load_table(directory, table):
+    """Return a dict {column name: numpy.memmap} for one table."""
+    with open(os.path.join(directory, table + ".json")) as f:
+        header = json.load(f)
+    rows = header["rows"]
+    columns = {}
+    for column in header["columns"]:
+        path = os.path.join(directory, column["file"])
+        if rows == 0:
+            columns[column["name"]] = np.empty(0, dtype=column["dtype"])
+        else:
+            columns[column["name"]] = np.memmap(path, dtype=column["dtype"], mode="r", shape=(rows,))
+    return columns
+
+
+def load_emission_map(baseName):
+    """Return (grid, header) for an emission map: grid is a numpy.memmap of
+    shape (lines, nx, ny, nz), header gives origin and voxel size in mm and
+    the energy window of each line in MeV. A comptonRecon image has the
+    shape (nx, ny, nz)."""
+    with open(baseName + ".json") as f:
+        header = json.load(f)
+    path = os.path.join(os.path.dirname(baseName), header["file"])
+    grid = np.memmap(path, dtype=header["dtype"], mode="r", shape=tuple(header["shape"]))
+    return grid, header
+
+
+if __name__ == "__main__":
+    directory = sys.argv[1] if len(sys.argv) > 1 else "../output/columns"
+    for name in ("Detection", "PromptGamma", "Pixel"):
+        if os.path.exists(os.path.join(directory, name + ".json")):
+            table = load_table(directory, name)
+            rows = len(next(iter(table.values()))) if table else 0
+            print("{}: {} rows, columns {}".format(name, rows, list(table)))
@@ -0,0 +1,77 @@
+"""merge_shards.py
+Combine the outputs of a job split with exampleB4c --shard i/N.
+
+    python3 merge_shards.py columns OUT_DIR IN_DIR...
+    python3 merge_shards.py emission OUT_BASE IN_BASE...
+
+Column tables (/B4c/output/columnDirectory) are concatenated and stably
+sorted by eventID. Events are seeded from their global number, so the
+result is bit-identical to the same treatment of one unsharded run with
+the same --seed, whatever the thread counts. Emission maps
+(/B4c/emission/fileName) are summed. ROOT files are combined with
+mergeOutput.
+"""
+import glob
+import json
+import os
+import sys
+
+import numpy as np
+
+from load_columns import load_emission_map, load_table
+
+
+def merge_columns(out_dir, in_dirs):
+    os.makedirs(out_dir, exist_ok=True)
+    names = sorted(os.path.basename(path)[:-len(".json")]
+                   for path in glob.glob(os.path.join(in_dirs[0], "*.json")))
+    for name in names:
+        with open(os.path.join(in_dirs[0], name + ".json")) as f:
+            header = json.load(f)
+        tables = [load_table(directory, name) for directory in in_dirs]
+
+        # Stable: rows of one event keep the order in which they were written
+        event_ids = np.concatenate([table["eventID"] for table in tables])
+        order = np.argsort(event_ids, kind="stable")
+
+        for column in header["columns"]:
+            data = np.concatenate([table[column["name"]] for table in tables])
+            data[order].astype(column["dtype"]).tofile(os.path.join(out_dir, column["file"]))
+
+        header["rows"] = int(len(order))
+        with open(os.path.join(out_dir, name + ".json"), "w") as f:
+            json.dump(header, f, indent=2)
+        print("{}: {} rows from {} shards".format(name, len(order), len(in_dirs)))
+
+
+def merge_emission(out_base, in_bases):
+    grid, header = load_emission_map(in_bases[0])
+    total = np.array(grid, dtype=np.float64)
+    for base in in_bases[1:]:
+        other, other_header = load_emission_map(base)
+        if other_header["shape"] != header["shape"]:
+            sys.exit("{}: emission map shape differs".format(base))
+        total += other
+
+    header["file"] = os.path.basename(out_base) + ".bin"
+    total.astype(header["dtype"]).tofile(out_base + ".bin")
+    with open(out_base + ".json", "w") as f:
+        json.dump(header, f, indent=2)
+
+    # Depth profile as written by EmissionMap::Write
+    depth = total.sum(axis=(2, 3))
+    x = header["origin"][0] + (np.arange(total.shape[1]) + 0.5) * header["voxel"][0]
+    with open(out_base + "_depth.csv", "w") as f:
+        f.write("x_mm" + "".join(",E{:g}".format(line["energy"]) for line in header["lines"]) + "\n")
+        for i in range(total.shape[1]):
+            f.write("{:g}".format(x[i]) + "".join(",{:g}".format(v) for v in depth[:, i]) + "\n")
+    print("emission map: {} shards summed into {}".format(len(in_bases), out_base))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4 or sys.argv[1] not in ("columns", "emission"):
+        sys.exit(__doc__)
+    if sys.argv[1] == "columns":
+        merge_columns(sys.argv[2], sys.argv[3:])
+    else:
+        merge_emission(sys.argv[2], sys.argv[3:])
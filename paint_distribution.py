@@ -1,18 +1,20 @@
+import sys
+
 import numpy as np
 import matplotlib.pyplot as plt
 
-fn = "Prompt_gamma.txt"  # 确保在此脚本同目录或改为绝对路径
+from load_columns import load_table
+
+# 列式输出目录（/B4c/output/columnDirectory），可由命令行参数指定
+directory = sys.argv[1] if len(sys.argv) > 1 else "../output/columns"
 
-# 直接用 numpy 读取（跳过 header）
-# 数据列顺序: eventID, energy_MeV, x_mm, y_mm, z_mm
-print("Loading full data with numpy.loadtxt (this may use significant memory)...")
-data = np.loadtxt(fn, skiprows=1)  # 返回 shape=(N,5)
+# 各列以 numpy.memmap 方式映射，不需要先导出为文本
+prompt = load_table(directory, "PromptGamma")
 
-eventID = data[:,0]
-energy = data[:,1]
-x = data[:,2]
-y = data[:,3]
-z = data[:,4]
+energy = prompt["Energy"]
+x = prompt["PosiX"]
+y = prompt["PosiY"]
+z = prompt["PosiZ"]
 
 # 可选过滤：只保留能量在4.4MeV左右的瞬发光子
 mask = (energy > 4.2) & (energy < 4.6)
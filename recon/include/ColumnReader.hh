@@ -0,0 +1,43 @@
+#ifndef ColumnReader_h
+#define ColumnReader_h 1
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/// Reads a table of the columnar output (/B4c/output/columnDirectory) in
+/// blocks of rows, so that tables larger than the memory can be streamed.
+/// The JSON header gives the row count and the column files; each column
+/// is opened on first use. Errors throw std::runtime_error.
+
+class ColumnReader
+{
+  public:
+    ColumnReader(const std::string& directory, const std::string& table);
+    ~ColumnReader();
+    ColumnReader(const ColumnReader&) = delete;
+    ColumnReader& operator=(const ColumnReader&) = delete;
+
+    std::uint64_t GetNofRows() const { return fNofRows; }
+    bool HasColumn(const std::string& name) const { return fColumns.count(name) > 0; }
+
+    // Rows [first, first + n) of a float64 column into values (resized to n)
+    void Read(const std::string& name, std::uint64_t first, std::size_t n,
+              std::vector<double>& values);
+
+  private:
+    struct Column
+    {
+        std::string path;
+        std::string dtype;
+        std::FILE* file = nullptr;
+    };
+
+    std::string fTable;
+    std::uint64_t fNofRows = 0;
+    std::map<std::string, Column> fColumns;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ComptonCone_h
+#define ComptonCone_h 1
+
+/// Cone of possible emission directions of a coincidence, in mm and MeV.
+///
+/// The apex is the scatter centroid and the axis points from the absorber
+/// centroid to it; a source at a point p is compatible with the event if
+/// the angle between p - apex and the axis is the Compton scattering angle
+/// of the two energies, assuming the scattered gamma was fully absorbed.
+
+struct ComptonCone
+{
+    double apex[3];
+    double axis[3];  // unit vector
+    double cosTheta;
+    double weight;
+
+    // False when the energies admit no scattering angle or the centroids
+    // coincide
+    static bool FromCoincidence(const double scatPosition[3], const double absoPosition[3],
+                                double scatEdep, double absoEdep, double weight,
+                                ComptonCone& cone);
+};
+
+#endif
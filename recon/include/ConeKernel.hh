@@ -0,0 +1,44 @@
+#ifndef ConeKernel_h
+#define ConeKernel_h 1
+
+#include "ComptonCone.hh"
+#include "VoxelGrid.hh"
+
+#include <cstdint>
+#include <vector>
+
+/// System-matrix elements between a Compton cone and the voxels of a
+/// grid, computed on the fly.
+///
+/// A voxel at distance r whose direction from the apex makes the angle
+/// beta with the cone axis gets K(cos(beta) - cos(theta)) / r^2, where K is
+/// a biweight kernel with the variance of a Gaussian of angular width
+/// sigma (in cos(theta): sin(theta) * sigma). The biweight has a finite
+/// support and no exponential, so the loop over a row of voxels along z
+/// is branch-free and vectorised by the compiler; only the voxels inside
+/// the support are kept.
+
+class ConeKernel
+{
+  public:
+    // Per-thread output and scratch space of Project
+    struct Projection
+    {
+        std::vector<std::uint32_t> voxels;
+        std::vector<double> values;
+        std::vector<double> row;
+    };
+
+    ConeKernel(const VoxelGrid& grid, double sigmaAngle);
+
+    const VoxelGrid& GetGrid() const { return fGrid; }
+
+    // Non-zero elements of the cone, replacing the previous ones
+    void Project(const ComptonCone& cone, Projection& projection) const;
+
+  private:
+    VoxelGrid fGrid;
+    double fSigmaAngle;
+};
+
+#endif
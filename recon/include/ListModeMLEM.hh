@@ -0,0 +1,75 @@
+#ifndef ListModeMLEM_h
+#define ListModeMLEM_h 1
+
+#include "ComptonCone.hh"
+#include "ConeKernel.hh"
+#include "VoxelGrid.hh"
+
+#include <cfloat>
+#include <string>
+#include <vector>
+
+class ColumnReader;
+
+/// List-mode MLEM/OSEM reconstruction of the Compton cones of the
+/// Detection table.
+///
+/// Each subset of an iteration is a contiguous range of the table, read
+/// in blocks of chunkRows coincidences while the previous block is being
+/// processed, so the table is never held in memory. The block is split
+/// over the threads; each keeps its own back-projection and the system
+/// matrix of a cone (ConeKernel) is computed once per cone and iteration.
+/// With S subsets the image is updated as
+///   lambda_j <- lambda_j * S / s_j * sum_i w_i t_ij / sum_k t_ik lambda_k
+/// where s_j is the solid angle of the scatter face seen from voxel j,
+/// over 4 pi. Coincidences carry their Detection weight.
+
+class ListModeMLEM
+{
+  public:
+    struct Options
+    {
+        int iterations = 10;
+        int subsets = 1;  // 1: MLEM
+        int threads = 1;
+        double sigmaAngle = 0.05;  // rad
+        double energyMin = 0.;  // total energy window, MeV
+        double energyMax = DBL_MAX;
+        std::size_t chunkRows = 1 << 16;
+        double scatterSize = 100.;  // square scatter face at z = scatterZ, mm
+        double scatterZ = 0.;
+    };
+
+    ListModeMLEM(const VoxelGrid& grid, const Options& options);
+
+    // Prints the progress of each iteration to std::cout
+    void Run(ColumnReader& detections);
+
+    const std::vector<double>& GetImage() const { return fImage; }
+    std::size_t GetNofCones() const { return fNofCones; }
+
+    // <baseName>.bin (float64, [x][y][z]) and <baseName>.json, in the
+    // format of the emission map (load_emission_map in load_columns.py)
+    void Write(const std::string& baseName) const;
+
+  private:
+    struct Chunk
+    {
+        std::vector<ComptonCone> cones;
+        std::vector<double> columns[9];
+    };
+
+    void ComputeSensitivity();
+    void ReadChunk(ColumnReader& detections, std::uint64_t first, std::size_t n,
+                   Chunk& chunk) const;
+    void BackProject(const std::vector<ComptonCone>& cones, std::size_t begin, std::size_t end,
+                     ConeKernel::Projection& projection, std::vector<double>& back) const;
+
+    ConeKernel fKernel;
+    Options fOptions;
+    std::vector<double> fImage;
+    std::vector<double> fSensitivity;
+    std::size_t fNofCones = 0;  // in the energy window, of the last iteration
+};
+
+#endif
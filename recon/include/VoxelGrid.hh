@@ -0,0 +1,27 @@
+#ifndef VoxelGrid_h
+#define VoxelGrid_h 1
+
+#include <cstddef>
+
+/// Regular voxel grid of the reconstructed images, in mm. Voxels are
+/// stored in [x][y][z] order, as in the emission map, so that a row of
+/// voxels along z is contiguous. The default covers the Target box
+/// (180 x 40 x 40 mm at z = 100 mm) with 2 mm voxels.
+
+struct VoxelGrid
+{
+    int nx = 90;
+    int ny = 20;
+    int nz = 20;
+    double origin[3] = {-90., -20., 80.};  // low corner
+    double voxel[3] = {2., 2., 2.};
+
+    std::size_t GetNofVoxels() const { return static_cast<std::size_t>(nx) * ny * nz; }
+    std::size_t Index(int ix, int iy, int iz) const
+    {
+      return (static_cast<std::size_t>(ix) * ny + iy) * nz + iz;
+    }
+    double Center(int axis, int i) const { return origin[axis] + (i + 0.5) * voxel[axis]; }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "ColumnReader.hh"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+// Value of the next "key": "value" (or "key": number) pair after pos
+std::string JsonValue(const std::string& text, const std::string& key, std::size_t& pos)
+{
+  auto keyPos = text.find("\"" + key + "\"", pos);
+  if (keyPos == std::string::npos) return {};
+  auto begin = text.find_first_not_of(" :\t\n", keyPos + key.size() + 2);
+  if (begin == std::string::npos) return {};
+  std::size_t end;
+  if (text[begin] == '"') {
+    ++begin;
+    end = text.find('"', begin);
+  }
+  else {
+    end = text.find_first_of(",}\n", begin);
+  }
+  pos = end;
+  return text.substr(begin, end - begin);
+}
+}  // namespace
+
+ColumnReader::ColumnReader(const std::string& directory, const std::string& table)
+  : fTable(table)
+{
+  std::ifstream header(directory + "/" + table + ".json");
+  if (!header) throw std::runtime_error("cannot open " + directory + "/" + table + ".json");
+  std::stringstream text;
+  text << header.rdbuf();
+  auto json = text.str();
+
+  std::size_t pos = 0;
+  fNofRows = std::stoull(JsonValue(json, "rows", pos));
+  for (;;) {
+    auto name = JsonValue(json, "name", pos);
+    if (name.empty()) break;
+    Column column;
+    column.dtype = JsonValue(json, "dtype", pos);
+    column.path = directory + "/" + JsonValue(json, "file", pos);
+    fColumns[name] = column;
+  }
+}
+
+ColumnReader::~ColumnReader()
+{
+  for (auto& entry : fColumns) {
+    if (entry.second.file) std::fclose(entry.second.file);
+  }
+}
+
+void ColumnReader::Read(const std::string& name, std::uint64_t first, std::size_t n,
+                        std::vector<double>& values)
+{
+  auto it = fColumns.find(name);
+  if (it == fColumns.end()) throw std::runtime_error("no column " + name + " in " + fTable);
+  auto& column = it->second;
+  if (column.dtype != "<f8") throw std::runtime_error(fTable + "." + name + " is not float64");
+  if (first + n > fNofRows) throw std::runtime_error("rows beyond the end of " + fTable);
+
+  if (!column.file) {
+    column.file = std::fopen(column.path.c_str(), "rb");
+    if (!column.file) throw std::runtime_error("cannot open " + column.path);
+  }
+  values.resize(n);
+  if (n == 0) return;
+  if (std::fseek(column.file, static_cast<long>(first * sizeof(double)), SEEK_SET) != 0
+      || std::fread(values.data(), sizeof(double), n, column.file) != n)
+  {
+    throw std::runtime_error("cannot read " + column.path);
+  }
+}
@@ -0,0 +1,36 @@
+#include "ComptonCone.hh"
+
+#include <cmath>
+
+namespace
+{
+constexpr double kElectronMass = 0.51099895;  // MeV
+}  // namespace
+
+bool ComptonCone::FromCoincidence(const double scatPosition[3], const double absoPosition[3],
+                                  double scatEdep, double absoEdep, double weight,
+                                  ComptonCone& cone)
+{
+  if (scatEdep <= 0. || absoEdep <= 0.) return false;
+
+  // Full absorption: E0 = E1 + E2, cos(theta) = 1 - m_e c^2 (1/E2 - 1/E0)
+  auto cosTheta = 1. - kElectronMass * (1. / absoEdep - 1. / (scatEdep + absoEdep));
+  if (cosTheta < -1. || cosTheta > 1.) return false;
+
+  double axis[3];
+  double norm = 0.;
+  for (int i = 0; i < 3; ++i) {
+    axis[i] = scatPosition[i] - absoPosition[i];
+    norm += axis[i] * axis[i];
+  }
+  if (norm <= 0.) return false;
+  norm = std::sqrt(norm);
+
+  for (int i = 0; i < 3; ++i) {
+    cone.apex[i] = scatPosition[i];
+    cone.axis[i] = axis[i] / norm;
+  }
+  cone.cosTheta = cosTheta;
+  cone.weight = weight;
+  return true;
+}
@@ -0,0 +1,70 @@
+#include "ConeKernel.hh"
+
+#include <algorithm>
+#include <cmath>
+
+ConeKernel::ConeKernel(const VoxelGrid& grid, double sigmaAngle)
+  : fGrid(grid), fSigmaAngle(sigmaAngle)
+{}
+
+void ConeKernel::Project(const ComptonCone& cone, Projection& projection) const
+{
+  projection.voxels.clear();
+  projection.values.clear();
+  projection.row.resize(fGrid.nz);
+
+  // Half width of the biweight in cos(theta); near theta = 0 the width of
+  // cos(theta) is second order in sigma
+  auto sinTheta = std::sqrt(std::max(1. - cone.cosTheta * cone.cosTheta, 0.));
+  auto sigma = std::max(sinTheta * fSigmaAngle, 0.5 * fSigmaAngle * fSigmaAngle);
+  auto invWidth2 = 1. / (7. * sigma * sigma);
+
+  const auto nz = fGrid.nz;
+  const auto zFirst = fGrid.Center(2, 0) - cone.apex[2];
+  const auto dzStep = fGrid.voxel[2];
+  const auto zLast = zFirst + (nz - 1) * dzStep;
+  const auto axisZ = cone.axis[2];
+  const auto cosTheta = cone.cosTheta;
+  const auto width = std::sqrt(7.) * sigma;
+  auto row = projection.row.data();
+
+  for (int ix = 0; ix < fGrid.nx; ++ix) {
+    auto dx = fGrid.Center(0, ix) - cone.apex[0];
+    for (int iy = 0; iy < fGrid.ny; ++iy) {
+      auto dy = fGrid.Center(1, iy) - cone.apex[1];
+      auto rxy2 = dx * dx + dy * dy;
+      auto dotXY = dx * cone.axis[0] + dy * cone.axis[1];
+
+      // Most rows miss the cone: cos(beta) along the row, (a + b z) / sqrt(c + z^2),
+      // has its extrema at the ends and at z = b c / a
+      auto cosBeta = [=](double dz) { return (dotXY + dz * axisZ) / std::sqrt(rxy2 + dz * dz); };
+      auto low = std::min(cosBeta(zFirst), cosBeta(zLast));
+      auto high = std::max(cosBeta(zFirst), cosBeta(zLast));
+      if (dotXY != 0.) {
+        auto zExtremum = axisZ * rxy2 / dotXY;
+        if (zExtremum > zFirst && zExtremum < zLast) {
+          low = std::min(low, cosBeta(zExtremum));
+          high = std::max(high, cosBeta(zExtremum));
+        }
+      }
+      if (low > cosTheta + width || high < cosTheta - width) continue;
+
+      // Branch-free, vectorised
+      for (int iz = 0; iz < nz; ++iz) {
+        auto dz = zFirst + iz * dzStep;
+        auto invR2 = 1. / (rxy2 + dz * dz);
+        auto d = (dotXY + dz * axisZ) * std::sqrt(invR2) - cosTheta;
+        auto k = std::max(1. - d * d * invWidth2, 0.);
+        row[iz] = k * k * invR2;
+      }
+
+      auto first = fGrid.Index(ix, iy, 0);
+      for (int iz = 0; iz < nz; ++iz) {
+        if (row[iz] > 0.) {
+          projection.voxels.push_back(static_cast<std::uint32_t>(first + iz));
+          projection.values.push_back(row[iz]);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,198 @@
+#include "ListModeMLEM.hh"
+
+#include "ColumnReader.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+constexpr double kPi = 3.14159265358979323846;
+
+const char* kColumns[] = {"scatPosiX", "scatPosiY", "scatPosiZ", "absoPosiX", "absoPosiY",
+                          "absoPosiZ", "scatEdep",  "absoEdep",  "weight"};
+
+// Solid angle of the rectangle [x1, x2] x [y1, y2] at height h
+double RectangleSolidAngle(double x1, double x2, double y1, double y2, double h)
+{
+  auto corner = [h](double x, double y) {
+    return std::atan(x * y / (h * std::sqrt(x * x + y * y + h * h)));
+  };
+  return corner(x2, y2) - corner(x1, y2) - corner(x2, y1) + corner(x1, y1);
+}
+
+// Threads joined when the scope is left, also by an exception: a read
+// error while they run must not reach std::terminate
+struct JoiningThreads
+{
+    std::vector<std::thread> threads;
+
+    ~JoiningThreads()
+    {
+      for (auto& thread : threads) {
+        if (thread.joinable()) thread.join();
+      }
+    }
+};
+}  // namespace
+
+ListModeMLEM::ListModeMLEM(const VoxelGrid& grid, const Options& options)
+  : fKernel(grid, options.sigmaAngle),
+    fOptions(options),
+    fImage(grid.GetNofVoxels(), 1.),
+    fSensitivity(grid.GetNofVoxels(), 0.)
+{
+  fOptions.threads = std::max(fOptions.threads, 1);
+  fOptions.subsets = std::max(fOptions.subsets, 1);
+  ComputeSensitivity();
+}
+
+void ListModeMLEM::ComputeSensitivity()
+{
+  const auto& grid = fKernel.GetGrid();
+  auto half = fOptions.scatterSize / 2.;
+  for (int ix = 0; ix < grid.nx; ++ix) {
+    auto x = grid.Center(0, ix);
+    for (int iy = 0; iy < grid.ny; ++iy) {
+      auto y = grid.Center(1, iy);
+      for (int iz = 0; iz < grid.nz; ++iz) {
+        auto h = std::abs(grid.Center(2, iz) - fOptions.scatterZ);
+        if (h == 0.) continue;
+        fSensitivity[grid.Index(ix, iy, iz)] =
+          RectangleSolidAngle(-half - x, half - x, -half - y, half - y, h) / (4. * kPi);
+      }
+    }
+  }
+}
+
+void ListModeMLEM::ReadChunk(ColumnReader& detections, std::uint64_t first, std::size_t n,
+                             Chunk& chunk) const
+{
+  // Runs before the weight column existed are unweighted
+  auto nofColumns = detections.HasColumn("weight") ? 9 : 8;
+  for (int i = 0; i < nofColumns; ++i) {
+    detections.Read(kColumns[i], first, n, chunk.columns[i]);
+  }
+
+  chunk.cones.clear();
+  for (std::size_t row = 0; row < n; ++row) {
+    auto scatEdep = chunk.columns[6][row];
+    auto absoEdep = chunk.columns[7][row];
+    auto total = scatEdep + absoEdep;
+    if (total < fOptions.energyMin || total > fOptions.energyMax) continue;
+
+    double scat[3] = {chunk.columns[0][row], chunk.columns[1][row], chunk.columns[2][row]};
+    double abso[3] = {chunk.columns[3][row], chunk.columns[4][row], chunk.columns[5][row]};
+    auto weight = nofColumns == 9 ? chunk.columns[8][row] : 1.;
+    ComptonCone cone;
+    if (ComptonCone::FromCoincidence(scat, abso, scatEdep, absoEdep, weight, cone)) {
+      chunk.cones.push_back(cone);
+    }
+  }
+}
+
+void ListModeMLEM::BackProject(const std::vector<ComptonCone>& cones, std::size_t begin,
+                               std::size_t end, ConeKernel::Projection& projection,
+                               std::vector<double>& back) const
+{
+  for (auto i = begin; i < end; ++i) {
+    fKernel.Project(cones[i], projection);
+    const auto nofElements = projection.voxels.size();
+    const auto voxels = projection.voxels.data();
+    const auto values = projection.values.data();
+
+    double forward = 0.;
+    for (std::size_t k = 0; k < nofElements; ++k) {
+      forward += values[k] * fImage[voxels[k]];
+    }
+    if (forward <= 0.) continue;
+
+    auto scale = cones[i].weight / forward;
+    for (std::size_t k = 0; k < nofElements; ++k) {
+      back[voxels[k]] += values[k] * scale;
+    }
+  }
+}
+
+void ListModeMLEM::Run(ColumnReader& detections)
+{
+  const auto nofRows = detections.GetNofRows();
+  const auto nofVoxels = fImage.size();
+  const auto nofThreads = static_cast<std::size_t>(fOptions.threads);
+  const auto subsets = static_cast<std::uint64_t>(fOptions.subsets);
+
+  std::vector<std::vector<double>> backs(nofThreads, std::vector<double>(nofVoxels));
+  std::vector<ConeKernel::Projection> projections(nofThreads);
+  Chunk chunks[2];
+
+  for (int iteration = 0; iteration < fOptions.iterations; ++iteration) {
+    auto start = std::chrono::steady_clock::now();
+    fNofCones = 0;
+
+    for (std::uint64_t subset = 0; subset < subsets; ++subset) {
+      auto first = nofRows * subset / subsets;
+      auto last = nofRows * (subset + 1) / subsets;
+      for (auto& back : backs) {
+        std::fill(back.begin(), back.end(), 0.);
+      }
+
+      // The next block is read while the threads process the current one
+      auto n = std::min<std::uint64_t>(fOptions.chunkRows, last - first);
+      ReadChunk(detections, first, n, chunks[0]);
+      for (int current = 0; first < last; current = 1 - current) {
+        const auto& cones = chunks[current].cones;
+        fNofCones += cones.size();
+
+        JoiningThreads workers;
+        for (std::size_t t = 0; t < nofThreads; ++t) {
+          auto begin = cones.size() * t / nofThreads;
+          auto end = cones.size() * (t + 1) / nofThreads;
+          workers.threads.emplace_back([&, t, begin, end]() {
+            BackProject(cones, begin, end, projections[t], backs[t]);
+          });
+        }
+
+        first += n;
+        n = std::min<std::uint64_t>(fOptions.chunkRows, last - first);
+        if (n > 0) ReadChunk(detections, first, n, chunks[1 - current]);
+      }
+
+      // Voxels the scatter does not see keep no activity
+      for (std::size_t j = 0; j < nofVoxels; ++j) {
+        double back = 0.;
+        for (const auto& threadBack : backs) {
+          back += threadBack[j];
+        }
+        fImage[j] = fSensitivity[j] > 0. ? fImage[j] * back * subsets / fSensitivity[j] : 0.;
+      }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Iteration " << iteration + 1 << ": " << fNofCones << " cones in "
+              << elapsed.count() << " s" << std::endl;
+  }
+}
+
+void ListModeMLEM::Write(const std::string& baseName) const
+{
+  auto binName = baseName + ".bin";
+  auto file = std::fopen(binName.c_str(), "wb");
+  if (!file) throw std::runtime_error("cannot open " + binName);
+  std::fwrite(fImage.data(), sizeof(double), fImage.size(), file);
+  std::fclose(file);
+
+  const auto& grid = fKernel.GetGrid();
+  std::ofstream header(baseName + ".json");
+  header << "{\n  \"file\": \"" << binName.substr(binName.rfind('/') + 1)
+         << "\",\n  \"dtype\": \"<f8\",\n  \"shape\": [" << grid.nx << ", " << grid.ny << ", "
+         << grid.nz << "],\n  \"origin\": [" << grid.origin[0] << ", " << grid.origin[1] << ", "
+         << grid.origin[2] << "],\n  \"voxel\": [" << grid.voxel[0] << ", " << grid.voxel[1]
+         << ", " << grid.voxel[2] << "],\n  \"iterations\": " << fOptions.iterations
+         << ",\n  \"subsets\": " << fOptions.subsets << ",\n  \"cones\": " << fNofCones
+         << "\n}\n";
+}
@@ -0,0 +1,172 @@
+// Regression tests of the Compton-camera reconstruction library (B4cRecon),
+// run by ctest: a point source is recovered from synthetic coincidences,
+// and a truncated column file ends the reconstruction with an exception.
+
+#include "ColumnReader.hh"
+#include "ListModeMLEM.hh"
+#include "VoxelGrid.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr double kElectronMass = 0.51099895;  // MeV
+constexpr double kPi = 3.14159265358979323846;
+
+const char* kColumns[] = {"scatPosiX", "scatPosiY", "scatPosiZ", "absoPosiX", "absoPosiY",
+                          "absoPosiZ", "scatEdep",  "absoEdep",  "weight"};
+
+// Detection table of gammas of energy E0 from a point source, Compton
+// scattered in the scatter face (z = 0, 100 x 100 mm) and fully absorbed
+// 50 mm further, in the layout of the columnar output
+void WriteDetections(const std::string& directory, const double source[3], int nofRows)
+{
+  std::filesystem::create_directories(directory);
+  std::mt19937_64 engine(12345);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  const double e0 = 4.44;
+
+  std::vector<std::vector<double>> columns(9);
+  while (static_cast<int>(columns[0].size()) < nofRows) {
+    double scat[3] = {100. * uniform(engine) - 50., 100. * uniform(engine) - 50., 0.};
+    double in[3];
+    double norm = 0.;
+    for (int i = 0; i < 3; ++i) {
+      in[i] = scat[i] - source[i];
+      norm += in[i] * in[i];
+    }
+    for (auto& component : in) {
+      component /= std::sqrt(norm);
+    }
+
+    // Outgoing direction at theta from the incoming one, random azimuth
+    auto cosTheta = 0.3 + 0.65 * uniform(engine);
+    auto sinTheta = std::sqrt(1. - cosTheta * cosTheta);
+    auto phi = 2. * kPi * uniform(engine);
+    double u[3] = {-in[1], in[0], 0.};  // orthogonal to in, in is never along z
+    auto uNorm = std::sqrt(u[0] * u[0] + u[1] * u[1]);
+    for (auto& component : u) {
+      component /= uNorm;
+    }
+    double v[3] = {in[1] * u[2] - in[2] * u[1], in[2] * u[0] - in[0] * u[2],
+                   in[0] * u[1] - in[1] * u[0]};
+    double abso[3];
+    for (int i = 0; i < 3; ++i) {
+      auto out = cosTheta * in[i] + sinTheta * (std::cos(phi) * u[i] + std::sin(phi) * v[i]);
+      abso[i] = scat[i] + 50. * out;
+    }
+    if (abso[2] >= 0.) continue;
+
+    auto absoEdep = e0 / (1. + e0 / kElectronMass * (1. - cosTheta));
+    double row[9] = {scat[0], scat[1], scat[2], abso[0], abso[1], abso[2],
+                     e0 - absoEdep, absoEdep, 1.};
+    for (int i = 0; i < 9; ++i) {
+      columns[i].push_back(row[i]);
+    }
+  }
+
+  std::ofstream header(directory + "/Detection.json");
+  header << "{\n  \"table\": \"Detection\",\n  \"rows\": " << nofRows << ",\n  \"columns\": [";
+  for (int i = 0; i < 9; ++i) {
+    auto file = std::string("Detection.") + kColumns[i] + ".bin";
+    header << (i ? "," : "") << "\n    {\"name\": \"" << kColumns[i]
+           << "\", \"dtype\": \"<f8\", \"file\": \"" << file << "\"}";
+    std::ofstream column(directory + "/" + file, std::ios::binary);
+    column.write(reinterpret_cast<const char*>(columns[i].data()),
+                 static_cast<std::streamsize>(columns[i].size() * sizeof(double)));
+  }
+  header << "\n  ]\n}\n";
+}
+
+// 40 x 40 x 40 mm around the source, 2 mm voxels
+VoxelGrid MakeGrid(const double source[3])
+{
+  VoxelGrid grid;
+  grid.nx = grid.ny = grid.nz = 20;
+  for (int axis = 0; axis < 3; ++axis) {
+    grid.origin[axis] = source[axis] - 20.;
+  }
+  return grid;
+}
+
+bool TestPointSource(const std::string& directory)
+{
+  const double source[3] = {20., 0., 100.};
+  WriteDetections(directory, source, 20000);
+
+  auto grid = MakeGrid(source);
+  ListModeMLEM::Options options;
+  options.iterations = 5;
+  options.threads = 2;
+  options.chunkRows = 4096;
+  ListModeMLEM mlem(grid, options);
+  ColumnReader detections(directory, "Detection");
+  mlem.Run(detections);
+
+  const auto& image = mlem.GetImage();
+  auto peak = std::max_element(image.begin(), image.end()) - image.begin();
+  auto ix = static_cast<int>(peak / (grid.ny * grid.nz));
+  auto iy = static_cast<int>(peak / grid.nz % grid.ny);
+  auto iz = static_cast<int>(peak % grid.nz);
+  double position[3] = {grid.Center(0, ix), grid.Center(1, iy), grid.Center(2, iz)};
+  double distance2 = 0.;
+  for (int axis = 0; axis < 3; ++axis) {
+    distance2 += (position[axis] - source[axis]) * (position[axis] - source[axis]);
+  }
+
+  std::cout << "point source: maximum at (" << position[0] << ", " << position[1] << ", "
+            << position[2] << "), " << mlem.GetNofCones() << " cones" << std::endl;
+  return mlem.GetNofCones() == 20000 && std::sqrt(distance2) <= 4.;
+}
+
+bool TestTruncatedColumn(const std::string& directory)
+{
+  const double source[3] = {20., 0., 100.};
+  WriteDetections(directory, source, 20000);
+  // A column shorter than the header says, as left by an interrupted job
+  std::filesystem::resize_file(directory + "/Detection.weight.bin", 10000 * sizeof(double));
+
+  ListModeMLEM::Options options;
+  options.iterations = 1;
+  options.threads = 2;
+  options.chunkRows = 4096;
+  ListModeMLEM mlem(MakeGrid(source), options);
+  ColumnReader detections(directory, "Detection");
+  try {
+    mlem.Run(detections);
+  }
+  catch (const std::runtime_error& e) {
+    std::cout << "truncated column: " << e.what() << std::endl;
+    return true;
+  }
+  std::cout << "truncated column: no error" << std::endl;
+  return false;
+}
+}  // namespace
+
+int main()
+{
+  auto directory = std::filesystem::temp_directory_path() / "testRecon";
+  std::filesystem::remove_all(directory);
+
+  auto failures = 0;
+  if (!TestPointSource((directory / "point").string())) {
+    std::cout << "FAILED: point source not recovered" << std::endl;
+    ++failures;
+  }
+  if (!TestTruncatedColumn((directory / "truncated").string())) {
+    std::cout << "FAILED: truncated column not reported" << std::endl;
+    ++failures;
+  }
+
+  std::filesystem::remove_all(directory);
+  return failures == 0 ? 0 : 1;
+}
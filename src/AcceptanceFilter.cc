@@ -0,0 +1,238 @@
+#include "AcceptanceFilter.hh"
+
+#include "G4Box.hh"
+#include "G4Electron.hh"
+#include "G4Gamma.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4Neutron.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4Positron.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iomanip>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AcceptanceFilter* AcceptanceFilter::Instance()
+{
+  static AcceptanceFilter instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AcceptanceFilter::AcceptanceFilter() : fMargin(20. * mm)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AcceptanceFilter::~AcceptanceFilter()
+{
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AcceptanceFilter::Category AcceptanceFilter::GetCategory(
+  const G4ParticleDefinition* particle) const
+{
+  if (particle == G4Gamma::Definition()) return kGamma;
+  if (particle == G4Neutron::Definition()) return kNeutron;
+  if (particle == G4Electron::Definition() || particle == G4Positron::Definition()) {
+    return kElectron;
+  }
+  return kOther;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AcceptanceFilter::Decision AcceptanceFilter::Decide(Category category,
+                                                    const G4ThreeVector& position,
+                                                    const G4ThreeVector& direction)
+{
+  auto& counters = fCounters.Local();
+  ++counters.exits[category];
+
+  auto policy = fPolicy[category];
+  if (policy == kKeep || (policy == kRay && HitsCamera(position, direction))) return kPass;
+
+  if (fProbeInterval > 0 && ++counters.sinceProbe >= static_cast<std::uint64_t>(fProbeInterval)) {
+    counters.sinceProbe = 0;
+    ++counters.probes[category];
+    return kProbe;
+  }
+  ++counters.killed[category];
+  return kReject;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AcceptanceFilter::CountProbe(Category category, G4int steps)
+{
+  fCounters.Local().probeSteps[category] += steps;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool AcceptanceFilter::HitsCamera(const G4ThreeVector& position,
+                                    const G4ThreeVector& direction) const
+{
+  // Slab test of the half line against the enlarged camera box
+  G4double tMin = 0.;
+  G4double tMax = DBL_MAX;
+  for (G4int axis = 0; axis < 3; ++axis) {
+    auto low = fCameraMin[axis] - fMargin;
+    auto high = fCameraMax[axis] + fMargin;
+    if (direction[axis] == 0.) {
+      if (position[axis] < low || position[axis] > high) return false;
+      continue;
+    }
+    auto t1 = (low - position[axis]) / direction[axis];
+    auto t2 = (high - position[axis]) / direction[axis];
+    if (t1 > t2) std::swap(t1, t2);
+    tMin = std::max(tMin, t1);
+    tMax = std::min(tMax, t2);
+    if (tMin > tMax) return false;
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AcceptanceFilter::BeginRun()
+{
+  fTargetLV = nullptr;
+  if (!fEnabled) return;
+
+  // Box around both camera layers, which are not rotated
+  G4bool first = true;
+  auto pvStore = G4PhysicalVolumeStore::GetInstance();
+  for (auto name : {"Scat", "Abso"}) {
+    auto pv = pvStore->GetVolume(name, false);
+    auto box = pv ? dynamic_cast<G4Box*>(pv->GetLogicalVolume()->GetSolid()) : nullptr;
+    if (!box) {
+      G4ExceptionDescription msg;
+      msg << "No box volume " << name << " in the geometry, the acceptance filter is off.";
+      G4Exception("AcceptanceFilter::BeginRun()", "MyCode0015", JustWarning, msg);
+      return;
+    }
+    G4ThreeVector halfLength(box->GetXHalfLength(), box->GetYHalfLength(),
+                             box->GetZHalfLength());
+    auto low = pv->GetTranslation() - halfLength;
+    auto high = pv->GetTranslation() + halfLength;
+    for (G4int axis = 0; axis < 3; ++axis) {
+      fCameraMin[axis] = first ? low[axis] : std::min(fCameraMin[axis], low[axis]);
+      fCameraMax[axis] = first ? high[axis] : std::max(fCameraMax[axis], high[axis]);
+    }
+    first = false;
+  }
+  fTargetLV = G4LogicalVolumeStore::GetInstance()->GetVolume("Target", false);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AcceptanceFilter::EndRun()
+{
+  Counters total;
+  fCounters.ForEach([&total](Counters& counters) {
+    for (G4int category = 0; category < kNofCategories; ++category) {
+      total.exits[category] += counters.exits[category];
+      total.killed[category] += counters.killed[category];
+      total.probes[category] += counters.probes[category];
+      total.probeSteps[category] += counters.probeSteps[category];
+    }
+    counters = Counters();
+  });
+  if (!fTargetLV) return;
+
+  static const char* names[kNofCategories] = {"gamma", "neutron", "e-/e+", "other"};
+  static const char* policies[] = {"keep", "ray", "kill"};
+
+  G4cout << G4endl << "--------------------Acceptance filter-----------------------" << G4endl
+         << std::setw(10) << "particle" << std::setw(7) << "policy" << std::setw(12) << "exits"
+         << std::setw(12) << "killed" << std::setw(9) << "probes" << std::setw(12)
+         << "steps/track" << std::setw(14) << "steps saved" << G4endl;
+  G4double allSaved = 0.;
+  for (G4int category = 0; category < kNofCategories; ++category) {
+    auto probes = total.probes[category];
+    auto stepsPerTrack = probes > 0 ? G4double(total.probeSteps[category]) / probes : 0.;
+    auto saved = stepsPerTrack * total.killed[category];
+    allSaved += saved;
+    G4cout << std::setw(10) << names[category] << std::setw(7) << policies[fPolicy[category]]
+           << std::setw(12) << total.exits[category] << std::setw(12) << total.killed[category]
+           << std::setw(9) << probes << std::setw(12) << std::setprecision(3) << stepsPerTrack
+           << std::setw(14) << std::setprecision(4) << saved << G4endl;
+  }
+  G4cout << " about " << std::setprecision(4) << allSaved
+         << " steps saved (steps of the killed tracks themselves, estimated from the"
+         << " probes; their secondaries are not counted)"
+         << std::setprecision(6) << G4endl
+         << "------------------------------------------------------------" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AcceptanceFilter::SetPolicy(Category category, const G4String& policy)
+{
+  if (policy == "keep") {
+    fPolicy[category] = kKeep;
+  }
+  else if (policy == "kill") {
+    fPolicy[category] = kKill;
+  }
+  else {
+    fPolicy[category] = kRay;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AcceptanceFilter::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/filter/",
+                                      "Killing of tracks that cannot reach the camera");
+
+  auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+    "Apply the particle policies to the tracks leaving the Target.");
+  enableCmd.SetParameterName("flag", true);
+  enableCmd.SetDefaultValue("true");
+  enableCmd.SetToBeBroadcasted(false);
+
+  const char* policyGuidance =
+    "keep: track it, kill: kill it when it leaves the Target,\n"
+    "ray: kill it when its straight line misses the camera box.";
+  auto& gammaCmd = fMessenger->DeclareMethod("gamma", &AcceptanceFilter::SetGammaPolicy,
+    G4String("Policy of the gammas; ") + policyGuidance);
+  auto& neutronCmd = fMessenger->DeclareMethod("neutron", &AcceptanceFilter::SetNeutronPolicy,
+    G4String("Policy of the neutrons; ") + policyGuidance);
+  auto& electronCmd = fMessenger->DeclareMethod("electron", &AcceptanceFilter::SetElectronPolicy,
+    G4String("Policy of the electrons and positrons; ") + policyGuidance);
+  auto& otherCmd = fMessenger->DeclareMethod("other", &AcceptanceFilter::SetOtherPolicy,
+    G4String("Policy of all other particles; ") + policyGuidance);
+  for (auto cmd : {&gammaCmd, &neutronCmd, &electronCmd, &otherCmd}) {
+    cmd->SetParameterName("policy", false);
+    cmd->SetCandidates("keep ray kill");
+    cmd->SetToBeBroadcasted(false);
+  }
+
+  auto& marginCmd = fMessenger->DeclarePropertyWithUnit("margin", "mm", fMargin,
+    "Enlargement of the camera box in the ray test, for the deflection of\n"
+    "charged particles in the air.");
+  marginCmd.SetParameterName("margin", false);
+  marginCmd.SetRange("margin>=0.");
+  marginCmd.SetToBeBroadcasted(false);
+
+  auto& probeCmd = fMessenger->DeclareProperty("probeInterval", fProbeInterval,
+    "Track one in this many tracks to be killed to estimate the steps saved;\n"
+    "0 kills them all.");
+  probeCmd.SetParameterName("interval", false);
+  probeCmd.SetRange("interval>=0");
+  probeCmd.SetToBeBroadcasted(false);
+}
@@ -3,7 +3,8 @@
 #include "EventAction.hh"
 #include "PrimaryGeneratorAction.hh"
 #include "RunAction.hh"
-#include "SteppingAction.hh"
+#include "StackingAction.hh"
+#include "TrackingAction.hh"
 
 void ActionInitialization::BuildForMaster() const
 {
@@ -19,6 +20,9 @@ void ActionInitialization::Build() const
   SetUserAction(runAction);
   auto eventAction = new EventAction(runAction);
   SetUserAction(eventAction);
-  auto steppingAction = new SteppingAction(eventAction);
-  SetUserAction(steppingAction);
+  // Prompt gammas are tagged when they are created. No stepping action is
+  // set here: RunAction installs those of the acceptance filter and the
+  // profiler once they are enabled
+  SetUserAction(new StackingAction(eventAction));
+  SetUserAction(new TrackingAction);
 }
@@ -0,0 +1,358 @@
+#include "AdaptiveRun.hh"
+
+#include "G4Box.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4UnitsTable.hh"
+
+#include <algorithm>
+#include <cmath>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AdaptiveRun* AdaptiveRun::Instance()
+{
+  static AdaptiveRun instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AdaptiveRun::AdaptiveRun()
+  : fFalloffPrecision(0.5 * mm), fEnergyMin(4.24 * MeV), fEnergyMax(4.64 * MeV), fInterval(5. * s)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AdaptiveRun::~AdaptiveRun()
+{
+  Stop();
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AdaptiveRun::Accumulator& AdaptiveRun::Local()
+{
+  auto& accumulator = fAccumulators.Local();
+  // The first event of a run starts a new batch
+  if (accumulator.run != fRun) {
+    accumulator.run = fRun;
+    ResetBatch(accumulator.batch);
+  }
+  return accumulator;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::ResetBatch(Batch& batch) const
+{
+  batch.events = 0;
+  batch.count = 0.;
+  batch.depth.assign(fStatistic == Statistic::Falloff ? fNofDepthBins : 0, 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::CountCoincidence(G4double totalEnergy, G4double weight)
+{
+  if (fStatistic != Statistic::Window) return;
+  if (totalEnergy < fEnergyMin || totalEnergy > fEnergyMax) return;
+  Local().batch.count += weight;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::AddPromptGamma(G4double depth, G4double energy, G4double weight)
+{
+  if (fStatistic != Statistic::Falloff) return;
+  if (energy < fEnergyMin || energy > fEnergyMax) return;
+  auto bin = static_cast<G4int>(std::floor((depth - fDepthMin) / fDepthBin));
+  if (bin < 0 || bin >= fNofDepthBins) return;
+  Local().batch.depth[bin] += weight;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::EndOfEvent()
+{
+  auto& batch = Local().batch;
+  if (++batch.events < fBatchEvents) return;
+
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fPending.push_back(std::move(batch));
+  }
+  ResetBatch(batch);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::Start()
+{
+  Stop();
+  fStopRequested.store(false);
+  ++fRun;
+  if (fStatistic == Statistic::None) return;
+
+  if (fStatistic == Statistic::Falloff) {
+    auto targetPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("Target", false);
+    auto targetBox = targetPV ? dynamic_cast<G4Box*>(targetPV->GetLogicalVolume()->GetSolid())
+                              : nullptr;
+    if (!targetBox) {
+      G4Exception("AdaptiveRun::Start()", "MyCode0017", JustWarning,
+                  "Target box not found, the run is not adaptive.");
+      return;
+    }
+    // 1 mm bins along the beam
+    fNofDepthBins = std::max(1, static_cast<G4int>(std::lround(2. * targetBox->GetXHalfLength())));
+    fDepthMin = targetPV->GetTranslation().x() - targetBox->GetXHalfLength();
+    fDepthBin = 2. * targetBox->GetXHalfLength() / fNofDepthBins;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fPending.clear();
+  }
+  fYields.clear();
+  for (auto& group : fGroups) {
+    group.assign(fStatistic == Statistic::Falloff ? fNofDepthBins : 0, 0.);
+  }
+  fNofBatches = 0;
+  fActive = true;
+
+  fMonitorStop = false;
+  fMonitor = std::thread(&AdaptiveRun::MonitorLoop, this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::Stop()
+{
+  if (!fMonitor.joinable()) return;
+
+  {
+    std::lock_guard<std::mutex> lock(fStopMutex);
+    fMonitorStop = true;
+  }
+  fStopCondition.notify_all();
+  fMonitor.join();
+  fActive = false;
+
+  // Full batches only; the threads' last partial batches are left out
+  Collect();
+  auto estimate = Evaluate();
+
+  G4cout << G4endl << "--------------------Adaptive run----------------------------" << G4endl
+         << " " << fNofBatches << " batches of " << fBatchEvents << " events, energy window "
+         << G4BestUnit(fEnergyMin, "Energy") << "- " << G4BestUnit(fEnergyMax, "Energy")
+         << G4endl;
+  if (!estimate.valid) {
+    G4cout << " too few batches for an estimate" << G4endl;
+  }
+  else if (fStatistic == Statistic::Window) {
+    G4cout << " coincidences per event: " << estimate.value << " +- " << estimate.error
+           << " (relative " << estimate.error / estimate.value << ", target "
+           << fRelativePrecision << ")" << G4endl;
+  }
+  else {
+    G4cout << " distal falloff: " << G4BestUnit(estimate.value, "Length") << "+- "
+           << G4BestUnit(estimate.error, "Length") << "(target "
+           << G4BestUnit(fFalloffPrecision, "Length") << ")" << G4endl;
+  }
+  G4cout << (fStopRequested.load() ? " target reached, the run was stopped early"
+                                   : " target not reached within the run")
+         << G4endl << "------------------------------------------------------------" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::MonitorLoop()
+{
+  auto interval = std::chrono::duration<G4double>(fInterval / s);
+  std::unique_lock<std::mutex> lock(fStopMutex);
+  while (!fStopCondition.wait_for(lock, interval, [this]() { return fMonitorStop; })) {
+    lock.unlock();
+    Collect();
+    if (!fStopRequested.load(std::memory_order_relaxed) && IsPrecise(Evaluate())) {
+      fStopRequested.store(true);
+    }
+    lock.lock();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::Collect()
+{
+  std::vector<Batch> batches;
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    batches.swap(fPending);
+  }
+
+  for (const auto& batch : batches) {
+    if (fStatistic == Statistic::Window) {
+      fYields.push_back(batch.count / batch.events);
+    }
+    else {
+      // Batches are dealt to the groups in turn
+      auto& group = fGroups[fNofBatches % kNofGroups];
+      for (std::size_t bin = 0; bin < group.size(); ++bin) {
+        group[bin] += batch.depth[bin];
+      }
+    }
+    ++fNofBatches;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AdaptiveRun::Estimate AdaptiveRun::Evaluate() const
+{
+  Estimate estimate;
+  if (fNofBatches < static_cast<std::size_t>(std::max(fMinBatches, 2))) return estimate;
+
+  // Batch means: the spread of n independent estimates gives the error
+  // of their mean
+  std::vector<G4double> values;
+  if (fStatistic == Statistic::Window) {
+    values = fYields;
+  }
+  else {
+    if (fNofBatches < kNofGroups) return estimate;
+    for (const auto& group : fGroups) {
+      G4double position;
+      if (!Falloff(group, position)) return estimate;
+      values.push_back(position);
+    }
+  }
+
+  G4double sum = 0.;
+  G4double sum2 = 0.;
+  for (auto value : values) {
+    sum += value;
+    sum2 += value * value;
+  }
+  auto n = static_cast<G4double>(values.size());
+  auto mean = sum / n;
+  auto variance = std::max(sum2 - n * mean * mean, 0.) / (n - 1.);
+
+  estimate.valid = fStatistic == Statistic::Falloff || mean > 0.;
+  estimate.value = mean;
+  estimate.error = std::sqrt(variance / n);
+  return estimate;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool AdaptiveRun::Falloff(const std::vector<G4double>& depth, G4double& position) const
+{
+  // Profile smoothed over 3 bins, half of its maximum beyond the maximum
+  auto n = static_cast<G4int>(depth.size());
+  if (n < 3) return false;
+  std::vector<G4double> smooth(n, 0.);
+  for (G4int i = 1; i + 1 < n; ++i) {
+    smooth[i] = (depth[i - 1] + depth[i] + depth[i + 1]) / 3.;
+  }
+  auto peak = std::max_element(smooth.begin(), smooth.end()) - smooth.begin();
+  auto half = smooth[peak] / 2.;
+  if (half <= 0.) return false;
+
+  for (auto i = peak + 1; i < n; ++i) {
+    if (smooth[i] < half) {
+      auto fraction = (smooth[i - 1] - half) / (smooth[i - 1] - smooth[i]);
+      position = fDepthMin + (i - 0.5 + fraction) * fDepthBin;
+      return true;
+    }
+  }
+  return false;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool AdaptiveRun::IsPrecise(const Estimate& estimate) const
+{
+  if (!estimate.valid) return false;
+  if (fStatistic == Statistic::Window) {
+    return estimate.error <= fRelativePrecision * estimate.value;
+  }
+  return estimate.error <= fFalloffPrecision;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::SetStatistic(const G4String& name)
+{
+  if (name == "window") {
+    fStatistic = Statistic::Window;
+  }
+  else if (name == "falloff") {
+    fStatistic = Statistic::Falloff;
+  }
+  else {
+    fStatistic = Statistic::None;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AdaptiveRun::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/adaptive/", "Run ended on a target precision");
+
+  auto& statisticCmd = fMessenger->DeclareMethod("statistic", &AdaptiveRun::SetStatistic,
+    "Statistic that ends the run: none, window (coincidences per event in the\n"
+    "energy window) or falloff (distal falloff of the prompt-gamma depth profile\n"
+    "in the energy window).");
+  statisticCmd.SetParameterName("statistic", false);
+  statisticCmd.SetCandidates("none window falloff");
+  statisticCmd.SetToBeBroadcasted(false);
+
+  auto& relativeCmd = fMessenger->DeclareProperty("relativePrecision", fRelativePrecision,
+    "Target relative uncertainty of the window statistic.");
+  relativeCmd.SetParameterName("precision", false);
+  relativeCmd.SetRange("precision>0.");
+  relativeCmd.SetToBeBroadcasted(false);
+
+  auto& falloffCmd = fMessenger->DeclarePropertyWithUnit("falloffPrecision", "mm",
+    fFalloffPrecision, "Target uncertainty of the falloff position.");
+  falloffCmd.SetParameterName("precision", false);
+  falloffCmd.SetRange("precision>0.");
+  falloffCmd.SetToBeBroadcasted(false);
+
+  auto& energyMinCmd = fMessenger->DeclarePropertyWithUnit("energyMin", "MeV", fEnergyMin,
+    "Lower edge of the energy window: total energy of a coincidence, or energy\n"
+    "of a prompt gamma for the falloff.");
+  energyMinCmd.SetParameterName("energy", false);
+  energyMinCmd.SetRange("energy>=0.");
+  energyMinCmd.SetToBeBroadcasted(false);
+
+  auto& energyMaxCmd = fMessenger->DeclarePropertyWithUnit("energyMax", "MeV", fEnergyMax,
+    "Upper edge of the energy window.");
+  energyMaxCmd.SetParameterName("energy", false);
+  energyMaxCmd.SetRange("energy>0.");
+  energyMaxCmd.SetToBeBroadcasted(false);
+
+  auto& batchCmd = fMessenger->DeclareProperty("batchEvents", fBatchEvents,
+    "Events per batch of a thread.");
+  batchCmd.SetParameterName("events", false);
+  batchCmd.SetRange("events>0");
+  batchCmd.SetToBeBroadcasted(false);
+
+  auto& minBatchesCmd = fMessenger->DeclareProperty("minBatches", fMinBatches,
+    "Batches needed before the run may be ended.");
+  minBatchesCmd.SetParameterName("batches", false);
+  minBatchesCmd.SetRange("batches>=2");
+  minBatchesCmd.SetToBeBroadcasted(false);
+
+  auto& intervalCmd = fMessenger->DeclarePropertyWithUnit("interval", "s", fInterval,
+    "Wall time between two checks of the precision.");
+  intervalCmd.SetParameterName("interval", false);
+  intervalCmd.SetRange("interval>0.");
+  intervalCmd.SetToBeBroadcasted(false);
+}
@@ -0,0 +1,218 @@
+#include "AsyncWriter.hh"
+
+#include "ColumnOutput.hh"
+
+#include "G4AutoLock.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace
+{
+G4Mutex producersMutex = G4MUTEX_INITIALIZER;
+constexpr std::size_t kBatchSize = 4096;  // records drained per ring and pass
+}  // namespace
+
+G4ThreadLocal AsyncWriter::Producer* AsyncWriter::fProducer = nullptr;
+G4ThreadLocal G4int AsyncWriter::fProducerGeneration = -1;
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AsyncWriter* AsyncWriter::Instance()
+{
+  static AsyncWriter instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::Start(G4int detectionTableID, G4int promptTableID, G4int pixelTableID)
+{
+  if (IsRunning()) return;
+
+  fDetectionTableID = detectionTableID;
+  fPromptTableID = promptTableID;
+  fPixelTableID = pixelTableID;
+
+  // Rings are sized per run; threads register again on their first push
+  {
+    G4AutoLock lock(&producersMutex);
+    fProducers.clear();
+    ++fGeneration;
+  }
+
+  fStopRequested = false;
+  fRunning.store(true, std::memory_order_release);
+  fWriter = std::thread(&AsyncWriter::WriterLoop, this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::Stop()
+{
+  // Called when no thread pushes anymore: the writer drains what is left
+  if (!IsRunning()) return;
+
+  fStopRequested.store(true, std::memory_order_release);
+  fWriter.join();
+  fRunning.store(false, std::memory_order_release);
+
+  PrintStatistics();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+AsyncWriter::Producer* AsyncWriter::GetProducer()
+{
+  if (fProducerGeneration != fGeneration) {
+    G4AutoLock lock(&producersMutex);
+    fProducers.push_back(std::make_unique<Producer>(fRingCapacity));
+    fProducer = fProducers.back().get();
+    fProducerGeneration = fGeneration;
+  }
+  return fProducer;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::Push(const EventAction::PromptGamma& record)
+{
+  auto producer = GetProducer();
+  PushTo(producer->prompt, producer, record);
+  ++producer->promptPushed;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::Push(const EventAction::Detection& record)
+{
+  auto producer = GetProducer();
+  PushTo(producer->detection, producer, record);
+  ++producer->detectionPushed;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::Push(const EventAction::PixelRecord& record)
+{
+  auto producer = GetProducer();
+  PushTo(producer->pixel, producer, record);
+  ++producer->pixelPushed;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::PushMarker(std::function<void()> onWritten)
+{
+  auto producer = GetProducer();
+  std::lock_guard<std::mutex> lock(producer->markerMutex);
+  producer->markers.push_back(
+    {producer->promptPushed, producer->detectionPushed, producer->pixelPushed,
+     std::move(onWritten)});
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+template<class T>
+void AsyncWriter::PushTo(RingBuffer<T>& ring, Producer* producer, const T& record)
+{
+  ++producer->nofRecords;
+  if (ring.TryPush(record)) return;
+
+  // Backpressure: the writer is behind, wait for a free slot
+  auto start = std::chrono::steady_clock::now();
+  while (!ring.TryPush(record)) {
+    std::this_thread::yield();
+  }
+  std::chrono::nanoseconds waited = std::chrono::steady_clock::now() - start;
+  ++producer->nofStalls;
+  producer->stallNanoseconds += waited.count();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::size_t AsyncWriter::Drain()
+{
+  std::vector<Producer*> producers;
+  {
+    G4AutoLock lock(&producersMutex);
+    for (const auto& producer : fProducers) {
+      producers.push_back(producer.get());
+    }
+  }
+
+  std::size_t nofRecords = 0;
+  std::vector<std::function<void()>> reached;
+  for (auto producer : producers) {
+    auto occupancy =
+      std::max({producer->prompt.Size(), producer->detection.Size(), producer->pixel.Size()});
+    producer->maxOccupancy = std::max(producer->maxOccupancy, occupancy);
+
+    auto nofPrompt = producer->prompt.PopBatch(
+      kBatchSize, [this](const auto& record) { EventAction::FillColumns(fPromptTableID, record); });
+    auto nofDetection = producer->detection.PopBatch(kBatchSize, [this](const auto& record) {
+      EventAction::FillColumns(fDetectionTableID, record);
+    });
+    auto nofPixel = producer->pixel.PopBatch(kBatchSize, [this](const auto& record) {
+      EventAction::FillColumns(fPixelTableID, record);
+    });
+    producer->promptPopped += nofPrompt;
+    producer->detectionPopped += nofDetection;
+    producer->pixelPopped += nofPixel;
+    nofRecords += nofPrompt + nofDetection + nofPixel;
+
+    std::lock_guard<std::mutex> lock(producer->markerMutex);
+    while (!producer->markers.empty()
+           && producer->markers.front().promptCount <= producer->promptPopped
+           && producer->markers.front().detectionCount <= producer->detectionPopped
+           && producer->markers.front().pixelCount <= producer->pixelPopped)
+    {
+      reached.push_back(std::move(producer->markers.front().onWritten));
+      producer->markers.pop_front();
+    }
+  }
+
+  // The records before the markers are staged in this thread's blocks
+  if (!reached.empty()) {
+    ColumnOutput::Instance()->FlushThread();
+    for (const auto& onWritten : reached) {
+      onWritten();
+    }
+  }
+  return nofRecords;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::WriterLoop()
+{
+  while (true) {
+    // Read the flag before draining, so nothing pushed before Stop() is missed
+    auto stopping = fStopRequested.load(std::memory_order_acquire);
+    auto nofRecords = Drain();
+    if (nofRecords == 0) {
+      if (stopping) break;
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  }
+
+  // The column blocks of this thread are written out here as well
+  ColumnOutput::Instance()->FlushThread();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void AsyncWriter::PrintStatistics() const
+{
+  G4cout << G4endl << " Asynchronous writer: ring capacity " << fRingCapacity
+         << " records per type and thread" << G4endl;
+  for (std::size_t i = 0; i < fProducers.size(); ++i) {
+    const auto& producer = *fProducers[i];
+    G4cout << "   producer " << std::setw(3) << i << ": " << std::setw(12) << producer.nofRecords
+           << " records, " << std::setw(8) << producer.nofStalls << " stalls ("
+           << producer.stallNanoseconds * 1e-6 << " ms), peak fill " << std::setprecision(3)
+           << 100. * producer.maxOccupancy / producer.prompt.Capacity() << " %"
+           << std::setprecision(6) << G4endl;
+  }
+}
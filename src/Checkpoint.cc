@@ -0,0 +1,396 @@
+#include "Checkpoint.hh"
+
+#include "AsyncWriter.hh"
+#include "ColumnOutput.hh"
+#include "Sharding.hh"
+
+#include "G4AnalysisManager.hh"
+
+#include "tools/rcsv_histo"
+#include "tools/wcsv_histo"
+
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace
+{
+constexpr char kMagic[8] = {'B', '4', 'C', 'C', 'K', 'P', 'T', '1'};
+
+struct FileHeader
+{
+    char magic[8];
+    std::uint64_t masterSeed;
+    std::int32_t shardIndex;
+    std::int32_t nofShards;
+    std::int32_t runID;
+    std::int32_t nofEvents;
+    std::uint64_t nofCompleted;
+    std::uint32_t nofTables;
+    std::uint32_t nofH1s;
+};
+static_assert(sizeof(FileHeader) == 48, "checkpoint header must be packed");
+}  // namespace
+
+G4ThreadLocal Checkpoint::ThreadState* Checkpoint::fState = nullptr;
+G4ThreadLocal G4int Checkpoint::fStateGeneration = -1;
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Checkpoint* Checkpoint::Instance()
+{
+  static Checkpoint instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::uint64_t Checkpoint::LoadResumeFile(const G4String& fileName)
+{
+  G4ExceptionDescription msg;
+  auto file = std::fopen(fileName.c_str(), "rb");
+  FileHeader header{};
+  if (!file || std::fread(&header, sizeof(header), 1, file) != 1
+      || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+  {
+    if (file) std::fclose(file);
+    msg << fileName << " is not a readable checkpoint file.";
+    G4Exception("Checkpoint::LoadResumeFile()", "MyCode0010", FatalException, msg);
+    return 0;
+  }
+
+  fResumeRunID = header.runID;
+  fResumeNofEvents = header.nofEvents;
+  fResumeShard = header.shardIndex;
+
+  fResumeRows.resize(header.nofTables);
+  std::fread(fResumeRows.data(), sizeof(std::uint64_t), fResumeRows.size(), file);
+
+  for (std::uint32_t i = 0; i < header.nofH1s; ++i) {
+    std::uint64_t length = 0;
+    std::fread(&length, sizeof(length), 1, file);
+    std::string text(length, '\0');
+    std::fread(&text[0], 1, length, file);
+
+    std::istringstream stream(text);
+    tools::rcsv::histo reader(stream);
+    std::string objectClass;
+    void* object = nullptr;
+    if (reader.read(G4cout, objectClass, object) && objectClass == H1::s_class()) {
+      fBaseH1s.push_back(*static_cast<H1*>(object));
+      delete static_cast<H1*>(object);
+    }
+  }
+
+  fResumeWords.resize((static_cast<std::size_t>(header.nofEvents) + 63) / 64);
+  auto nofWords = std::fread(fResumeWords.data(), sizeof(std::uint64_t), fResumeWords.size(), file);
+  std::fclose(file);
+
+  if (nofWords != fResumeWords.size() || fBaseH1s.size() != header.nofH1s) {
+    msg << fileName << " is truncated.";
+    G4Exception("Checkpoint::LoadResumeFile()", "MyCode0010", FatalException, msg);
+    return 0;
+  }
+
+  G4cout << "Checkpoint: resuming run " << header.runID << " after " << header.nofCompleted
+         << " of " << header.nofEvents << " events" << G4endl;
+  return header.masterSeed;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::BeginRun(G4int runID, G4int nofEvents, G4int eventOffset, G4int nofH1s,
+                          const G4String& fileName, G4int eventsPerSnapshot, G4double interval)
+{
+  fFileName = fileName;
+  fEnabled = !fileName.empty();
+  fEventsPerSnapshot = eventsPerSnapshot;
+  fInterval = std::chrono::duration<G4double>(interval);
+  fRunID = runID;
+  fNofEvents = nofEvents;
+  fEventOffset = eventOffset;
+  fNofH1s = nofH1s;
+  fResuming = false;
+
+  // The completed-event map is only needed to checkpoint or to skip events
+  fNofWords = (static_cast<std::size_t>(nofEvents) + 63) / 64;
+  fNofCompleted = 0;
+  if (fEnabled || runID <= fResumeRunID) {
+    fCompleted.reset(new std::atomic<std::uint64_t>[fNofWords]);
+    for (std::size_t i = 0; i < fNofWords; ++i) {
+      fCompleted[i].store(0, std::memory_order_relaxed);
+    }
+  }
+  else {
+    fCompleted.reset();
+  }
+
+  if (runID < fResumeRunID) {
+    G4ExceptionDescription msg;
+    msg << "Run " << runID << " was completed before the checkpoint of run " << fResumeRunID
+        << ", its events are skipped.";
+    G4Exception("Checkpoint::BeginRun()", "MyCode0010", JustWarning, msg);
+    for (G4int i = 0; i < nofEvents; ++i) {
+      fCompleted[i >> 6].fetch_or(std::uint64_t(1) << (i & 63), std::memory_order_relaxed);
+    }
+    fNofCompleted = nofEvents;
+  }
+  else if (runID == fResumeRunID) {
+    if (nofEvents != fResumeNofEvents || Sharding::Instance()->GetShardIndex() != fResumeShard) {
+      G4ExceptionDescription msg;
+      msg << "The checkpoint was taken for shard " << fResumeShard << " with " << fResumeNofEvents
+          << " events, this run is shard " << Sharding::Instance()->GetShardIndex() << " with "
+          << nofEvents << " events.";
+      G4Exception("Checkpoint::BeginRun()", "MyCode0010", FatalException, msg);
+      return;
+    }
+    for (std::size_t i = 0; i < fNofWords; ++i) {
+      fCompleted[i].store(fResumeWords[i], std::memory_order_relaxed);
+      fNofCompleted += std::bitset<64>(fResumeWords[i]).count();
+    }
+    fResuming = true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fStates.clear();
+    fDeferred.clear();
+    ++fGeneration;
+  }
+
+  if (fEnabled) {
+    fStopRequested = false;
+    fWriter = std::thread(&Checkpoint::CheckpointLoop, this);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::RestoreHistograms() const
+{
+  if (!fResuming) return;
+
+  auto analysisManager = G4AnalysisManager::Instance();
+  for (std::size_t i = 0; i < fBaseH1s.size(); ++i) {
+    if (auto h1 = analysisManager->GetH1(static_cast<G4int>(i), false, false)) {
+      h1->add(fBaseH1s[i]);
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::EndRun()
+{
+  // All snapshots are durable here: the workers have finished and the
+  // asynchronous writer has drained its rings
+  if (fWriter.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(fStopMutex);
+      fStopRequested = true;
+    }
+    fStopCondition.notify_all();
+    fWriter.join();
+  }
+  if (fEnabled) {
+    PromoteDeferred();
+    Write();
+  }
+  fResuming = false;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Checkpoint::ThreadState* Checkpoint::GetState()
+{
+  if (fStateGeneration != fGeneration) {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fStates.push_back(std::make_unique<ThreadState>());
+    fState = fStates.back().get();
+    fState->lastSnapshot = std::chrono::steady_clock::now();
+    fStateGeneration = fGeneration;
+  }
+  return fState;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::EndOfEvent(G4int eventID)
+{
+  if (!fEnabled) return;
+
+  auto state = GetState();
+  state->pendingEvents.push_back(eventID);
+
+  // Snapshots are taken more often than checkpoints are written, so that a
+  // checkpoint lags the event loop by a fraction of the interval only
+  if (static_cast<G4int>(state->pendingEvents.size()) >= fEventsPerSnapshot
+      || std::chrono::steady_clock::now() - state->lastSnapshot >= fInterval / 4)
+  {
+    TakeSnapshot(state);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::EndOfThreadRun()
+{
+  if (!fEnabled) return;
+
+  auto state = GetState();
+  if (!state->pendingEvents.empty()) TakeSnapshot(state);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::TakeSnapshot(ThreadState* state)
+{
+  // Copying the thread histograms and handing over a marker is all the
+  // event loop pays; the file is written by the checkpoint thread
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->state = state;
+  snapshot->events.swap(state->pendingEvents);
+
+  auto analysisManager = G4AnalysisManager::Instance();
+  for (G4int i = 0; i < fNofH1s; ++i) {
+    if (auto h1 = analysisManager->GetH1(i, false, false)) snapshot->h1s.push_back(*h1);
+  }
+  state->lastSnapshot = std::chrono::steady_clock::now();
+
+  auto asyncWriter = AsyncWriter::Instance();
+  if (asyncWriter->IsRunning()) {
+    asyncWriter->PushMarker([this, snapshot]() { Promote(*snapshot); });
+  }
+  else {
+    // The rows are appended by the checkpoint thread, the event loop does
+    // not wait for the column files
+    auto append = ColumnOutput::Instance()->DetachThread();
+    std::lock_guard<std::mutex> lock(fMutex);
+    fDeferred.push_back([this, append, snapshot]() {
+      append();
+      Promote(*snapshot);
+    });
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::Promote(Snapshot& snapshot)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  for (auto eventID : snapshot.events) {
+    auto index = static_cast<std::int64_t>(eventID) - fEventOffset;
+    auto bit = std::uint64_t(1) << (index & 63);
+    if (!(fCompleted[index >> 6].fetch_or(bit, std::memory_order_relaxed) & bit)) {
+      ++fNofCompleted;
+    }
+  }
+  snapshot.state->durableH1s = std::move(snapshot.h1s);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::PromoteDeferred()
+{
+  std::vector<std::function<void()>> deferred;
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    deferred.swap(fDeferred);
+  }
+  for (const auto& promote : deferred) {
+    promote();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::CheckpointLoop()
+{
+  std::unique_lock<std::mutex> lock(fStopMutex);
+  while (!fStopCondition.wait_for(lock, fInterval, [this]() { return fStopRequested; })) {
+    lock.unlock();
+    PromoteDeferred();
+    Write();
+    lock.lock();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Checkpoint::Write()
+{
+  // Copy the durable state; the row counts are read afterwards, so they
+  // cover the rows of every event marked completed
+  std::vector<std::uint64_t> words(fNofWords);
+  std::vector<H1> h1s;
+  if (fResuming) h1s = fBaseH1s;
+  std::uint64_t nofCompleted = 0;
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    for (std::size_t i = 0; i < fNofWords; ++i) {
+      words[i] = fCompleted[i].load(std::memory_order_relaxed);
+    }
+    nofCompleted = fNofCompleted;
+    for (const auto& state : fStates) {
+      for (std::size_t i = 0; i < state->durableH1s.size(); ++i) {
+        if (i < h1s.size()) {
+          h1s[i].add(state->durableH1s[i]);
+        }
+        else {
+          h1s.push_back(state->durableH1s[i]);
+        }
+      }
+    }
+  }
+
+  auto columns = ColumnOutput::Instance();
+  std::vector<std::uint64_t> rows(columns->GetNofTables(), 0);
+  if (columns->IsOpen()) {
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+      rows[i] = columns->GetNofRows(static_cast<G4int>(i));
+    }
+  }
+
+  auto sharding = Sharding::Instance();
+  FileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.masterSeed = sharding->GetMasterSeed();
+  header.shardIndex = sharding->GetShardIndex();
+  header.nofShards = sharding->GetNofShards();
+  header.runID = fRunID;
+  header.nofEvents = fNofEvents;
+  header.nofCompleted = nofCompleted;
+  header.nofTables = static_cast<std::uint32_t>(rows.size());
+  header.nofH1s = static_cast<std::uint32_t>(h1s.size());
+
+  // Written aside and renamed, a preemption never leaves a partial file
+  auto tmpName = fFileName + ".tmp";
+  auto file = std::fopen(tmpName.c_str(), "wb");
+  if (!file) {
+    G4ExceptionDescription msg;
+    msg << "Cannot write checkpoint file " << tmpName;
+    G4Exception("Checkpoint::Write()", "MyCode0010", JustWarning, msg);
+    return;
+  }
+  std::fwrite(&header, sizeof(header), 1, file);
+  std::fwrite(rows.data(), sizeof(std::uint64_t), rows.size(), file);
+  for (const auto& h1 : h1s) {
+    std::ostringstream stream;
+    tools::wcsv::hto(stream, H1::s_class(), h1);
+    auto text = stream.str();
+    std::uint64_t length = text.size();
+    std::fwrite(&length, sizeof(length), 1, file);
+    std::fwrite(text.data(), 1, length, file);
+  }
+  std::fwrite(words.data(), sizeof(std::uint64_t), words.size(), file);
+  std::fflush(file);
+  fsync(fileno(file));
+  std::fclose(file);
+  std::rename(tmpName.c_str(), fFileName.c_str());
+
+  G4cout << "Checkpoint: " << nofCompleted << " of " << fNofEvents << " events saved to "
+         << fFileName << G4endl;
+}
@@ -0,0 +1,347 @@
+#include "ColumnOutput.hh"
+
+#include "G4AutoLock.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <utility>
+
+namespace
+{
+G4Mutex columnMutex = G4MUTEX_INITIALIZER;
+}  // namespace
+
+G4ThreadLocal std::vector<ColumnOutput::Block>* ColumnOutput::fBlocks = nullptr;
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ColumnOutput* ColumnOutput::Instance()
+{
+  static ColumnOutput instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int ColumnOutput::CreateTable(const G4String& name)
+{
+  G4AutoLock lock(&columnMutex);
+  for (std::size_t i = 0; i < fTables.size(); ++i) {
+    if (fTables[i].name == name) return static_cast<G4int>(i);
+  }
+  fTables.push_back(Table{name, {}, 0, 0});
+  return static_cast<G4int>(fTables.size()) - 1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int ColumnOutput::CreateIColumn(G4int tableID, const G4String& name)
+{
+  return CreateColumn(tableID, name, Type::Int32);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int ColumnOutput::CreateDColumn(G4int tableID, const G4String& name)
+{
+  return CreateColumn(tableID, name, Type::Float64);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int ColumnOutput::CreateColumn(G4int tableID, const G4String& name, Type type)
+{
+  G4AutoLock lock(&columnMutex);
+  auto& table = fTables.at(tableID);
+  for (std::size_t i = 0; i < table.columns.size(); ++i) {
+    if (table.columns[i].name == name) return static_cast<G4int>(i);
+  }
+
+  Column column{name, type, table.rowSize, nullptr};
+  table.rowSize += (type == Type::Int32) ? sizeof(std::int32_t) : sizeof(double);
+  table.columns.push_back(column);
+  return static_cast<G4int>(table.columns.size()) - 1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::Open(const G4String& directory)
+{
+  const std::uint16_t probe = 1;
+  if (*reinterpret_cast<const char*>(&probe) != 1) {
+    G4Exception("ColumnOutput::Open()", "MyCode0007", FatalException,
+                "Columnar output is only supported on little-endian hosts.");
+    return;
+  }
+
+  G4AutoLock lock(&columnMutex);
+  fDirectory = directory;
+  std::error_code error;
+  std::filesystem::create_directories(directory.c_str(), error);
+
+  for (auto& table : fTables) {
+    table.nofRows = 0;
+    for (auto& column : table.columns) {
+      auto fileName = directory + "/" + table.name + "." + column.name + ".bin";
+      column.file = std::fopen(fileName.c_str(), "wb");
+      if (!column.file) {
+        G4ExceptionDescription msg;
+        msg << "Cannot open column file " << fileName;
+        G4Exception("ColumnOutput::Open()", "MyCode0007", FatalException, msg);
+        return;
+      }
+    }
+  }
+  fBytesWritten = 0;
+  fOpen.store(true, std::memory_order_release);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::Resume(const G4String& directory, const std::vector<std::uint64_t>& nofRows,
+                          const std::function<G4bool(G4int)>& keepEvent)
+{
+  G4AutoLock lock(&columnMutex);
+  if (nofRows.size() != fTables.size()) {
+    G4Exception("ColumnOutput::Resume()", "MyCode0007", FatalException,
+                "The checkpoint does not match the booked column tables.");
+    return;
+  }
+
+  fDirectory = directory;
+  for (std::size_t i = 0; i < fTables.size(); ++i) {
+    auto& table = fTables[i];
+    table.nofRows = Compact(table, nofRows[i], keepEvent);
+    for (auto& column : table.columns) {
+      auto fileName = directory + "/" + table.name + "." + column.name + ".bin";
+      column.file = std::fopen(fileName.c_str(), "ab");
+      if (!column.file) {
+        G4ExceptionDescription msg;
+        msg << "Cannot reopen column file " << fileName;
+        G4Exception("ColumnOutput::Resume()", "MyCode0007", FatalException, msg);
+        return;
+      }
+    }
+    G4cout << "Columnar output: " << table.nofRows << " rows of " << table.name << " resumed"
+           << G4endl;
+  }
+  fBytesWritten = 0;
+  fOpen.store(true, std::memory_order_release);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::uint64_t ColumnOutput::Compact(Table& table, std::uint64_t nofRows,
+                                    const std::function<G4bool(G4int)>& keepEvent) const
+{
+  // Rows of events that were not complete at the checkpoint may have been
+  // appended by other threads in between, they are squeezed out in place
+  auto path = [&](const Column& column) {
+    return fDirectory + "/" + table.name + "." + column.name + ".bin";
+  };
+
+  std::vector<char> keep(nofRows, 0);
+  std::uint64_t nofKept = 0;
+  if (auto file = std::fopen(path(table.columns.at(0)).c_str(), "rb")) {
+    std::vector<std::int32_t> eventIDs(1 << 16);
+    std::uint64_t row = 0;
+    while (row < nofRows) {
+      auto count = std::fread(eventIDs.data(), sizeof(std::int32_t),
+                              std::min<std::uint64_t>(eventIDs.size(), nofRows - row), file);
+      if (count == 0) break;
+      for (std::size_t i = 0; i < count; ++i, ++row) {
+        keep[row] = keepEvent(eventIDs[i]);
+        nofKept += keep[row];
+      }
+    }
+    std::fclose(file);
+  }
+
+  for (const auto& column : table.columns) {
+    auto size = (column.type == Type::Int32) ? sizeof(std::int32_t) : sizeof(double);
+    auto file = std::fopen(path(column).c_str(), "r+b");
+    if (!file) continue;
+
+    std::vector<char> buffer(size << 16);
+    std::uint64_t read = 0;
+    std::uint64_t written = 0;
+    while (read < nofRows) {
+      auto count = std::min<std::uint64_t>(1 << 16, nofRows - read);
+      std::fseek(file, static_cast<long>(read * size), SEEK_SET);
+      count = std::fread(buffer.data(), size, count, file);
+      if (count == 0) break;
+      std::size_t nofPacked = 0;
+      for (std::size_t i = 0; i < count; ++i) {
+        if (keep[read + i]) {
+          std::memmove(buffer.data() + nofPacked * size, buffer.data() + i * size, size);
+          ++nofPacked;
+        }
+      }
+      std::fseek(file, static_cast<long>(written * size), SEEK_SET);
+      std::fwrite(buffer.data(), size, nofPacked, file);
+      read += count;
+      written += nofPacked;
+    }
+    std::fclose(file);
+
+    std::error_code error;
+    std::filesystem::resize_file(path(column).c_str(), written * size, error);
+  }
+  return nofKept;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::uint64_t ColumnOutput::GetNofRows(G4int tableID) const
+{
+  G4AutoLock lock(&columnMutex);
+  return fTables.at(tableID).nofRows;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::Close()
+{
+  if (!IsOpen()) return;
+  FlushThread();
+
+  G4AutoLock lock(&columnMutex);
+  fOpen.store(false, std::memory_order_release);
+  for (auto& table : fTables) {
+    for (auto& column : table.columns) {
+      std::fclose(column.file);
+      column.file = nullptr;
+    }
+    WriteHeader(table);
+  }
+
+  G4cout << "Columnar output: " << fBytesWritten.load() << " bytes written to " << fDirectory
+         << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ColumnOutput::Block& ColumnOutput::GetBlock(G4int tableID)
+{
+  if (!fBlocks) fBlocks = new std::vector<Block>;
+
+  if (static_cast<std::size_t>(tableID) >= fBlocks->size()) {
+    fBlocks->resize(fTables.size());
+  }
+  auto& block = (*fBlocks)[tableID];
+  if (block.columns.empty()) {
+    const auto& table = fTables[tableID];
+    block.row.assign(table.rowSize, 0);
+    block.columns.resize(table.columns.size());
+    for (std::size_t i = 0; i < table.columns.size(); ++i) {
+      auto size = (table.columns[i].type == Type::Int32) ? sizeof(std::int32_t) : sizeof(double);
+      block.columns[i].reserve(fBlockRows * size);
+    }
+  }
+  return block;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::FillIColumn(G4int tableID, G4int column, G4int value)
+{
+  auto& block = GetBlock(tableID);
+  std::int32_t data = value;
+  std::memcpy(block.row.data() + fTables[tableID].columns[column].offset, &data, sizeof(data));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::FillDColumn(G4int tableID, G4int column, G4double value)
+{
+  auto& block = GetBlock(tableID);
+  std::memcpy(block.row.data() + fTables[tableID].columns[column].offset, &value, sizeof(value));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::AddRow(G4int tableID)
+{
+  auto& block = GetBlock(tableID);
+  const auto& table = fTables[tableID];
+  for (std::size_t i = 0; i < table.columns.size(); ++i) {
+    const auto& column = table.columns[i];
+    auto size = (column.type == Type::Int32) ? sizeof(std::int32_t) : sizeof(double);
+    auto first = block.row.begin() + column.offset;
+    block.columns[i].insert(block.columns[i].end(), first, first + size);
+  }
+  if (++block.nofRows >= fBlockRows) Append(tableID, block);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::FlushThread()
+{
+  if (!fBlocks) return;
+  for (std::size_t i = 0; i < fBlocks->size(); ++i) {
+    if ((*fBlocks)[i].nofRows > 0) Append(static_cast<G4int>(i), (*fBlocks)[i]);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::function<void()> ColumnOutput::DetachThread()
+{
+  // The staged columns are moved out; GetBlock sets up empty ones again
+  auto detached = std::make_shared<std::vector<std::pair<G4int, Block>>>();
+  if (fBlocks) {
+    for (std::size_t i = 0; i < fBlocks->size(); ++i) {
+      auto& block = (*fBlocks)[i];
+      if (block.nofRows == 0) continue;
+      detached->emplace_back(static_cast<G4int>(i), std::move(block));
+      block = Block();
+    }
+  }
+  return [this, detached]() {
+    for (auto& [tableID, block] : *detached) {
+      Append(tableID, block);
+    }
+  };
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::Append(G4int tableID, Block& block)
+{
+  // All columns of a block are written under one lock, which keeps the
+  // rows of the different column files aligned
+  G4AutoLock lock(&columnMutex);
+  auto& table = fTables[tableID];
+  if (IsOpen()) {
+    for (std::size_t i = 0; i < table.columns.size(); ++i) {
+      std::fwrite(block.columns[i].data(), 1, block.columns[i].size(), table.columns[i].file);
+      fBytesWritten += block.columns[i].size();
+    }
+    table.nofRows += block.nofRows;
+  }
+  lock.unlock();
+
+  for (auto& column : block.columns) {
+    column.clear();
+  }
+  block.nofRows = 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ColumnOutput::WriteHeader(const Table& table) const
+{
+  std::ofstream header(fDirectory + "/" + table.name + ".json");
+  header << "{\n  \"table\": \"" << table.name << "\",\n  \"rows\": " << table.nofRows
+         << ",\n  \"columns\": [";
+  for (std::size_t i = 0; i < table.columns.size(); ++i) {
+    const auto& column = table.columns[i];
+    header << (i ? "," : "") << "\n    {\"name\": \"" << column.name << "\", \"dtype\": \""
+           << (column.type == Type::Int32 ? "<i4" : "<f8") << "\", \"file\": \"" << table.name
+           << "." << column.name << ".bin\"}";
+  }
+  header << "\n  ]\n}\n";
+}
@@ -0,0 +1,127 @@
+#include "CrystalFastModel.hh"
+
+#include "G4DynamicParticle.hh"
+#include "G4Electron.hh"
+#include "G4FastSimulationManager.hh"
+#include "G4FastStep.hh"
+#include "G4FastTrack.hh"
+#include "G4Gamma.hh"
+#include "G4GenericMessenger.hh"
+#include "G4Material.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4Positron.hh"
+#include "G4RandomDirection.hh"
+#include "G4Region.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Track.hh"
+#include "Randomize.hh"
+
+#include <cmath>
+
+namespace
+{
+// Practical range of electrons (Katz-Penfold), as a mass thickness
+G4double ElectronRange(G4double energy)
+{
+  auto e = energy / MeV;
+  if (e < 0.01) return 0.;
+  if (e > 2.5) return (530. * e - 106.) * mg / cm2;
+  return 412. * std::pow(e, 1.265 - 0.0954 * std::log(e)) * mg / cm2;
+}
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+CrystalFastModel::CrystalFastModel(const G4String& name) : G4VFastSimulationModel(name)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+CrystalFastModel::~CrystalFastModel()
+{
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void CrystalFastModel::AddEnvelope(G4Region* region)
+{
+  auto manager = region->GetFastSimulationManager();
+  if (!manager) manager = new G4FastSimulationManager(region);
+  manager->AddFastSimulationModel(this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool CrystalFastModel::IsApplicable(const G4ParticleDefinition& particle)
+{
+  return &particle == G4Electron::Definition() || &particle == G4Positron::Definition();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool CrystalFastModel::ModelTrigger(const G4FastTrack&)
+{
+  return fEnabled;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void CrystalFastModel::DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep)
+{
+  auto track = fastTrack.GetPrimaryTrack();
+  auto energy = track->GetKineticEnergy();
+  auto position = fastTrack.GetPrimaryTrackLocalPosition();
+  auto direction = fastTrack.GetPrimaryTrackLocalDirection();
+
+  // Centroid of the deposits: along the direction, spread around it
+  auto range = ElectronRange(energy) / track->GetMaterial()->GetDensity();
+  if (range > 0.) {
+    auto lateral = direction.orthogonal().unit();
+    lateral.rotate(direction, twopi * G4UniformRand());
+    auto deposit = position + fDepthFraction * range * direction
+                   + G4RandGauss::shoot(0., fLateralFraction * range) * lateral;
+    // Left where it starts when the point falls outside the crystal
+    if (fastTrack.GetEnvelopeSolid()->Inside(deposit) != kOutside) position = deposit;
+  }
+
+  fastStep.KillPrimaryTrack();
+  fastStep.ProposePrimaryTrackFinalPosition(position);
+  fastStep.ProposeTotalEnergyDeposited(energy);
+
+  // Annihilation at rest
+  if (track->GetDefinition() == G4Positron::Definition()) {
+    auto gammaDirection = G4RandomDirection();
+    fastStep.SetNumberOfSecondaryTracks(2);
+    for (auto sign : {1., -1.}) {
+      G4DynamicParticle gamma(G4Gamma::Definition(), sign * gammaDirection, electron_mass_c2);
+      fastStep.CreateSecondaryTrack(gamma, position, track->GetGlobalTime());
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void CrystalFastModel::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/fast/", "Fast simulation of the crystals");
+
+  auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+    "Parameterise the electrons and positrons in the Scatter and Absorber\n"
+    "instead of transporting them (false: full simulation, still paying for\n"
+    "the fast simulation process; run without --fastSim to avoid it).");
+  enableCmd.SetParameterName("flag", true);
+  enableCmd.SetDefaultValue("true");
+
+  auto& depthCmd = fMessenger->DeclareProperty("depthFraction", fDepthFraction,
+    "Distance of the deposit along the electron direction, in electron ranges.");
+  depthCmd.SetParameterName("fraction", false);
+  depthCmd.SetRange("fraction>=0. && fraction<=1.");
+
+  auto& lateralCmd = fMessenger->DeclareProperty("lateralFraction", fLateralFraction,
+    "Gaussian lateral spread (sigma) of the deposit, in electron ranges.");
+  lateralCmd.SetParameterName("fraction", false);
+  lateralCmd.SetRange("fraction>=0. && fraction<=1.");
+}
@@ -1,10 +1,14 @@
 #include "DetectorConstruction.hh"
 
+#include "CrystalFastModel.hh"
+#include "PixelSD.hh"
+#include "Startup.hh"
 #include "TrackerSD.hh"
 
 #include "G4AutoDelete.hh"
 #include "G4Box.hh"
 #include "G4Colour.hh"
+#include "G4GenericMessenger.hh"
 #include "G4GlobalMagFieldMessenger.hh"
 #include "G4LogicalVolume.hh"
 #include "G4Material.hh"
@@ -12,17 +16,43 @@
 #include "G4PVPlacement.hh"
 #include "G4PVReplica.hh"
 #include "G4PhysicalConstants.hh"
+#include "G4ProductionCuts.hh"
+#include "G4Region.hh"
+#include "G4RegionStore.hh"
+#include "G4RunManagerKernel.hh"
 #include "G4SDManager.hh"
 #include "G4SystemOfUnits.hh"
+#include "G4VUserPhysicsList.hh"
 #include "G4VisAttributes.hh"
 
+#include <algorithm>
+#include <cmath>
+
+DetectorConstruction::DetectorConstruction()
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+DetectorConstruction::~DetectorConstruction()
+{
+  delete fMessenger;
+  delete fCameraMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 G4VPhysicalVolume* DetectorConstruction::Construct()
 {
   // Define materials
   DefineMaterials();
 
   // Define volumes
-  return DefineVolumes();
+  auto worldPV = DefineVolumes();
+  Startup::Instance()->GeometryDone();
+
+  return worldPV;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -50,8 +80,7 @@ void DetectorConstruction::DefineMaterials()
   PMMA->AddElement(H, 8);
   PMMA->AddElement(O, 2);
 
-  // Print materials
-  G4cout << *(G4Material::GetMaterialTable()) << G4endl;
+  // The material table is printed on request with /material/g4/printMaterial all
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -144,6 +173,11 @@ G4VPhysicalVolume* DetectorConstruction::DefineVolumes()
                     0,  // copy number
                     fCheckOverlaps);  // checking overlaps
 
+  if (fAbsoPitch > 0.) {
+    fAbsoPixels = Pixelate(absorberLV, "Abso", absoSizeXY, absoThickness, fAbsoPitch,
+                           G4ThreeVector(0., 0., absoPosiZ));
+  }
+
   //
   // Scatter
   //
@@ -163,6 +197,13 @@ G4VPhysicalVolume* DetectorConstruction::DefineVolumes()
                     0,  // copy number
                     fCheckOverlaps);  // checking overlaps
 
+  if (fScatPitch > 0.) {
+    fScatPixels = Pixelate(scatterLV, "Scat", scatSizeXY, scatThickness, fScatPitch,
+                           G4ThreeVector(0., 0., 0.));
+  }
+
+  DefineRegions(targetLV, scatterLV, absorberLV);
+
   //
   // print parameters
   //
@@ -185,6 +226,142 @@ G4VPhysicalVolume* DetectorConstruction::DefineVolumes()
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+DetectorConstruction::PixelLayer DetectorConstruction::Pixelate(G4LogicalVolume* layerLV,
+  const G4String& name, G4double sizeXY, G4double thickness, G4double pitch,
+  const G4ThreeVector& center)
+{
+  // A whole number of pixels per side, the pitch is adjusted to the layer size
+  PixelLayer layer;
+  layer.nofPixels = std::max(1, static_cast<G4int>(std::lround(sizeXY / pitch)));
+  layer.pitch = sizeXY / layer.nofPixels;
+  layer.firstPixel =
+    center + G4ThreeVector(-sizeXY / 2 + layer.pitch / 2, -sizeXY / 2 + layer.pitch / 2, 0.);
+
+  // Rows replicated along Y in the layer, pixels along X in a row
+  auto material = layerLV->GetMaterial();
+  auto rowS = new G4Box(name + "Row", sizeXY / 2, layer.pitch / 2, thickness / 2);
+  auto rowLV = new G4LogicalVolume(rowS, material, name + "RowLV");
+  new G4PVReplica(name + "Row", rowLV, layerLV, kYAxis, layer.nofPixels, layer.pitch);
+
+  auto pixelS = new G4Box(name + "Pixel", layer.pitch / 2, layer.pitch / 2, thickness / 2);
+  layer.pixelLV = new G4LogicalVolume(pixelS, material, name + "PixelLV");
+  new G4PVReplica(name + "Pixel", layer.pixelLV, rowLV, kXAxis, layer.nofPixels, layer.pitch);
+
+  G4cout << name << ": " << layer.nofPixels << " x " << layer.nofPixels << " pixels of "
+         << layer.pitch / mm << " mm" << G4endl;
+
+  return layer;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::DefineRegions(G4LogicalVolume* targetLV, G4LogicalVolume* scatterLV,
+                                         G4LogicalVolume* absorberLV)
+{
+  // Regions without a cut of their own share the default production cuts.
+  // A rebuilt geometry reuses the regions of the first one: the deleted
+  // volumes have already removed themselves from them
+  auto addRegion = [](const G4String& name, G4LogicalVolume* rootLV) {
+    auto region = G4RegionStore::GetInstance()->GetRegion(name, false);
+    if (!region) region = new G4Region(name);
+    region->AddRootLogicalVolume(rootLV);
+  };
+  addRegion("Target", targetLV);
+  addRegion("Scatter", scatterLV);
+  addRegion("Absorber", absorberLV);
+
+  for (const auto& regionCut : fRegionCuts) {
+    ApplyRegionCut(regionCut.first);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetRegionCut(const G4String& regionName, G4double cut)
+{
+  // Before /run/initialize the cut is applied when the region is built,
+  // afterwards it takes effect at the next run
+  fRegionCuts[regionName] = cut;
+  ApplyRegionCut(regionName);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::ApplyRegionCut(const G4String& regionName)
+{
+  auto region = G4RegionStore::GetInstance()->GetRegion(regionName, false);
+  if (!region) return;
+
+  auto& cuts = fProductionCuts[regionName];
+  if (!cuts) {
+    cuts = new G4ProductionCuts;
+    region->SetProductionCuts(cuts);
+  }
+  cuts->SetProductionCut(fRegionCuts[regionName]);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetWorldCut(G4double cut)
+{
+  // Same as /run/setCut
+  auto physicsList = G4RunManagerKernel::GetRunManagerKernel()->GetPhysicsList();
+  if (physicsList) physicsList->SetDefaultCutValue(cut);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::DefineCommands()
+{
+  // The geometry is built by the master only, so the commands are not
+  // broadcast to the worker threads
+  fMessenger = new G4GenericMessenger(this, "/B4c/cuts/", "Production cuts per region");
+
+  auto& targetCmd = fMessenger->DeclareMethodWithUnit("Target", "mm",
+    &DetectorConstruction::SetTargetCut, "Production cut in the Target region.");
+  targetCmd.SetParameterName("cut", false);
+  targetCmd.SetRange("cut>0.");
+  targetCmd.SetToBeBroadcasted(false);
+
+  auto& scatterCmd = fMessenger->DeclareMethodWithUnit("Scatter", "mm",
+    &DetectorConstruction::SetScatterCut, "Production cut in the Scatter region.");
+  scatterCmd.SetParameterName("cut", false);
+  scatterCmd.SetRange("cut>0.");
+  scatterCmd.SetToBeBroadcasted(false);
+
+  auto& absorberCmd = fMessenger->DeclareMethodWithUnit("Absorber", "mm",
+    &DetectorConstruction::SetAbsorberCut, "Production cut in the Absorber region.");
+  absorberCmd.SetParameterName("cut", false);
+  absorberCmd.SetRange("cut>0.");
+  absorberCmd.SetToBeBroadcasted(false);
+
+  auto& worldCmd = fMessenger->DeclareMethodWithUnit("World", "mm",
+    &DetectorConstruction::SetWorldCut,
+    "Default production cut, used in the World and in the regions without\n"
+    "a cut of their own (same as /run/setCut).");
+  worldCmd.SetParameterName("cut", false);
+  worldCmd.SetRange("cut>0.");
+  worldCmd.SetToBeBroadcasted(false);
+
+  fCameraMessenger = new G4GenericMessenger(this, "/B4c/camera/", "Camera segmentation");
+
+  auto& scatPitchCmd = fCameraMessenger->DeclarePropertyWithUnit("scatPitch", "mm", fScatPitch,
+    "Pixel pitch of the scatter, rounded to a whole number of pixels per side;\n"
+    "0 for a monolithic layer. Set before /run/initialize.");
+  scatPitchCmd.SetParameterName("pitch", false);
+  scatPitchCmd.SetRange("pitch>=0.");
+  scatPitchCmd.SetToBeBroadcasted(false);
+
+  auto& absoPitchCmd = fCameraMessenger->DeclarePropertyWithUnit("absoPitch", "mm", fAbsoPitch,
+    "Pixel pitch of the absorber, rounded to a whole number of pixels per side;\n"
+    "0 for a monolithic layer. Set before /run/initialize.");
+  absoPitchCmd.SetParameterName("pitch", false);
+  absoPitchCmd.SetRange("pitch>=0.");
+  absoPitchCmd.SetToBeBroadcasted(false);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 void DetectorConstruction::ConstructSDandField()
 {
   // G4SDManager::GetSDMpointer()->SetVerboseLevel(1);
@@ -192,10 +369,45 @@ void DetectorConstruction::ConstructSDandField()
   //
   // Sensitive detectors
   //
-  auto absoSD = new TrackerSD("AbsorberSD", "AbsorberHitsCollection");
-  auto scatSD = new TrackerSD("ScatterSD", "ScatterHitsCollection");
-  G4SDManager::GetSDMpointer()->AddNewDetector(absoSD);
-  G4SDManager::GetSDMpointer()->AddNewDetector(scatSD);
-  SetSensitiveDetector("AbsoLV", absoSD);
-  SetSensitiveDetector("ScatLV", scatSD);
+  // Pixelated layers share one PixelSD, read directly by EventAction;
+  // monolithic ones have their TrackerSD and hits collection
+  auto sdManager = G4SDManager::GetSDMpointer();
+  PixelSD* pixelSD = nullptr;
+  if (fAbsoPixels.pixelLV || fScatPixels.pixelLV) pixelSD = new PixelSD("PixelSD");
+
+  if (fAbsoPixels.pixelLV) {
+    pixelSD->AddLayer(1, fAbsoPixels.pixelLV, fAbsoPixels.nofPixels, fAbsoPixels.pitch,
+                      fAbsoPixels.firstPixel);
+  }
+  else {
+    auto absoSD = new TrackerSD("AbsorberSD", "AbsorberHitsCollection");
+    sdManager->AddNewDetector(absoSD);
+    SetSensitiveDetector("AbsoLV", absoSD);
+  }
+
+  if (fScatPixels.pixelLV) {
+    pixelSD->AddLayer(0, fScatPixels.pixelLV, fScatPixels.nofPixels, fScatPixels.pitch,
+                      fScatPixels.firstPixel);
+  }
+  else {
+    auto scatSD = new TrackerSD("ScatterSD", "ScatterHitsCollection");
+    sdManager->AddNewDetector(scatSD);
+    SetSensitiveDetector("ScatLV", scatSD);
+  }
+
+  if (pixelSD) {
+    sdManager->AddNewDetector(pixelSD);
+    if (fAbsoPixels.pixelLV) SetSensitiveDetector(fAbsoPixels.pixelLV, pixelSD);
+    if (fScatPixels.pixelLV) SetSensitiveDetector(fScatPixels.pixelLV, pixelSD);
+  }
+
+  //
+  // Fast simulation of the crystals, with --fastSim only
+  //
+  if (!fFastSimulation) return;
+  auto fastModel = new CrystalFastModel("CrystalFastModel");
+  auto regionStore = G4RegionStore::GetInstance();
+  fastModel->AddEnvelope(regionStore->GetRegion("Scatter"));
+  fastModel->AddEnvelope(regionStore->GetRegion("Absorber"));
+  G4AutoDelete::Register(fastModel);
 }
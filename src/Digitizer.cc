@@ -0,0 +1,171 @@
+#include "Digitizer.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iomanip>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Digitizer* Digitizer::Instance()
+{
+  static Digitizer instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Digitizer::Digitizer() : fEnergyMax(DBL_MAX)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Digitizer::~Digitizer()
+{
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double Digitizer::Smear(Detector detector, G4double edep) const
+{
+  // Without resolution no random number is drawn, runs stay reproducible
+  auto resolution = fResolution[detector];
+  if (resolution <= 0.) return edep;
+
+  auto sigma = resolution / 2.355 * std::sqrt(edep * 662. * keV);
+  return std::max(G4RandGauss::shoot(edep, sigma), 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool Digitizer::Accept(G4double scatEnergy, G4double absoEnergy, G4bool mixedWeights)
+{
+  auto& counters = fCounters.Local();
+  ++counters.candidates;
+
+  auto reject = [&counters](Cut cut) {
+    ++counters.rejected[cut];
+    return false;
+  };
+
+  // Hits of histories weighted differently have no common weight
+  if (mixedWeights) return reject(kMixedWeights);
+  if (scatEnergy < fThreshold[kScatter]) return reject(kScatThreshold);
+  if (absoEnergy < fThreshold[kAbsorber]) return reject(kAbsoThreshold);
+
+  auto total = scatEnergy + absoEnergy;
+  if (total < fEnergyMin || total > fEnergyMax) return reject(kEnergyWindow);
+
+  // Compton scattering in the scatter, full absorption of the scattered
+  // gamma: cos(theta) = 1 - m_e c^2 (1/E_abso - 1/E_total) >= -1
+  if (fKinematics) {
+    if (absoEnergy <= 0.) return reject(kKinematics);
+    auto cosTheta = 1. - electron_mass_c2 * (1. / absoEnergy - 1. / total);
+    if (cosTheta < -1.) return reject(kKinematics);
+  }
+
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool Digitizer::IsActive() const
+{
+  return fResolution[kScatter] > 0. || fResolution[kAbsorber] > 0. || fThreshold[kScatter] > 0.
+         || fThreshold[kAbsorber] > 0. || fEnergyMin > 0. || fEnergyMax < DBL_MAX || fKinematics;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::EndRun(std::size_t bytesPerRow)
+{
+  // The threads have finished the run; the counters start again at zero
+  Counters total;
+  fCounters.ForEach([&total](Counters& counters) {
+    total.candidates += counters.candidates;
+    for (G4int cut = 0; cut < kNofCuts; ++cut) {
+      total.rejected[cut] += counters.rejected[cut];
+    }
+    counters = Counters();
+  });
+  if ((!IsActive() && total.rejected[kMixedWeights] == 0) || total.candidates == 0) return;
+
+  static const char* names[kNofCuts] = {"mixedWeights", "scatThreshold", "absoThreshold",
+                                        "energyWindow", "comptonCheck"};
+  auto percent = [&total](std::uint64_t n) { return 100. * n / total.candidates; };
+
+  G4cout << G4endl << "--------------------Digitizer-------------------------------" << G4endl
+         << " " << total.candidates << " coincidences" << G4endl << std::setw(16) << "cut"
+         << std::setw(14) << "rejected" << std::setw(10) << "%" << std::setw(14) << "MB saved"
+         << G4endl;
+  auto remaining = total.candidates;
+  for (G4int cut = 0; cut < kNofCuts; ++cut) {
+    auto rejected = total.rejected[cut];
+    remaining -= rejected;
+    G4cout << std::setw(16) << names[cut] << std::setw(14) << rejected << std::setw(10)
+           << std::setprecision(3) << percent(rejected) << std::setw(14) << std::setprecision(4)
+           << rejected * bytesPerRow / 1e6 << G4endl;
+  }
+  G4cout << std::setw(16) << "accepted" << std::setw(14) << remaining << std::setw(10)
+         << std::setprecision(3) << percent(remaining) << std::setprecision(6) << G4endl
+         << "------------------------------------------------------------" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/digi/", "Detector response and event selection");
+
+  auto& scatResolutionCmd = fMessenger->DeclareProperty("scatResolution", fResolution[kScatter],
+    "Energy resolution of the scatter, FWHM/E at 662 keV (e.g. 0.06 for GAGG);\n"
+    "0 keeps the deposited energy.");
+  scatResolutionCmd.SetParameterName("resolution", false);
+  scatResolutionCmd.SetRange("resolution>=0. && resolution<1.");
+  scatResolutionCmd.SetToBeBroadcasted(false);
+
+  auto& absoResolutionCmd = fMessenger->DeclareProperty("absoResolution", fResolution[kAbsorber],
+    "Energy resolution of the absorber, FWHM/E at 662 keV (e.g. 0.03 for LaBr3);\n"
+    "0 keeps the deposited energy.");
+  absoResolutionCmd.SetParameterName("resolution", false);
+  absoResolutionCmd.SetRange("resolution>=0. && resolution<1.");
+  absoResolutionCmd.SetToBeBroadcasted(false);
+
+  auto& scatThresholdCmd = fMessenger->DeclarePropertyWithUnit("scatThreshold", "keV",
+    fThreshold[kScatter], "Minimum measured energy in the scatter of a coincidence.");
+  scatThresholdCmd.SetParameterName("threshold", false);
+  scatThresholdCmd.SetRange("threshold>=0.");
+  scatThresholdCmd.SetToBeBroadcasted(false);
+
+  auto& absoThresholdCmd = fMessenger->DeclarePropertyWithUnit("absoThreshold", "keV",
+    fThreshold[kAbsorber], "Minimum measured energy in the absorber of a coincidence.");
+  absoThresholdCmd.SetParameterName("threshold", false);
+  absoThresholdCmd.SetRange("threshold>=0.");
+  absoThresholdCmd.SetToBeBroadcasted(false);
+
+  auto& energyMinCmd = fMessenger->DeclarePropertyWithUnit("energyMin", "MeV", fEnergyMin,
+    "Lower edge of the total-energy window of a coincidence.");
+  energyMinCmd.SetParameterName("energy", false);
+  energyMinCmd.SetRange("energy>=0.");
+  energyMinCmd.SetToBeBroadcasted(false);
+
+  auto& energyMaxCmd = fMessenger->DeclarePropertyWithUnit("energyMax", "MeV", fEnergyMax,
+    "Upper edge of the total-energy window of a coincidence.");
+  energyMaxCmd.SetParameterName("energy", false);
+  energyMaxCmd.SetRange("energy>0.");
+  energyMaxCmd.SetToBeBroadcasted(false);
+
+  auto& kinematicsCmd = fMessenger->DeclareProperty("comptonCheck", fKinematics,
+    "Reject coincidences without a valid Compton scattering angle.");
+  kinematicsCmd.SetParameterName("flag", true);
+  kinematicsCmd.SetDefaultValue("true");
+  kinematicsCmd.SetToBeBroadcasted(false);
+}
@@ -0,0 +1,255 @@
+#include "EmissionMap.hh"
+
+#include "Sharding.hh"
+
+#include "G4Box.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4UnitsTable.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <new>
+
+namespace
+{
+constexpr std::align_val_t kCacheLine{64};
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EmissionMap::EmissionMap()
+  : G4VAccumulable("EmissionMap"),
+    fHalfWidth(0.2 * MeV),
+    fRequestedVoxelSize(1. * mm, 4. * mm, 4. * mm)
+{
+  // 12C* and 16O* de-excitation lines
+  AddLine(4.44 * MeV);
+  AddLine(6.13 * MeV);
+
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EmissionMap::~EmissionMap()
+{
+  if (fData) ::operator delete[](fData, kCacheLine);
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::SetBox(const G4ThreeVector& center, const G4ThreeVector& halfSize)
+{
+  if (!IsEnabled()) {
+    if (fData) ::operator delete[](fData, kCacheLine);
+    fData = nullptr;
+    fSize = 0;
+    return;
+  }
+
+  // Whole number of voxels per axis, the voxel size is adjusted to fit the box
+  fMin = center - halfSize;
+  auto nofBins = [](G4double length, G4double size) {
+    return std::max(1, static_cast<G4int>(std::lround(length / size)));
+  };
+  fNx = nofBins(2. * halfSize.x(), fRequestedVoxelSize.x());
+  fNy = nofBins(2. * halfSize.y(), fRequestedVoxelSize.y());
+  fNz = nofBins(2. * halfSize.z(), fRequestedVoxelSize.z());
+  fVoxelSize.set(2. * halfSize.x() / fNx, 2. * halfSize.y() / fNy, 2. * halfSize.z() / fNz);
+  fNofVoxels = static_cast<std::size_t>(fNx) * fNy * fNz;
+
+  Allocate();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::SetBoxFromTarget()
+{
+  auto targetPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("Target", false);
+  auto targetBox = targetPV ? dynamic_cast<G4Box*>(targetPV->GetLogicalVolume()->GetSolid())
+                            : nullptr;
+  if (!targetBox) {
+    G4Exception("EmissionMap::SetBoxFromTarget()", "MyCode0008", JustWarning,
+                "Target box not found, the emission map is disabled.");
+    fFileName.clear();
+    SetBox(G4ThreeVector(), G4ThreeVector());
+    return;
+  }
+
+  SetBox(targetPV->GetTranslation(),
+         G4ThreeVector(targetBox->GetXHalfLength(), targetBox->GetYHalfLength(),
+                       targetBox->GetZHalfLength()));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::Allocate()
+{
+  auto size = fLines.size() * fNofVoxels;
+  if (size != fSize) {
+    if (fData) ::operator delete[](fData, kCacheLine);
+    fData = size ? static_cast<G4double*>(::operator new[](size * sizeof(G4double), kCacheLine))
+                 : nullptr;
+    fSize = size;
+  }
+  Reset();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::Merge(const G4VAccumulable& other)
+{
+  const auto& otherMap = static_cast<const EmissionMap&>(other);
+  if (!fData || otherMap.fSize != fSize) return;
+
+  for (std::size_t i = 0; i < fSize; ++i) {
+    fData[i] += otherMap.fData[i];
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::Reset()
+{
+  if (fData) std::fill(fData, fData + fSize, 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EmissionMap::GetLineYield(std::size_t line) const
+{
+  if (!fData) return 0.;
+  auto first = fData + line * fNofVoxels;
+  G4double sum = 0.;
+  for (std::size_t i = 0; i < fNofVoxels; ++i) {
+    sum += first[i];
+  }
+  return sum;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::vector<G4double> EmissionMap::GetDepthProfile(std::size_t line) const
+{
+  std::vector<G4double> profile(fNx, 0.);
+  if (!fData) return profile;
+
+  // x is the slowest index, so every depth bin is one contiguous slab
+  std::size_t slab = static_cast<std::size_t>(fNy) * fNz;
+  auto first = fData + line * fNofVoxels;
+  for (G4int ix = 0; ix < fNx; ++ix) {
+    for (std::size_t i = 0; i < slab; ++i) {
+      profile[ix] += first[ix * slab + i];
+    }
+  }
+  return profile;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::Write() const
+{
+  if (!fData) return;
+
+  auto baseName = Sharding::Instance()->TagFileName(fFileName);
+
+  // Grid as raw little-endian float64 in [line][x][y][z] order
+  auto binName = baseName + ".bin";
+  auto file = std::fopen(binName.c_str(), "wb");
+  if (!file) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open emission map file " << binName;
+    G4Exception("EmissionMap::Write()", "MyCode0008", JustWarning, msg);
+    return;
+  }
+  std::fwrite(fData, sizeof(G4double), fSize, file);
+  std::fclose(file);
+
+  // Header in the style of the columnar output, coordinates in mm
+  std::ofstream header(baseName + ".json");
+  header << "{\n  \"file\": \"" << binName.substr(binName.rfind('/') + 1)
+         << "\",\n  \"dtype\": \"<f8\",\n  \"shape\": [" << fLines.size() << ", " << fNx << ", "
+         << fNy << ", " << fNz << "],\n  \"origin\": [" << fMin.x() / mm << ", " << fMin.y() / mm
+         << ", " << fMin.z() / mm << "],\n  \"voxel\": [" << fVoxelSize.x() / mm << ", "
+         << fVoxelSize.y() / mm << ", " << fVoxelSize.z() / mm << "],\n  \"lines\": [";
+  for (std::size_t line = 0; line < fLines.size(); ++line) {
+    header << (line ? "," : "") << "\n    {\"energy\": " << fLines[line].energy / MeV
+           << ", \"low\": " << fLines[line].low / MeV << ", \"high\": " << fLines[line].high / MeV
+           << "}";
+  }
+  header << "\n  ]\n}\n";
+
+  // Depth profile, one column per line
+  std::ofstream depth(baseName + "_depth.csv");
+  depth << "x_mm";
+  for (const auto& line : fLines) {
+    depth << ",E" << line.energy / MeV;
+  }
+  depth << "\n";
+  std::vector<std::vector<G4double>> profiles;
+  for (std::size_t line = 0; line < fLines.size(); ++line) {
+    profiles.push_back(GetDepthProfile(line));
+  }
+  for (G4int ix = 0; ix < fNx; ++ix) {
+    depth << (fMin.x() + (ix + 0.5) * fVoxelSize.x()) / mm;
+    for (const auto& profile : profiles) {
+      depth << "," << profile[ix];
+    }
+    depth << "\n";
+  }
+
+  G4cout << "Emission map: " << fNx << " x " << fNy << " x " << fNz << " voxels written to "
+         << binName << G4endl;
+  for (std::size_t line = 0; line < fLines.size(); ++line) {
+    G4cout << "   " << G4BestUnit(fLines[line].energy, "Energy")
+           << " line yield: " << GetLineYield(line) << G4endl;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::AddLine(G4double energy)
+{
+  fLines.push_back({energy, energy - fHalfWidth, energy + fHalfWidth});
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::ClearLines()
+{
+  fLines.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EmissionMap::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/emission/", "Prompt-gamma emission map");
+
+  auto& fileCmd = fMessenger->DeclareProperty("fileName", fFileName,
+    "Base name of the emission map output (<name>.bin, <name>.json and\n"
+    "<name>_depth.csv); empty disables the map.");
+  fileCmd.SetParameterName("name", true);
+  fileCmd.SetDefaultValue("");
+
+  fMessenger->DeclarePropertyWithUnit("voxelSize", "mm", fRequestedVoxelSize,
+    "Voxel size along x (beam), y and z; rounded to fit the Target box.");
+
+  auto& widthCmd = fMessenger->DeclarePropertyWithUnit("halfWidth", "MeV", fHalfWidth,
+    "Half width of the energy window of the lines added next.");
+  widthCmd.SetParameterName("width", false);
+  widthCmd.SetRange("width>0.");
+
+  auto& lineCmd = fMessenger->DeclareMethodWithUnit("addLine", "MeV", &EmissionMap::AddLine,
+    "Add a prompt-gamma line with the current halfWidth.");
+  lineCmd.SetParameterName("energy", false);
+
+  fMessenger->DeclareMethod("clearLines", &EmissionMap::ClearLines,
+    "Remove all prompt-gamma lines.");
+}
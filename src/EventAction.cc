@@ -1,18 +1,44 @@
 #include "EventAction.hh"
 
+#include "AdaptiveRun.hh"
+#include "AsyncWriter.hh"
+#include "Checkpoint.hh"
+#include "ColumnOutput.hh"
+#include "Digitizer.hh"
+#include "EmissionMap.hh"
+#include "EventInformation.hh"
+#include "OnlineImage.hh"
+#include "PhaseSpace.hh"
+#include "PixelSD.hh"
+#include "Startup.hh"
+#include "Telemetry.hh"
 #include "TrackerHit.hh"
 
 #include "G4AnalysisManager.hh"
 #include "G4Event.hh"
+#include "G4GenericMessenger.hh"
 #include "G4HCofThisEvent.hh"
 #include "G4RunManager.hh"
 #include "G4SDManager.hh"
 #include "G4UnitsTable.hh"
 
-#include <iomanip>
 #include <algorithm>
+#include <cfloat>
+#include <iomanip>
+#include <utility>
 
-EventAction::EventAction(RunAction* runAction) : fRunAction(runAction) {}
+EventAction::EventAction(RunAction* runAction)
+  : fCoincidenceWindow(DBL_MAX), fRunAction(runAction)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EventAction::~EventAction()
+{
+  delete fMessenger;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
@@ -44,89 +70,362 @@ void EventAction::PrintEventStatistics(G4double absoEdep, G4double absoTrackLeng
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-void EventAction::BeginOfEventAction(const G4Event* /*event*/) {}
+void EventAction::BeginOfEventAction(const G4Event* event)
+{
+  // Primaries are generated before, the spot of a plan is known
+  auto information = static_cast<const EventInformation*>(event->GetUserInformation());
+  fSpotID = information ? information->GetSpotID() : -1;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void EventAction::EndOfEventAction(const G4Event* event)
 {
-  // Get hits collections IDs (only once)
-  if (fScatHCID == -1) {
-    fScatHCID = G4SDManager::GetSDMpointer()->GetCollectionID("ScatterHitsCollection");
-    fAbsoHCID = G4SDManager::GetSDMpointer()->GetCollectionID("AbsorberHitsCollection");
+  // Event completed before the checkpoint of a resumed run, left empty
+  auto checkpoint = Checkpoint::Instance();
+  if (checkpoint->IsCompleted(event->GetEventID())) return;
+
+  // Get hits collections IDs and the pixelated layers (only once)
+  if (!fDetectorsFound) {
+    auto sdManager = G4SDManager::GetSDMpointer();
+    fPixelSD = dynamic_cast<PixelSD*>(sdManager->FindSensitiveDetector("PixelSD", false));
+    if (!fPixelSD || !fPixelSD->HasLayer(0)) {
+      fScatHCID = sdManager->GetCollectionID("ScatterHitsCollection");
+    }
+    if (!fPixelSD || !fPixelSD->HasLayer(1)) {
+      fAbsoHCID = sdManager->GetCollectionID("AbsorberHitsCollection");
+    }
+    fDetectorsFound = true;
+  }
+
+  // Write prompt gammas recorded in this event
+  WritePromptGammas();
+  WriteHits(event);
+
+  // Histograms and output rows of this event are complete
+  checkpoint->EndOfEvent(event->GetEventID());
+
+  Startup::Instance()->EndOfEvent();
+  Telemetry::Instance()->CountEvent();
+
+  // Soft abort: the event in progress on every thread is completed
+  auto adaptive = AdaptiveRun::Instance();
+  if (adaptive->IsActive()) {
+    adaptive->EndOfEvent();
+    if (adaptive->IsStopRequested()) G4RunManager::GetRunManager()->AbortRun(true);
   }
+}
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EventAction::WriteHits(const G4Event* event)
+{
   // get analysis manager
   auto analysisManager = G4AnalysisManager::Instance();
-  auto NtupleID = fRunAction->GetPromptNtupleID();
-
-	// Write prompt gammas recorded in this event into PromptGamma ntuple
-	if (!fPromptGammas.empty()) {
-			for (const auto &g : fPromptGammas) {
-        analysisManager->FillH1(2, g.energy);
-				analysisManager->FillNtupleIColumn(NtupleID, 0, g.eventID);
-				analysisManager->FillNtupleDColumn(NtupleID, 1, g.energy);
-				analysisManager->FillNtupleDColumn(NtupleID, 2, g.position.x());
-				analysisManager->FillNtupleDColumn(NtupleID, 3, g.position.y());
-				analysisManager->FillNtupleDColumn(NtupleID, 4, g.position.z());
-        analysisManager->AddNtupleRow(NtupleID);
-			}
-	}
-	fPromptGammas.clear();
-
-  // Get hits collections
-  auto scatHC = GetHitsCollection(fScatHCID, event);
-  auto absoHC = GetHitsCollection(fAbsoHCID, event);
 
   auto eventID = event->GetEventID();
 
-  G4int nScat = static_cast<G4int>(scatHC->entries());
-  G4int nAbso = static_cast<G4int>(absoHC->entries());
+  // Hits of both detectors: the hits collections of the monolithic layers
+  // and the pixels touched in the pixelated ones, in time order when a
+  // coincidence window is set
+  fTimedHits.clear();
+  for (auto [hcID, absorber] : {std::pair{fScatHCID, false}, std::pair{fAbsoHCID, true}}) {
+    if (hcID < 0) continue;
+    auto hitsCollection = GetHitsCollection(hcID, event);
+    for (std::size_t i = 0; i < hitsCollection->entries(); i++) {
+      const auto hit = (*hitsCollection)[i];
+      fTimedHits.push_back({hit->GetPos(), hit->GetEdep(), hit->GetTime(), hit->GetWeight(), -1,
+                            absorber});
+    }
+  }
+  if (fPixelSD) {
+    for (auto index : fPixelSD->GetTouched()) {
+      auto pixel = fPixelSD->GetPixel(index);
+      fTimedHits.push_back({pixel.position, pixel.edep, pixel.time, pixel.weight, pixel.pixelID,
+                            pixel.layer == 1});
+    }
+  }
+
+  if (fTimedHits.empty()) return;
+
+  if (fCoincidenceWindow < DBL_MAX) {
+    std::stable_sort(fTimedHits.begin(), fTimedHits.end(),
+                     [](const auto& a, const auto& b) { return a.time < b.time; });
+  }
+
+  // Each window opens at the earliest hit left and takes the hits up to
+  // the coincidence window later; with bunches of protons a window can
+  // hold hits of different protons (random coincidences)
+  auto writePixels = fRunAction->GetPixelRows();
+  std::size_t first = 0;
+  while (first < fTimedHits.size()) {
+    auto openTime = fTimedHits[first].time;
+
+    G4int nScatWindow = 0;
+    G4int nAbsoWindow = 0;
+    G4double scatEdep = 0.;
+    G4ThreeVector scatPosi(0., 0., 0.);
+    G4double absoEdep = 0.;
+    G4ThreeVector absoPosi(0., 0., 0.);
+    // The hits of one gamma share its weight, the spectra take that of the
+    // first hit in each detector; a coincidence needs one weight for all
+    G4double scatWeight = 1.;
+    G4double absoWeight = 1.;
+    auto windowWeight = fTimedHits[first].weight;
+    G4bool mixedWeights = false;
+
+    // Energy-weighted centroid of each detector
+    auto last = first;
+    for (; last < fTimedHits.size(); ++last) {
+      const auto& timedHit = fTimedHits[last];
+      if (timedHit.time - openTime > fCoincidenceWindow) break;
+      auto edep = timedHit.edep;
+      if (timedHit.weight != windowWeight) mixedWeights = true;
+      if (timedHit.absorber) {
+        if (nAbsoWindow == 0) absoWeight = timedHit.weight;
+        absoEdep += edep;
+        absoPosi += timedHit.position * edep;
+        ++nAbsoWindow;
+      }
+      else {
+        if (nScatWindow == 0) scatWeight = timedHit.weight;
+        scatEdep += edep;
+        scatPosi += timedHit.position * edep;
+        ++nScatWindow;
+      }
+    }
+    auto windowFirst = first;
+    first = last;
+
+    // Measured energies, with the resolution of the crystals
+    auto digitizer = Digitizer::Instance();
+    G4double scatEnergy = 0.;
+    G4double absoEnergy = 0.;
+    if (nScatWindow != 0) {
+      scatEnergy = digitizer->Smear(Digitizer::kScatter, scatEdep);
+      analysisManager->FillH1(0, scatEnergy, scatWeight);
+    }
+    if (nAbsoWindow != 0) {
+      absoEnergy = digitizer->Smear(Digitizer::kAbsorber, absoEdep);
+      analysisManager->FillH1(1, absoEnergy, absoWeight);
+    }
+
+    // record data only when both scatter and absorber detect event simultaneously,
+    // and the coincidence passes the digitizer cuts
+    if (nScatWindow == 0 || nAbsoWindow == 0) continue;
+    if (!digitizer->Accept(scatEnergy, absoEnergy, mixedWeights)) continue;
+    Telemetry::Instance()->CountCoincidence();
 
-  if (nScat == 0 && nAbso == 0) return;
+    auto adaptive = AdaptiveRun::Instance();
+    if (adaptive->IsActive()) adaptive->CountCoincidence(scatEnergy + absoEnergy, windowWeight);
 
-  G4double scatEdep = 0.;
-  G4ThreeVector scatPosi(0., 0., 0.);
-  G4double absoEdep = 0.;
-  G4ThreeVector absoPosi(0., 0., 0.);
+    Detection detection;
+    detection.eventID = eventID;
+    detection.scatPosition = scatPosi / scatEdep;
+    detection.absoPosition = absoPosi / absoEdep;
+    detection.scatEdep = scatEnergy;
+    detection.absoEdep = absoEnergy;
+    detection.spotID = fSpotID;
+    detection.time = openTime;
+    detection.weight = windowWeight;
 
-  for (int i = 0; i < nScat; i++) {
-    scatEdep += (*scatHC)[i]->GetEdep();
-    scatPosi += (*scatHC)[i]->GetPos() * scatEdep;
+    WriteDetection(detection);
+
+    // Sparse pixel lists of a pixelated camera, for the accepted windows only
+    if (writePixels) {
+      for (auto i = windowFirst; i < last; ++i) {
+        const auto& hit = fTimedHits[i];
+        if (hit.pixelID < 0) continue;  // monolithic layer
+        PixelRecord pixel;
+        pixel.eventID = eventID;
+        pixel.layer = hit.absorber ? 1 : 0;
+        pixel.pixelID = hit.pixelID;
+        pixel.edep = hit.edep;
+        pixel.time = hit.time;
+        WritePixel(pixel);
+      }
+    }
+
+    auto image = OnlineImage::Instance();
+    if (image->IsEnabled()) {
+      image->Fill(detection.scatPosition, detection.absoPosition, scatEnergy, absoEnergy,
+                  detection.weight);
+    }
   }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EventAction::WritePromptGammas()
+{
+  if (fPromptGammas.empty()) return;
+
+  Telemetry::Instance()->CountPromptGammas(fPromptGammas.size());
+
+  auto analysisManager = G4AnalysisManager::Instance();
+  auto ntupleID = fRunAction->GetPromptNtupleID();
+  auto writeRows = fRunAction->GetPromptRows();
+  auto writeNtuple = writeRows && fRunAction->GetRootNtuples();
+  auto emissionMap = fRunAction->GetEmissionMap();
 
-  for (int i = 0; i < nAbso; i++) {
-    absoEdep += (*absoHC)[i]->GetEdep();
-    absoPosi += (*absoHC)[i]->GetPos() * absoEdep;
+  auto asyncWriter = AsyncWriter::Instance();
+  auto columns = ColumnOutput::Instance();
+  auto tableID = fRunAction->GetPromptTableID();
+  auto adaptive = AdaptiveRun::Instance();
+
+  for (const auto& g : fPromptGammas) {
+    analysisManager->FillH1(2, g.energy, g.weight);
+    if (emissionMap) emissionMap->Fill(g.position, g.energy, g.weight);
+    if (adaptive->IsActive()) adaptive->AddPromptGamma(g.position.x(), g.energy, g.weight);
+
+    if (writeNtuple) {
+      analysisManager->FillNtupleIColumn(ntupleID, 0, g.eventID);
+      analysisManager->FillNtupleDColumn(ntupleID, 1, g.energy);
+      analysisManager->FillNtupleDColumn(ntupleID, 2, g.position.x());
+      analysisManager->FillNtupleDColumn(ntupleID, 3, g.position.y());
+      analysisManager->FillNtupleDColumn(ntupleID, 4, g.position.z());
+      analysisManager->FillNtupleIColumn(ntupleID, 5, g.creatorProcess);
+      analysisManager->FillNtupleIColumn(ntupleID, 6, g.parentPDG);
+      analysisManager->FillNtupleIColumn(ntupleID, 7, g.spotID);
+      analysisManager->AddNtupleRow(ntupleID);
+    }
+
+    if (!writeRows) continue;
+    if (asyncWriter->IsRunning()) {
+      asyncWriter->Push(g);
+    }
+    else if (columns->IsOpen()) {
+      FillColumns(tableID, g);
+    }
+  }
+
+  // Phase space for replaying the camera stage without the beam
+  auto phaseSpaceWriter = fRunAction->GetPhaseSpaceWriter();
+  if (phaseSpaceWriter) {
+    for (const auto& g : fPromptGammas) {
+      phaseSpaceWriter->Write(g.eventID, g.position, g.direction, g.energy, g.time, g.weight);
+    }
+  }
+
+  fPromptGammas.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EventAction::WriteDetection(const Detection& detection)
+{
+  if (fRunAction->GetRootNtuples()) {
+    auto analysisManager = G4AnalysisManager::Instance();
+    auto ntupleID = fRunAction->GetDetectionNtupleID();
+
+    analysisManager->FillNtupleIColumn(ntupleID, 0, detection.eventID);
+    analysisManager->FillNtupleDColumn(ntupleID, 1, detection.scatPosition[0]);
+    analysisManager->FillNtupleDColumn(ntupleID, 2, detection.scatPosition[1]);
+    analysisManager->FillNtupleDColumn(ntupleID, 3, detection.scatPosition[2]);
+
+    analysisManager->FillNtupleDColumn(ntupleID, 4, detection.absoPosition[0]);
+    analysisManager->FillNtupleDColumn(ntupleID, 5, detection.absoPosition[1]);
+    analysisManager->FillNtupleDColumn(ntupleID, 6, detection.absoPosition[2]);
+
+    analysisManager->FillNtupleDColumn(ntupleID, 7, detection.scatEdep);
+    analysisManager->FillNtupleDColumn(ntupleID, 8, detection.absoEdep);
+    analysisManager->FillNtupleIColumn(ntupleID, 9, detection.spotID);
+    analysisManager->FillNtupleDColumn(ntupleID, 10, detection.time);
+    analysisManager->FillNtupleDColumn(ntupleID, 11, detection.weight);
+
+    analysisManager->AddNtupleRow(ntupleID);
+  }
+
+  auto asyncWriter = AsyncWriter::Instance();
+  if (asyncWriter->IsRunning()) {
+    asyncWriter->Push(detection);
+  }
+  else if (ColumnOutput::Instance()->IsOpen()) {
+    FillColumns(fRunAction->GetDetectionTableID(), detection);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EventAction::WritePixel(const PixelRecord& pixel)
+{
+  if (fRunAction->GetRootNtuples()) {
+    auto analysisManager = G4AnalysisManager::Instance();
+    auto ntupleID = fRunAction->GetPixelNtupleID();
+    analysisManager->FillNtupleIColumn(ntupleID, 0, pixel.eventID);
+    analysisManager->FillNtupleIColumn(ntupleID, 1, pixel.layer);
+    analysisManager->FillNtupleIColumn(ntupleID, 2, pixel.pixelID);
+    analysisManager->FillNtupleDColumn(ntupleID, 3, pixel.edep);
+    analysisManager->FillNtupleDColumn(ntupleID, 4, pixel.time);
+    analysisManager->AddNtupleRow(ntupleID);
   }
 
-  if (nScat != 0) {
-    analysisManager->FillH1(0, scatEdep);
+  auto asyncWriter = AsyncWriter::Instance();
+  if (asyncWriter->IsRunning()) {
+    asyncWriter->Push(pixel);
   }
-  if (nAbso != 0) {
-    analysisManager->FillH1(1, absoEdep);
+  else if (ColumnOutput::Instance()->IsOpen()) {
+    FillColumns(fRunAction->GetPixelTableID(), pixel);
   }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EventAction::FillColumns(G4int tableID, const PromptGamma& g)
+{
+  auto columns = ColumnOutput::Instance();
+  columns->FillIColumn(tableID, 0, g.eventID);
+  columns->FillDColumn(tableID, 1, g.energy);
+  columns->FillDColumn(tableID, 2, g.position.x());
+  columns->FillDColumn(tableID, 3, g.position.y());
+  columns->FillDColumn(tableID, 4, g.position.z());
+  columns->FillIColumn(tableID, 5, g.creatorProcess);
+  columns->FillIColumn(tableID, 6, g.parentPDG);
+  columns->FillIColumn(tableID, 7, g.spotID);
+  columns->AddRow(tableID);
+}
 
-  // record data only when both scatter and absorber detect event simultaneously
-  if (nScat == 0 || nAbso == 0) return;
-  
-  absoPosi /= scatEdep;
-  scatPosi /= absoEdep;
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  NtupleID = fRunAction->GetDetectionNtupleID();
+void EventAction::FillColumns(G4int tableID, const Detection& detection)
+{
+  auto columns = ColumnOutput::Instance();
+  columns->FillIColumn(tableID, 0, detection.eventID);
+  for (G4int i = 0; i < 3; ++i) {
+    columns->FillDColumn(tableID, 1 + i, detection.scatPosition[i]);
+    columns->FillDColumn(tableID, 4 + i, detection.absoPosition[i]);
+  }
+  columns->FillDColumn(tableID, 7, detection.scatEdep);
+  columns->FillDColumn(tableID, 8, detection.absoEdep);
+  columns->FillIColumn(tableID, 9, detection.spotID);
+  columns->FillDColumn(tableID, 10, detection.time);
+  columns->FillDColumn(tableID, 11, detection.weight);
+  columns->AddRow(tableID);
+}
 
-  analysisManager->FillNtupleIColumn(NtupleID, 0, eventID);
-  analysisManager->FillNtupleDColumn(NtupleID, 1, scatPosi[0]);
-  analysisManager->FillNtupleDColumn(NtupleID, 2, scatPosi[1]);
-  analysisManager->FillNtupleDColumn(NtupleID, 3, scatPosi[2]);
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  analysisManager->FillNtupleDColumn(NtupleID, 4, absoPosi[0]);
-  analysisManager->FillNtupleDColumn(NtupleID, 5, absoPosi[1]);
-  analysisManager->FillNtupleDColumn(NtupleID, 6, absoPosi[2]);
+void EventAction::FillColumns(G4int tableID, const PixelRecord& pixel)
+{
+  auto columns = ColumnOutput::Instance();
+  columns->FillIColumn(tableID, 0, pixel.eventID);
+  columns->FillIColumn(tableID, 1, pixel.layer);
+  columns->FillIColumn(tableID, 2, pixel.pixelID);
+  columns->FillDColumn(tableID, 3, pixel.edep);
+  columns->FillDColumn(tableID, 4, pixel.time);
+  columns->AddRow(tableID);
+}
 
-  analysisManager->FillNtupleDColumn(NtupleID, 7, scatEdep);
-  analysisManager->FillNtupleDColumn(NtupleID, 8, absoEdep);
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  analysisManager->AddNtupleRow(NtupleID);
+void EventAction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/event/", "Event processing");
 
+  auto& windowCmd = fMessenger->DeclarePropertyWithUnit("coincidenceWindow", "ns",
+    fCoincidenceWindow,
+    "Time window of a scatter-absorber coincidence, opened by the earliest hit\n"
+    "left in the event; unlimited by default (one window per event).");
+  windowCmd.SetParameterName("window", false);
+  windowCmd.SetRange("window>0.");
 }
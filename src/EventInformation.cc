@@ -0,0 +1,8 @@
+#include "EventInformation.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EventInformation::Print() const
+{
+  G4cout << "Spot " << fSpotID << G4endl;
+}
@@ -0,0 +1,239 @@
+#include "OnlineImage.hh"
+
+#include "Sharding.hh"
+
+#include "G4Box.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OnlineImage* OnlineImage::Instance()
+{
+  static OnlineImage instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OnlineImage::OnlineImage() : fInterval(30. * s), fVoxelSize(4. * mm), fSigmaAngle(3. * deg)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OnlineImage::~OnlineImage()
+{
+  Stop();
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::Allocate(Image& image) const
+{
+  auto size = fKernel ? fKernel->GetGrid().GetNofVoxels() : 0;
+  if (size != image.size) {
+    image.data.reset(size ? new std::atomic<G4double>[size] : nullptr);
+    image.size = size;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    image.data[i].store(0., std::memory_order_relaxed);
+  }
+  image.cones.store(0, std::memory_order_relaxed);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::Fill(const G4ThreeVector& scatPosition, const G4ThreeVector& absoPosition,
+                       G4double scatEnergy, G4double absoEnergy, G4double weight)
+{
+  // The reconstruction library works in mm and MeV
+  const double scat[3] = {scatPosition.x() / mm, scatPosition.y() / mm, scatPosition.z() / mm};
+  const double abso[3] = {absoPosition.x() / mm, absoPosition.y() / mm, absoPosition.z() / mm};
+  ComptonCone cone;
+  if (!ComptonCone::FromCoincidence(scat, abso, scatEnergy / MeV, absoEnergy / MeV, weight,
+                                    cone))
+  {
+    return;
+  }
+
+  // A new image is sized under the registry lock, out of sight of the snapshots
+  auto& image = fImages.Local([this](Image& newImage) { Allocate(newImage); });
+  auto& projection = image.projection;
+  fKernel->Project(cone, projection);
+
+  G4double total = 0.;
+  for (auto value : projection.values) {
+    total += value;
+  }
+  if (total <= 0.) return;
+
+  auto scale = weight / total;
+  for (std::size_t k = 0; k < projection.voxels.size(); ++k) {
+    Add(image.data[projection.voxels[k]], projection.values[k] * scale);
+  }
+  image.cones.store(image.cones.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool OnlineImage::SetGridFromTarget()
+{
+  auto targetPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("Target", false);
+  auto targetBox = targetPV ? dynamic_cast<G4Box*>(targetPV->GetLogicalVolume()->GetSolid())
+                            : nullptr;
+  if (!targetBox) {
+    G4Exception("OnlineImage::SetGridFromTarget()", "MyCode0016", JustWarning,
+                "Target box not found, the online image is disabled.");
+    return false;
+  }
+
+  G4double halfSize[3] = {targetBox->GetXHalfLength(), targetBox->GetYHalfLength(),
+                          targetBox->GetZHalfLength()};
+  auto center = targetPV->GetTranslation();
+  VoxelGrid grid;
+  for (G4int axis = 0; axis < 3; ++axis) {
+    auto size = 2. * halfSize[axis];
+    auto n = std::max(1, static_cast<G4int>(std::lround(size / fVoxelSize)));
+    if (fFlat && axis == 1) n = 1;
+    grid.origin[axis] = (center[axis] - halfSize[axis]) / mm;
+    grid.voxel[axis] = size / n / mm;
+    (axis == 0 ? grid.nx : axis == 1 ? grid.ny : grid.nz) = n;
+  }
+  fKernel = std::make_unique<ConeKernel>(grid, fSigmaAngle / rad);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::Start(G4int runID)
+{
+  Stop();
+  if (fFileName.empty() || !SetGridFromTarget()) return;
+
+  // The threads are idle between runs, their images are resized here
+  fImages.ForEach([this](Image& image) { Allocate(image); });
+  fSum.assign(fKernel->GetGrid().GetNofVoxels(), 0.);
+  fRunID = runID;
+  fSnapshot = 0;
+  fActive = true;
+
+  fStopRequested = false;
+  fWriter = std::thread(&OnlineImage::SnapshotLoop, this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::Stop()
+{
+  if (!fWriter.joinable()) return;
+
+  {
+    std::lock_guard<std::mutex> lock(fStopMutex);
+    fStopRequested = true;
+  }
+  fStopCondition.notify_all();
+  fWriter.join();
+
+  WriteSnapshot();
+  fActive = false;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::SnapshotLoop()
+{
+  auto interval = std::chrono::duration<G4double>(fInterval / s);
+  std::unique_lock<std::mutex> lock(fStopMutex);
+  while (!fStopCondition.wait_for(lock, interval, [this]() { return fStopRequested; })) {
+    lock.unlock();
+    WriteSnapshot();
+    lock.lock();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::WriteSnapshot()
+{
+  // Read while the threads fill their images: a cone may be caught half
+  // added, it is complete in the next snapshot
+  std::fill(fSum.begin(), fSum.end(), 0.);
+  std::uint64_t cones = 0;
+  fImages.ForEach([this, &cones](const Image& image) {
+    if (image.size != fSum.size()) return;
+    for (std::size_t i = 0; i < fSum.size(); ++i) {
+      fSum[i] += image.data[i].load(std::memory_order_relaxed);
+    }
+    cones += image.cones.load(std::memory_order_relaxed);
+  });
+
+  auto baseName = Sharding::Instance()->TagFileName(fFileName) + "_run" + std::to_string(fRunID)
+                  + "_" + std::to_string(fSnapshot++);
+  auto binName = baseName + ".bin";
+  auto file = std::fopen(binName.c_str(), "wb");
+  if (!file) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open image snapshot " << binName;
+    G4Exception("OnlineImage::WriteSnapshot()", "MyCode0016", JustWarning, msg);
+    return;
+  }
+  std::fwrite(fSum.data(), sizeof(G4double), fSum.size(), file);
+  std::fclose(file);
+
+  const auto& grid = fKernel->GetGrid();
+  std::ofstream header(baseName + ".json");
+  header << "{\n  \"file\": \"" << binName.substr(binName.rfind('/') + 1)
+         << "\",\n  \"dtype\": \"<f8\",\n  \"shape\": [" << grid.nx << ", " << grid.ny << ", "
+         << grid.nz << "],\n  \"origin\": [" << grid.origin[0] << ", " << grid.origin[1] << ", "
+         << grid.origin[2] << "],\n  \"voxel\": [" << grid.voxel[0] << ", " << grid.voxel[1]
+         << ", " << grid.voxel[2] << "],\n  \"run\": " << fRunID << ",\n  \"cones\": " << cones
+         << "\n}\n";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OnlineImage::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/image/", "Live backprojection image");
+
+  auto& fileCmd = fMessenger->DeclareProperty("fileName", fFileName,
+    "Base name of the image snapshots (<name>_run<R>_<n>.bin and .json);\n"
+    "empty disables the image.");
+  fileCmd.SetParameterName("name", true);
+  fileCmd.SetDefaultValue("");
+  fileCmd.SetToBeBroadcasted(false);
+
+  auto& intervalCmd = fMessenger->DeclarePropertyWithUnit("interval", "s", fInterval,
+    "Wall time between two snapshots.");
+  intervalCmd.SetParameterName("interval", false);
+  intervalCmd.SetRange("interval>0.");
+  intervalCmd.SetToBeBroadcasted(false);
+
+  auto& voxelCmd = fMessenger->DeclarePropertyWithUnit("voxelSize", "mm", fVoxelSize,
+    "Voxel size, rounded to fit the Target box.");
+  voxelCmd.SetParameterName("size", false);
+  voxelCmd.SetRange("size>0.");
+  voxelCmd.SetToBeBroadcasted(false);
+
+  auto& sigmaCmd = fMessenger->DeclarePropertyWithUnit("sigma", "deg", fSigmaAngle,
+    "Angular width of the backprojected cones.");
+  sigmaCmd.SetParameterName("sigma", false);
+  sigmaCmd.SetRange("sigma>0.");
+  sigmaCmd.SetToBeBroadcasted(false);
+
+  auto& flatCmd = fMessenger->DeclareProperty("flat", fFlat,
+    "2D image: the x-z plane through the Target centre, one voxel across y.");
+  flatCmd.SetParameterName("flag", true);
+  flatCmd.SetDefaultValue("true");
+  flatCmd.SetToBeBroadcasted(false);
+}
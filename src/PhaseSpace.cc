@@ -0,0 +1,202 @@
+#include "PhaseSpace.hh"
+
+#include "Telemetry.hh"
+
+#include "G4AutoLock.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <cstring>
+#include <map>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+G4Mutex readerMutex = G4MUTEX_INITIALIZER;
+constexpr std::size_t kBufferSize = 1 << 16;  // records per fwrite
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PhaseSpaceWriter::PhaseSpaceWriter(const G4String& fileName) : fFileName(fileName)
+{
+  fFile = std::fopen(fileName.c_str(), "wb");
+  if (!fFile) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open phase-space file " << fileName << " for writing.";
+    G4Exception("PhaseSpaceWriter::PhaseSpaceWriter()", "MyCode0004", FatalException, msg);
+    return;
+  }
+
+  // Header is rewritten with the final record count in Close()
+  PhaseSpace::Header header{};
+  std::memcpy(header.magic, PhaseSpace::kMagic, sizeof(header.magic));
+  header.endianTag = PhaseSpace::kEndianTag;
+  header.recordSize = sizeof(PhaseSpace::Record);
+  std::fwrite(&header, sizeof(header), 1, fFile);
+
+  fBuffer.reserve(kBufferSize);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PhaseSpaceWriter::~PhaseSpaceWriter()
+{
+  Close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhaseSpaceWriter::Write(G4int eventID, const G4ThreeVector& position,
+                             const G4ThreeVector& direction, G4double energy, G4double time,
+                             G4double weight)
+{
+  PhaseSpace::Record record;
+  record.x = position.x() / mm;
+  record.y = position.y() / mm;
+  record.z = position.z() / mm;
+  record.dx = direction.x();
+  record.dy = direction.y();
+  record.dz = direction.z();
+  record.energy = energy / MeV;
+  record.time = time / ns;
+  record.weight = weight;
+  record.eventID = eventID;
+
+  fBuffer.push_back(record);
+  if (fBuffer.size() == kBufferSize) Flush();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhaseSpaceWriter::Flush()
+{
+  if (!fFile || fBuffer.empty()) return;
+
+  std::fwrite(fBuffer.data(), sizeof(PhaseSpace::Record), fBuffer.size(), fFile);
+  fNofRecords += fBuffer.size();
+  Telemetry::Instance()->CountBytes(fBuffer.size() * sizeof(PhaseSpace::Record));
+  fBuffer.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhaseSpaceWriter::Close()
+{
+  if (!fFile) return;
+
+  Flush();
+
+  PhaseSpace::Header header{};
+  std::memcpy(header.magic, PhaseSpace::kMagic, sizeof(header.magic));
+  header.endianTag = PhaseSpace::kEndianTag;
+  header.recordSize = sizeof(PhaseSpace::Record);
+  header.nofRecords = fNofRecords;
+  std::fseek(fFile, 0, SEEK_SET);
+  std::fwrite(&header, sizeof(header), 1, fFile);
+
+  std::fclose(fFile);
+  fFile = nullptr;
+
+  G4cout << "Phase space: " << fNofRecords << " prompt gammas written to " << fFileName
+         << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PhaseSpaceReader::~PhaseSpaceReader()
+{
+  for (const auto& mapping : fMappings) {
+    munmap(mapping.address, mapping.length);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::shared_ptr<const PhaseSpaceReader> PhaseSpaceReader::Open(const G4String& baseName)
+{
+  // All worker threads replaying the same files share one mapping and index
+  static std::map<G4String, std::weak_ptr<const PhaseSpaceReader>> readers;
+
+  G4AutoLock lock(&readerMutex);
+  auto reader = readers[baseName].lock();
+  if (reader) return reader;
+
+  // <base>.phsp from a sequential run, or <base>_t*.phsp from worker threads
+  G4String pattern = baseName + ".phsp";
+  if (access(pattern.c_str(), R_OK) != 0) pattern = baseName + "_t*.phsp";
+
+  glob_t files;
+  if (glob(pattern.c_str(), 0, nullptr, &files) != 0) {
+    G4ExceptionDescription msg;
+    msg << "No phase-space file matches " << pattern;
+    G4Exception("PhaseSpaceReader::Open()", "MyCode0005", FatalException, msg);
+    return nullptr;
+  }
+
+  auto newReader = std::shared_ptr<PhaseSpaceReader>(new PhaseSpaceReader);
+  for (std::size_t i = 0; i < files.gl_pathc; ++i) {
+    newReader->Map(files.gl_pathv[i]);
+  }
+  globfree(&files);
+
+  G4cout << "Phase space: " << newReader->fNofRecords << " prompt gammas in "
+         << newReader->fGroups.size() << " events read from " << pattern << G4endl;
+
+  readers[baseName] = newReader;
+  return newReader;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhaseSpaceReader::Map(const G4String& fileName)
+{
+  G4ExceptionDescription msg;
+
+  int fd = open(fileName.c_str(), O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0
+      || static_cast<std::size_t>(status.st_size) < sizeof(PhaseSpace::Header))
+  {
+    if (fd >= 0) close(fd);
+    msg << "Cannot read phase-space file " << fileName;
+    G4Exception("PhaseSpaceReader::Map()", "MyCode0005", FatalException, msg);
+    return;
+  }
+
+  std::size_t length = status.st_size;
+  void* address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    msg << "Cannot map phase-space file " << fileName;
+    G4Exception("PhaseSpaceReader::Map()", "MyCode0005", FatalException, msg);
+    return;
+  }
+  fMappings.push_back({address, length});
+
+  auto header = static_cast<const PhaseSpace::Header*>(address);
+  if (std::memcmp(header->magic, PhaseSpace::kMagic, sizeof(header->magic)) != 0
+      || header->endianTag != PhaseSpace::kEndianTag
+      || header->recordSize != sizeof(PhaseSpace::Record)
+      || sizeof(PhaseSpace::Header) + header->nofRecords * sizeof(PhaseSpace::Record) > length)
+  {
+    msg << fileName << " is not a compatible phase-space file.";
+    G4Exception("PhaseSpaceReader::Map()", "MyCode0005", FatalException, msg);
+    return;
+  }
+
+  // Records of one event are contiguous because each event is written
+  // by a single thread at the end of the event
+  auto records = reinterpret_cast<const PhaseSpace::Record*>(header + 1);
+  for (std::uint64_t i = 0; i < header->nofRecords; ++i) {
+    if (i == 0 || records[i].eventID != records[i - 1].eventID) {
+      fGroups.push_back({records + i, 0});
+    }
+    ++fGroups.back().size;
+  }
+  fNofRecords += header->nofRecords;
+}
@@ -0,0 +1,117 @@
+#include "PixelSD.hh"
+
+#include "G4LogicalVolume.hh"
+#include "G4Step.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4VProcess.hh"
+#include "G4VTouchable.hh"
+
+#include <algorithm>
+#include <cmath>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PixelSD::PixelSD(const G4String& name) : G4VSensitiveDetector(name) {}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PixelSD::AddLayer(G4int layerID, const G4LogicalVolume* pixelLV, G4int nofPixels,
+                       G4double pitch, const G4ThreeVector& firstPixel)
+{
+  Layer layer;
+  layer.layer = layerID;
+  layer.pixelLV = pixelLV;
+  layer.nofPixels = nofPixels;
+  layer.pitch = pitch;
+  layer.firstPixel = firstPixel;
+  layer.offset = fEdep.size();
+  fLayers.push_back(layer);
+
+  auto nofAll = fEdep.size() + static_cast<std::size_t>(nofPixels) * nofPixels;
+  fEdep.resize(nofAll, 0.);
+  fTime.resize(nofAll, 0.);
+  fWeight.resize(nofAll, 1.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool PixelSD::HasLayer(G4int layer) const
+{
+  return std::any_of(fLayers.begin(), fLayers.end(),
+                     [layer](const Layer& l) { return l.layer == layer; });
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PixelSD::Pixel PixelSD::GetPixel(std::size_t index) const
+{
+  // Layers are few and ordered by offset
+  auto layer = fLayers.rbegin();
+  while (layer->offset > index) ++layer;
+
+  Pixel pixel;
+  pixel.layer = layer->layer;
+  pixel.pixelID = static_cast<G4int>(index - layer->offset);
+  auto row = pixel.pixelID / layer->nofPixels;
+  auto column = pixel.pixelID % layer->nofPixels;
+  pixel.edep = fEdep[index];
+  pixel.time = fTime[index];
+  pixel.weight = fWeight[index];
+  pixel.position = layer->firstPixel + G4ThreeVector(column * layer->pitch, row * layer->pitch, 0.);
+  return pixel;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PixelSD::Initialize(G4HCofThisEvent*)
+{
+  // The previous event has been written, only its pixels are reset
+  for (auto index : fTouched) {
+    fEdep[index] = 0.;
+  }
+  fTouched.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool PixelSD::ProcessHits(G4Step* step, G4TouchableHistory*)
+{
+  G4double edep = step->GetTotalEnergyDeposit();
+  if (edep == 0.) return false;
+
+  auto preStepPoint = step->GetPreStepPoint();
+  auto touchable = preStepPoint->GetTouchable();
+  auto pixelLV = touchable->GetVolume()->GetLogicalVolume();
+  auto layer = std::find_if(fLayers.begin(), fLayers.end(),
+                            [pixelLV](const Layer& l) { return l.pixelLV == pixelLV; });
+  if (layer == fLayers.end()) return false;
+
+  // Pixel replicated along X in a row, rows along Y in the layer
+  auto column = touchable->GetReplicaNumber(0);
+  auto row = touchable->GetReplicaNumber(1);
+
+  // The fast simulation of the crystals moves the deposit away from the
+  // pre-step point, to the final position of the step; the layers are
+  // not rotated
+  auto process = step->GetPostStepPoint()->GetProcessDefinedStep();
+  if (process && process->GetProcessType() == fParameterisation) {
+    auto offset = (step->GetPostStepPoint()->GetPosition() - layer->firstPixel) / layer->pitch;
+    auto last = layer->nofPixels - 1;
+    column = std::clamp(static_cast<G4int>(std::lround(offset.x())), 0, last);
+    row = std::clamp(static_cast<G4int>(std::lround(offset.y())), 0, last);
+  }
+  auto index = layer->offset + static_cast<std::size_t>(row) * layer->nofPixels + column;
+
+  auto time = step->GetPostStepPoint()->GetGlobalTime();
+  if (fEdep[index] == 0.) {
+    fTouched.push_back(index);
+    fTime[index] = time;
+    fWeight[index] = step->GetTrack()->GetWeight();
+  }
+  else {
+    fTime[index] = std::min(fTime[index], time);
+  }
+  fEdep[index] += edep;
+
+  return true;
+}
@@ -1,15 +1,39 @@
 #include "PrimaryGeneratorAction.hh"
 
+#include "Checkpoint.hh"
+#include "EventInformation.hh"
+#include "PhaseSpace.hh"
+#include "Sharding.hh"
+#include "TreatmentPlan.hh"
+
 #include "G4Box.hh"
+#include "G4Event.hh"
+#include "G4GenericMessenger.hh"
+#include "G4Gamma.hh"
 #include "G4LogicalVolume.hh"
 #include "G4LogicalVolumeStore.hh"
 #include "G4ParticleGun.hh"
 #include "G4ParticleTable.hh"
 #include "G4IonTable.hh"
+#include "G4PrimaryParticle.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4Poisson.hh"
+#include "G4RunManager.hh"
 #include "Randomize.hh"
 #include "G4SystemOfUnits.hh"
 #include "globals.hh"
 
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Source point of the beam axis (+X), upstream of the Target
+const G4ThreeVector kBeamCenter(-140. * mm, 0. * mm, 100. * mm);
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 PrimaryGeneratorAction::PrimaryGeneratorAction()
 {
   G4int nofParticles = 1;
@@ -22,6 +46,8 @@ PrimaryGeneratorAction::PrimaryGeneratorAction()
     fParticleGun->SetParticleMomentumDirection(G4ThreeVector(1.,0.,0.));
     fParticleGun->SetParticleEnergy(150. * MeV);
   }
+
+  DefineCommands();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -29,6 +55,7 @@ PrimaryGeneratorAction::PrimaryGeneratorAction()
 PrimaryGeneratorAction::~PrimaryGeneratorAction()
 {
   delete fParticleGun;
+  delete fMessenger;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -37,11 +64,59 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* event)
 {
   // This function is called at the begining of event
 
+  // Global event number and per-event seed, before any random number is drawn
+  Sharding::Instance()->SeedEvent(event);
+
+  // Events completed before the checkpoint of a resumed run stay empty
+  if (Checkpoint::Instance()->IsCompleted(event->GetEventID())) return;
+
+  if (fPhaseSpace) {
+    GenerateFromPhaseSpace(event);
+  }
+  else {
+    // Bunch of protons sharing the event, each at its own time in the bunch
+    G4int nofProtons = fPoissonBunch ? static_cast<G4int>(G4Poisson(fBunchSize)) : fBunchSize;
+    G4int spotID = -1;
+    for (G4int i = 0; i < nofProtons; ++i) {
+      fParticleGun->SetParticleTime(nofProtons > 1 ? SampleBunchTime() : 0.);
+      if (fPlan) {
+        spotID = GenerateFromPlan(event);
+      }
+      else {
+        GenerateBeam(event);
+      }
+    }
+    // Spot ID in the output rows of the event, only when it is unambiguous
+    if (fPlan && nofProtons == 1) {
+      event->SetUserInformation(new EventInformation(spotID));
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double PrimaryGeneratorAction::SampleBunchTime() const
+{
+  // Uniform over the bunch length; with an RF period the protons come in
+  // micro-bunches of Gaussian width at multiples of the period
+  G4double time = G4UniformRand() * fBunchLength;
+  if (fRFPeriod > 0.) {
+    time = std::floor(time / fRFPeriod) * fRFPeriod;
+    if (fRFWidth > 0.) time += G4RandGauss::shoot(0., fRFWidth);
+  }
+  return time;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::CheckWorld()
+{
   // In order to avoid dependence of PrimaryGeneratorAction
   // on DetectorConstruction class we get world volume
-  // from G4LogicalVolumeStore
+  // from G4LogicalVolumeStore, once: the geometry is built before the
+  // first event and does not change during a run
   //
-  G4double worldZHalfLength = 0.;
+  fWorldChecked = true;
   auto worldLV = G4LogicalVolumeStore::GetInstance()->GetVolume("World");
 
   // Check that the world volume has box shape
@@ -50,26 +125,29 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* event)
     worldBox = dynamic_cast<G4Box*>(worldLV->GetSolid());
   }
 
-  if (worldBox) {
-    worldZHalfLength = worldBox->GetZHalfLength();
-  }
-  else {
+  if (!worldBox) {
     G4ExceptionDescription msg;
     msg << "World volume of box shape not found." << G4endl;
     msg << "Perhaps you have changed geometry." << G4endl;
     msg << "The gun will be place in the center.";
     G4Exception("PrimaryGeneratorAction::GeneratePrimaries()", "MyCode0002", JustWarning, msg);
   }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::GenerateBeam(G4Event* event)
+{
+  if (!fWorldChecked) CheckWorld();
 
   // Pencil beam with Gaussian transverse profile
   // Beam axis along +X, sample transverse (Y,Z) from Gaussian with sigma = 1 mm
-  const G4ThreeVector beamCenter(-140. * mm, 0. * mm, 100. * mm);
   const G4double sigma = 1.0 * mm; // requested beam width (rms)
 
   // sample Y and Z from Gaussian around the beam center
-  G4double sampY = G4RandGauss::shoot(beamCenter.y(), sigma);
-  G4double sampZ = G4RandGauss::shoot(beamCenter.z(), sigma);
-  G4ThreeVector srcPos(beamCenter.x(), sampY, sampZ);
+  G4double sampY = G4RandGauss::shoot(kBeamCenter.y(), sigma);
+  G4double sampZ = G4RandGauss::shoot(kBeamCenter.z(), sigma);
+  G4ThreeVector srcPos(kBeamCenter.x(), sampY, sampZ);
 
   // Set up particle and generate
   fParticleGun->SetParticlePosition(srcPos);
@@ -77,3 +155,134 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* event)
   fParticleGun->SetParticleMomentumDirection(G4ThreeVector(1., 0., 0.));
   fParticleGun->GeneratePrimaryVertex(event);
 }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int PrimaryGeneratorAction::GenerateFromPlan(G4Event* event)
+{
+  if (!fWorldChecked) CheckWorld();
+
+  auto spotID = fPlan->Sample(G4UniformRand(), G4UniformRand());
+  const auto& spot = fPlan->GetSpot(spotID);
+
+  G4double energy = spot.energy;
+  if (spot.energySpread > 0.) {
+    energy = std::max(G4RandGauss::shoot(spot.energy, spot.energySpread), 0.);
+  }
+  G4ThreeVector position(kBeamCenter.x(), G4RandGauss::shoot(kBeamCenter.y() + spot.y, spot.sigmaY),
+                         G4RandGauss::shoot(kBeamCenter.z() + spot.z, spot.sigmaZ));
+  G4ThreeVector direction(1., 0., 0.);
+  if (spot.divergenceY > 0. || spot.divergenceZ > 0.) {
+    direction.set(1., std::tan(G4RandGauss::shoot(0., spot.divergenceY)),
+                  std::tan(G4RandGauss::shoot(0., spot.divergenceZ)));
+    direction = direction.unit();
+  }
+
+  fParticleGun->SetParticlePosition(position);
+  fParticleGun->SetParticleEnergy(energy);
+  fParticleGun->SetParticleMomentumDirection(direction);
+  fParticleGun->GeneratePrimaryVertex(event);
+
+  return static_cast<G4int>(spotID);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::GenerateFromPhaseSpace(G4Event* event)
+{
+  // Event N replays all prompt gammas of the N-th recorded event, so the
+  // events handed out by the run manager shard the file across threads
+  auto eventID = static_cast<std::size_t>(event->GetEventID());
+  if (eventID >= fPhaseSpace->GetNofGroups()) {
+    G4ExceptionDescription msg;
+    msg << "Phase space exhausted after " << fPhaseSpace->GetNofGroups() << " events." << G4endl;
+    msg << "The run is stopped.";
+    G4Exception("PrimaryGeneratorAction::GenerateFromPhaseSpace()", "MyCode0006", JustWarning,
+                msg);
+    G4RunManager::GetRunManager()->AbortRun(true);
+    return;
+  }
+
+  static G4ThreadLocal G4ParticleDefinition* gamma = nullptr;
+  if (!gamma) gamma = G4Gamma::Definition();
+
+  const auto& group = fPhaseSpace->GetGroup(eventID);
+  for (std::uint32_t i = 0; i < group.size; ++i) {
+    const auto& record = group.first[i];
+
+    auto vertex = new G4PrimaryVertex(
+      G4ThreeVector(record.x * mm, record.y * mm, record.z * mm), record.time * ns);
+    auto particle = new G4PrimaryParticle(gamma);
+    particle->SetKineticEnergy(record.energy * MeV);
+    particle->SetMomentumDirection(G4ThreeVector(record.dx, record.dy, record.dz));
+    particle->SetWeight(record.weight);
+    vertex->SetPrimary(particle);
+    event->AddPrimaryVertex(vertex);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::SetReplayFile(const G4String& baseName)
+{
+  if (baseName.empty() || baseName == "none") {
+    fPhaseSpace.reset();
+    return;
+  }
+  fPhaseSpace = PhaseSpaceReader::Open(baseName);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::SetPlanFile(const G4String& fileName)
+{
+  if (fileName.empty() || fileName == "none") {
+    fPlan.reset();
+    return;
+  }
+  fPlan = TreatmentPlan::Load(fileName);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/gun/", "Primary generator control");
+
+  auto& replayCmd = fMessenger->DeclareMethod("replay", &PrimaryGeneratorAction::SetReplayFile,
+    "Replay prompt gammas from <name>.phsp or <name>_t*.phsp instead of the proton beam.\n"
+    "One event per recorded proton event; \"none\" restores the beam.");
+  replayCmd.SetParameterName("name", false);
+
+  auto& planCmd = fMessenger->DeclareMethod("plan", &PrimaryGeneratorAction::SetPlanFile,
+    "Spot-scanning treatment plan (see TreatmentPlan.hh) instead of the single\n"
+    "pencil beam; spots are drawn by monitor units. \"none\" restores the beam.");
+  planCmd.SetParameterName("file", false);
+
+  auto& bunchCmd = fMessenger->DeclareProperty("bunchSize", fBunchSize,
+    "Protons per event (mean number with poissonBunch); hits of different protons\n"
+    "can form random coincidences. Plan spot IDs are only kept for 1 proton.");
+  bunchCmd.SetParameterName("n", false);
+  bunchCmd.SetRange("n>=1");
+
+  auto& poissonCmd = fMessenger->DeclareProperty("poissonBunch", fPoissonBunch,
+    "Draw the number of protons of each event from a Poisson distribution.");
+  poissonCmd.SetParameterName("flag", true);
+  poissonCmd.SetDefaultValue("true");
+
+  auto& lengthCmd = fMessenger->DeclarePropertyWithUnit("bunchLength", "ns", fBunchLength,
+    "Time over which the protons of an event are spread uniformly.");
+  lengthCmd.SetParameterName("length", false);
+  lengthCmd.SetRange("length>=0.");
+
+  auto& periodCmd = fMessenger->DeclarePropertyWithUnit("rfPeriod", "ns", fRFPeriod,
+    "RF period of the accelerator (e.g. 9.4 ns for a 106 MHz cyclotron);\n"
+    "0 for a continuous beam.");
+  periodCmd.SetParameterName("period", false);
+  periodCmd.SetRange("period>=0.");
+
+  auto& widthCmd = fMessenger->DeclarePropertyWithUnit("rfWidth", "ns", fRFWidth,
+    "Gaussian width (sigma) of the micro-bunches of the RF period.");
+  widthCmd.SetParameterName("width", false);
+  widthCmd.SetRange("width>=0.");
+}
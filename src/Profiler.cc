@@ -0,0 +1,143 @@
+#ifdef B4C_PROFILING
+
+#include "Profiler.hh"
+
+#include "Sharding.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4ParticleDefinition.hh"
+#include "G4VProcess.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <tuple>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Profiler* Profiler::Instance()
+{
+  static Profiler instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Profiler::Profiler()
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Profiler::~Profiler()
+{
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Profiler::EndRun()
+{
+  // Entries are summed by name, pointers may differ between threads
+  using NameKey = std::tuple<G4String, G4String, G4String>;
+  std::map<NameKey, Entry> merged;
+  Entry total;
+  fTables.ForEach([&merged, &total](Table& table) {
+    for (auto& [key, entry] : table) {
+      // Entries of earlier runs stay zeroed, their volume may be gone
+      if (entry.steps == 0) continue;
+      NameKey name{key.volume ? key.volume->GetName() : G4String("OutOfWorld"),
+                   key.particle->GetParticleName(),
+                   key.creator ? key.creator->GetProcessName() : G4String("primary")};
+      auto& sum = merged[name];
+      sum.steps += entry.steps;
+      sum.tracks += entry.tracks;
+      sum.time += entry.time;
+      total.steps += entry.steps;
+      total.tracks += entry.tracks;
+      total.time += entry.time;
+      // Every run is profiled on its own. The entries are zeroed, not
+      // erased: the profiling actions keep a pointer to their last one
+      entry = Entry();
+    }
+  });
+  if (merged.empty()) return;
+
+  std::vector<std::pair<NameKey, Entry>> ranked(merged.begin(), merged.end());
+  std::sort(ranked.begin(), ranked.end(),
+            [](const auto& a, const auto& b) { return a.second.time > b.second.time; });
+
+  auto seconds = [](Clock::duration time) { return std::chrono::duration<G4double>(time).count(); };
+  auto totalSeconds = seconds(total.time);
+  auto fraction = [totalSeconds, &seconds](const Entry& entry) {
+    return totalSeconds > 0. ? seconds(entry.time) / totalSeconds : 0.;
+  };
+
+  G4cout << G4endl << "--------------------Transport hotspots----------------------" << G4endl
+         << " " << total.steps << " steps, " << total.tracks << " tracks, " << totalSeconds
+         << " s (all threads)" << G4endl << std::setw(12) << "volume" << std::setw(12)
+         << "particle" << std::setw(18) << "creator" << std::setw(12) << "steps" << std::setw(10)
+         << "tracks" << std::setw(10) << "time [s]" << std::setw(8) << "%" << std::setw(10)
+         << "ns/step" << G4endl;
+  auto nofPrinted = std::min<std::size_t>(ranked.size(), std::max(fNofPrinted, 0));
+  for (std::size_t i = 0; i < nofPrinted; ++i) {
+    const auto& [name, entry] = ranked[i];
+    G4cout << std::setw(12) << std::get<0>(name) << std::setw(12) << std::get<1>(name)
+           << std::setw(18) << std::get<2>(name) << std::setw(12) << entry.steps << std::setw(10)
+           << entry.tracks << std::setw(10) << std::setprecision(3) << seconds(entry.time)
+           << std::setw(8) << std::setprecision(3) << 100. * fraction(entry) << std::setw(10)
+           << std::setprecision(4) << (entry.steps ? 1e9 * seconds(entry.time) / entry.steps : 0.)
+           << G4endl;
+  }
+  G4cout << std::setprecision(6) << "------------------------------------------------------------"
+         << G4endl;
+
+  if (fFileName.empty()) return;
+
+  auto fileName = Sharding::Instance()->TagFileName(fFileName);
+  std::ofstream csv(fileName);
+  if (!csv) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open profile file " << fileName;
+    G4Exception("Profiler::EndRun()", "MyCode0013", JustWarning, msg);
+    return;
+  }
+  csv << "volume,particle,creator,steps,tracks,time_s,time_fraction\n";
+  for (const auto& [name, entry] : ranked) {
+    csv << std::get<0>(name) << "," << std::get<1>(name) << "," << std::get<2>(name) << ","
+        << entry.steps << "," << entry.tracks << "," << seconds(entry.time) << ","
+        << fraction(entry) << "\n";
+  }
+  G4cout << "Profile written to " << fileName << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Profiler::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/profile/", "Transport time profiling");
+
+  auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+    "Profile steps, tracks and time per volume, particle and creator process\n"
+    "from the next run on; the threads keep profiling until the end of the job.");
+  enableCmd.SetParameterName("flag", true);
+  enableCmd.SetDefaultValue("true");
+  enableCmd.SetToBeBroadcasted(false);
+
+  auto& fileCmd = fMessenger->DeclareProperty("fileName", fFileName,
+    "CSV file of the profile, rewritten at the end of each run; empty for none.");
+  fileCmd.SetParameterName("name", true);
+  fileCmd.SetDefaultValue("");
+  fileCmd.SetToBeBroadcasted(false);
+
+  auto& printCmd = fMessenger->DeclareProperty("print", fNofPrinted,
+    "Number of hotspots printed at the end of the run.");
+  printCmd.SetParameterName("n", false);
+  printCmd.SetRange("n>=0");
+  printCmd.SetToBeBroadcasted(false);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifdef B4C_PROFILING
+
+#include "ProfilingAction.hh"
+
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4VPhysicalVolume.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ProfilingAction::ProfilingAction(G4UserSteppingAction* next)
+  : fNext(next), fTable(Profiler::Instance()->GetThreadTable()), fLastTime(Profiler::Clock::now())
+{}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ProfilingAction::~ProfilingAction()
+{
+  delete fNext;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ProfilingAction::SetNext(G4UserSteppingAction* next)
+{
+  delete fNext;
+  fNext = next;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ProfilingAction::UserSteppingAction(const G4Step* step)
+{
+  auto now = Profiler::Clock::now();
+  auto track = step->GetTrack();
+  auto firstStep = track->GetCurrentStepNumber() == 1;
+
+  Profiler::Key key{step->GetPreStepPoint()->GetPhysicalVolume()->GetLogicalVolume(),
+                    track->GetParticleDefinition(), track->GetCreatorProcess()};
+
+  // Consecutive steps mostly share their key, the map is searched on a change
+  if (!fLastEntry || !(key == fLastKey)) {
+    fLastEntry = &(*fTable)[key];
+    fLastKey = key;
+  }
+
+  ++fLastEntry->steps;
+  if (firstStep) ++fLastEntry->tracks;
+
+  // The first step of an event (primary track 1) would carry the time
+  // between the events
+  if (!(firstStep && track->GetTrackID() == 1)) {
+    fLastEntry->time += now - fLastTime;
+  }
+  fLastTime = now;
+
+  if (fNext) fNext->UserSteppingAction(step);
+}
+
+#endif
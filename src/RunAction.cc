@@ -1,15 +1,44 @@
 #include "RunAction.hh"
 
+#include "AcceptanceFilter.hh"
+#include "AdaptiveRun.hh"
+#include "AsyncWriter.hh"
+#include "Checkpoint.hh"
+#include "ColumnOutput.hh"
+#include "Digitizer.hh"
+#include "EmissionMap.hh"
+#include "OnlineImage.hh"
+#include "PhaseSpace.hh"
+#include "ProfilingAction.hh"
+#include "Sharding.hh"
+#include "Startup.hh"
+#include "SteppingAction.hh"
+#include "Telemetry.hh"
+
+#include "G4AccumulableManager.hh"
 #include "G4AnalysisManager.hh"
+#include "G4EventManager.hh"
+#include "G4GenericMessenger.hh"
+#include "G4Run.hh"
 #include "G4RunManager.hh"
 #include "G4SystemOfUnits.hh"
+#include "G4Threading.hh"
 #include "G4UnitsTable.hh"
 #include "globals.hh"
 
-RunAction::RunAction()
+RunAction::RunAction() : fCheckpointInterval(600. * s), fMetricsInterval(10. * s)
 {
-  // set printing event number per each event
-  G4RunManager::GetRunManager()->SetPrintProgress(1);
+  // Progress is printed only on request (/run/printProgress), live
+  // throughput goes to the metrics file (/B4c/output/metricsFile)
+
+  // Created with the master run action, their commands exist before the macro runs
+  Digitizer::Instance();
+  AcceptanceFilter::Instance();
+  OnlineImage::Instance();
+  AdaptiveRun::Instance();
+#ifdef B4C_PROFILING
+  Profiler::Instance();
+#endif
 
   // Create analysis manager
   // The choice of the output format is done via the specified
@@ -20,7 +49,7 @@ RunAction::RunAction()
   // analysisManager->SetHistoDirectoryName("histograms");
   // analysisManager->SetNtupleDirectoryName("ntuple");
   analysisManager->SetVerboseLevel(1);
-  analysisManager->SetNtupleMerging(true);
+  // Ntuple merging is switched in BeginOfRunAction, see /B4c/output/perThreadFiles
   // Note: merging ntuples is available only with Root output
 
   // Book histograms, ntuple
@@ -43,6 +72,9 @@ RunAction::RunAction()
   analysisManager->CreateNtupleDColumn(fDetectionNtupleID, "absoPosiZ");
   analysisManager->CreateNtupleDColumn(fDetectionNtupleID, "scatEdep");
   analysisManager->CreateNtupleDColumn(fDetectionNtupleID, "absoEdep");
+  analysisManager->CreateNtupleIColumn(fDetectionNtupleID, "spotID");
+  analysisManager->CreateNtupleDColumn(fDetectionNtupleID, "time");
+  analysisManager->CreateNtupleDColumn(fDetectionNtupleID, "weight");
   analysisManager->FinishNtuple();
 
   // Creating ntuple for prompt gamma record
@@ -53,35 +85,245 @@ RunAction::RunAction()
   analysisManager->CreateNtupleDColumn(fPromptNtupleID, "PosiX");
   analysisManager->CreateNtupleDColumn(fPromptNtupleID, "PosiY");
   analysisManager->CreateNtupleDColumn(fPromptNtupleID, "PosiZ");
+  analysisManager->CreateNtupleIColumn(fPromptNtupleID, "creatorProcess");
+  analysisManager->CreateNtupleIColumn(fPromptNtupleID, "parentPDG");
+  analysisManager->CreateNtupleIColumn(fPromptNtupleID, "spotID");
+  analysisManager->FinishNtuple();
+
+  // Creating ntuple for the pixels hit, empty unless the camera is pixelated
+  //
+  fPixelNtupleID = analysisManager->CreateNtuple("Pixel", "Energy per pixel hit");
+  analysisManager->CreateNtupleIColumn(fPixelNtupleID, "eventID");
+  analysisManager->CreateNtupleIColumn(fPixelNtupleID, "layer");
+  analysisManager->CreateNtupleIColumn(fPixelNtupleID, "pixelID");
+  analysisManager->CreateNtupleDColumn(fPixelNtupleID, "edep");
+  analysisManager->CreateNtupleDColumn(fPixelNtupleID, "time");
   analysisManager->FinishNtuple();
-  
+
+  BookColumns();
+
+  // Prompt-gamma emission map, reduced over the threads at the end of run
+  fEmissionMap = new EmissionMap;
+  G4AccumulableManager::Instance()->Register(fEmissionMap);
+
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::BookColumns()
+{
+  // Same layout as the ntuples, written when /B4c/output/columnDirectory is set
+  auto columns = ColumnOutput::Instance();
+
+  fDetectionTableID = columns->CreateTable("Detection");
+  columns->CreateIColumn(fDetectionTableID, "eventID");
+  columns->CreateDColumn(fDetectionTableID, "scatPosiX");
+  columns->CreateDColumn(fDetectionTableID, "scatPosiY");
+  columns->CreateDColumn(fDetectionTableID, "scatPosiZ");
+  columns->CreateDColumn(fDetectionTableID, "absoPosiX");
+  columns->CreateDColumn(fDetectionTableID, "absoPosiY");
+  columns->CreateDColumn(fDetectionTableID, "absoPosiZ");
+  columns->CreateDColumn(fDetectionTableID, "scatEdep");
+  columns->CreateDColumn(fDetectionTableID, "absoEdep");
+  columns->CreateIColumn(fDetectionTableID, "spotID");
+  columns->CreateDColumn(fDetectionTableID, "time");
+  columns->CreateDColumn(fDetectionTableID, "weight");
+
+  fPromptTableID = columns->CreateTable("PromptGamma");
+  columns->CreateIColumn(fPromptTableID, "eventID");
+  columns->CreateDColumn(fPromptTableID, "Energy");
+  columns->CreateDColumn(fPromptTableID, "PosiX");
+  columns->CreateDColumn(fPromptTableID, "PosiY");
+  columns->CreateDColumn(fPromptTableID, "PosiZ");
+  columns->CreateIColumn(fPromptTableID, "creatorProcess");
+  columns->CreateIColumn(fPromptTableID, "parentPDG");
+  columns->CreateIColumn(fPromptTableID, "spotID");
+
+  fPixelTableID = columns->CreateTable("Pixel");
+  columns->CreateIColumn(fPixelTableID, "eventID");
+  columns->CreateIColumn(fPixelTableID, "layer");
+  columns->CreateIColumn(fPixelTableID, "pixelID");
+  columns->CreateDColumn(fPixelTableID, "edep");
+  columns->CreateDColumn(fPixelTableID, "time");
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-void RunAction::BeginOfRunAction(const G4Run* /*run*/)
+RunAction::~RunAction()
+{
+  delete fPhaseSpaceWriter;
+  delete fEmissionMap;
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EmissionMap* RunAction::GetEmissionMap() const
+{
+  return fEmissionMap->IsEnabled() ? fEmissionMap : nullptr;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::BeginOfRunAction(const G4Run* run)
 {
   // inform the runManager to save random number seed
   // G4RunManager::GetRunManager()->SetRandomNumberStore(true);
 
+  // Startup breakdown, and the table cache filled, before the run is timed
+  if (IsMaster()) Startup::Instance()->BeginRun();
+
+  // The camera box is set before the workers start the run
+  if (IsMaster()) AcceptanceFilter::Instance()->BeginRun();
+
+  // Threads processing events get the stepping actions once enabled;
+  // without them no stepping action runs at all
+  auto processesEvents = !IsMaster() || !G4Threading::IsMultithreadedApplication();
+  if (!fFiltering && processesEvents && AcceptanceFilter::Instance()->IsEnabled()) {
+    auto filterAction = new SteppingAction;
+#ifdef B4C_PROFILING
+    if (fProfilingAction) {
+      fProfilingAction->SetNext(filterAction);
+    }
+    else {
+      G4RunManager::GetRunManager()->SetUserAction(filterAction);
+    }
+#else
+    G4RunManager::GetRunManager()->SetUserAction(filterAction);
+#endif
+    fFiltering = true;
+  }
+
+#ifdef B4C_PROFILING
+  if (!fProfilingAction && processesEvents && Profiler::Instance()->IsEnabled()) {
+    // The profiling action takes over the stepping action and calls it
+    auto eventManager = G4EventManager::GetEventManager();
+    fProfilingAction = new ProfilingAction(eventManager->GetUserSteppingAction());
+    G4RunManager::GetRunManager()->SetUserAction(fProfilingAction);
+  }
+#endif
+
+  fTimer.Start();
+
+  auto sharding = Sharding::Instance();
+  auto checkpoint = Checkpoint::Instance();
+  if (IsMaster()) {
+    sharding->BeginRun(run->GetRunID(), run->GetNumberOfEventToBeProcessed());
+    checkpoint->BeginRun(run->GetRunID(), run->GetNumberOfEventToBeProcessed(),
+                         sharding->GetEventOffset(), G4AnalysisManager::Instance()->GetNofH1s(),
+                         sharding->TagFileName(fCheckpointFile), fCheckpointEvents,
+                         fCheckpointInterval / s);
+
+    // Only the histograms and the column tables are restored from the
+    // checkpoint; the other outputs would silently lose the earlier events
+    auto unrestorable = fRootNtuples || !fPhaseSpaceFileName.empty() || fEmissionMap->IsEnabled();
+    if (unrestorable && (checkpoint->IsResuming() || !fCheckpointFile.empty())) {
+      G4ExceptionDescription msg;
+      msg << "A resumed run cannot restore the ROOT ntuples, the phase-space files or the"
+          << " emission map: set /B4c/output/rootNtuples false, and no phaseSpaceFile or"
+          << " /B4c/emission/fileName, to resume a run.";
+      G4Exception("RunAction::BeginOfRunAction()", "MyCode0010",
+                  checkpoint->IsResuming() ? FatalException : JustWarning, msg);
+      if (checkpoint->IsResuming()) return;
+    }
+  }
+
+  fEmissionMap->SetBoxFromTarget();
+  G4AccumulableManager::Instance()->Reset();
+
   // Get analysis manager
   auto analysisManager = G4AnalysisManager::Instance();
 
   // Open an output file
   //
-  G4String fileName = "../output/simulation.root";
+  G4String fileName = sharding->TagFileName(fOutputFileName);
   // Other supported output types:
   // G4String fileName = "B4.csv";
   // G4String fileName = "B4.hdf5";
   // G4String fileName = "B4.xml";
+
+  // Without merging each worker streams its ntuple rows into its own file,
+  // <name>_run<runID>_t<threadID>.root; histograms still go to the master.
+  // Combine them with the mergeOutput tool.
+  analysisManager->SetNtupleMerging(!fPerThreadFiles);
+  if (fPerThreadFiles) {
+    auto extension = fileName.rfind('.');
+    auto runTag = "_run" + std::to_string(run->GetRunID());
+    if (extension == std::string::npos) {
+      fileName += runTag;
+    }
+    else {
+      fileName.insert(extension, runTag);
+    }
+  }
   analysisManager->OpenFile(fileName);
   G4cout << "Using " << analysisManager->GetType() << G4endl;
+  if (IsMaster()) checkpoint->RestoreHistograms();
+
+  if (!fColumnDirectory.empty() && IsMaster()) {
+    auto directory = sharding->TagFileName(fColumnDirectory);
+    if (checkpoint->IsResuming()) {
+      ColumnOutput::Instance()->Resume(directory, checkpoint->GetResumeRows(),
+                                       [checkpoint](G4int eventID) {
+                                         return checkpoint->IsCompleted(eventID);
+                                       });
+    }
+    else {
+      ColumnOutput::Instance()->Open(directory);
+    }
+    if (fAsyncWriter) {
+      AsyncWriter::Instance()->SetRingCapacity(fRingCapacity);
+      AsyncWriter::Instance()->Start(fDetectionTableID, fPromptTableID, fPixelTableID);
+    }
+  }
+
+  // Sampled after the output files are open, the byte counts start from them
+  if (IsMaster()) {
+    Telemetry::Instance()->Start(fMetricsFile, fMetricsInterval / s, run->GetRunID(),
+                                 run->GetNumberOfEventToBeProcessed());
+    OnlineImage::Instance()->Start(run->GetRunID());
+    AdaptiveRun::Instance()->Start();
+  }
+
+  // Prompt gammas are recorded by the threads processing events,
+  // each into its own phase-space file
+  if (!fPhaseSpaceFileName.empty() && (!IsMaster() || !G4Threading::IsMultithreadedApplication()))
+  {
+    G4String phaseSpaceFile = sharding->TagFileName(fPhaseSpaceFileName);
+    if (G4Threading::IsMultithreadedApplication()) {
+      phaseSpaceFile += "_t" + std::to_string(G4Threading::G4GetThreadId());
+    }
+    fPhaseSpaceWriter = new PhaseSpaceWriter(phaseSpaceFile + ".phsp");
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-void RunAction::EndOfRunAction(const G4Run* /*run*/)
+void RunAction::EndOfRunAction(const G4Run* run)
 {
+  fTimer.Stop();
+
+  // Workers add their emission maps to the master one
+  G4AccumulableManager::Instance()->Merge();
+
+  // Last snapshot of the threads that processed events, before the
+  // histograms are merged and reset
+  auto checkpoint = Checkpoint::Instance();
+  if (!IsMaster() || !G4Threading::IsMultithreadedApplication()) {
+    checkpoint->EndOfThreadRun();
+  }
+
+  if (IsMaster()) {
+    auto nofEvents = run->GetNumberOfEvent();
+    auto seconds = fTimer.GetRealElapsed();
+    G4cout << G4endl << "--------------------End of Global Run-----------------------" << G4endl
+           << " Run " << run->GetRunID() << ": " << nofEvents << " events in " << seconds
+           << " s";
+    if (seconds > 0.) G4cout << " (" << nofEvents / seconds << " events/s)";
+    G4cout << G4endl << "------------------------------------------------------------" << G4endl;
+  }
+
   // print histogram statistics
   //
   auto analysisManager = G4AnalysisManager::Instance();
@@ -111,4 +353,112 @@ void RunAction::EndOfRunAction(const G4Run* /*run*/)
   //
   analysisManager->Write();
   analysisManager->CloseFile();
+
+  delete fPhaseSpaceWriter;
+  fPhaseSpaceWriter = nullptr;
+
+  // Workers hand over their last rows, the master closes the files
+  // once all workers have finished
+  auto columns = ColumnOutput::Instance();
+  if (IsMaster()) {
+    AsyncWriter::Instance()->Stop();
+    checkpoint->EndRun();
+    columns->Close();
+    Telemetry::Instance()->Stop();
+    OnlineImage::Instance()->Stop();
+    AdaptiveRun::Instance()->Stop();
+    Digitizer::Instance()->EndRun(columns->GetRowSize(fDetectionTableID));
+    AcceptanceFilter::Instance()->EndRun();
+#ifdef B4C_PROFILING
+    Profiler::Instance()->EndRun();
+#endif
+    if (fEmissionMap->IsEnabled()) fEmissionMap->Write();
+  }
+  else {
+    columns->FlushThread();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/output/", "Output control");
+
+  auto& fileNameCmd = fMessenger->DeclareProperty("fileName", fOutputFileName,
+    "Analysis output file; the extension selects the format.");
+  fileNameCmd.SetParameterName("name", false);
+
+  auto& perThreadCmd = fMessenger->DeclareProperty("perThreadFiles", fPerThreadFiles,
+    "Write the ntuples of each worker into its own run/thread tagged file\n"
+    "instead of merging them through the master.");
+  perThreadCmd.SetParameterName("flag", true);
+  perThreadCmd.SetDefaultValue("true");
+
+  auto& columnCmd = fMessenger->DeclareProperty("columnDirectory", fColumnDirectory,
+    "Directory for the columnar binary output (one file per column and a JSON\n"
+    "header per table, see load_columns.py); empty disables it.");
+  columnCmd.SetParameterName("directory", true);
+  columnCmd.SetDefaultValue("");
+
+  auto& ntupleCmd = fMessenger->DeclareProperty("rootNtuples", fRootNtuples,
+    "Fill the Detection and prompt gamma ntuples of the analysis manager.");
+  ntupleCmd.SetParameterName("flag", true);
+  ntupleCmd.SetDefaultValue("true");
+
+  auto& promptRowsCmd = fMessenger->DeclareProperty("promptRows", fPromptRows,
+    "Write one row per prompt gamma (ntuple and columns); the energy histogram\n"
+    "and the emission map (/B4c/emission/) are filled either way.");
+  promptRowsCmd.SetParameterName("flag", true);
+  promptRowsCmd.SetDefaultValue("true");
+
+  auto& pixelRowsCmd = fMessenger->DeclareProperty("pixelRows", fPixelRows,
+    "Write one row per pixel hit (layer 0 scatter, 1 absorber) of the accepted\n"
+    "coincidences when the camera is pixelated (/B4c/camera/).");
+  pixelRowsCmd.SetParameterName("flag", true);
+  pixelRowsCmd.SetDefaultValue("true");
+
+  auto& asyncCmd = fMessenger->DeclareProperty("asyncWriter", fAsyncWriter,
+    "Hand the columnar output records to a dedicated writer thread through\n"
+    "per-thread ring buffers instead of writing them from the event loop.");
+  asyncCmd.SetParameterName("flag", true);
+  asyncCmd.SetDefaultValue("true");
+
+  auto& ringCmd = fMessenger->DeclareProperty("ringCapacity", fRingCapacity,
+    "Records per ring buffer of the asynchronous writer (rounded up to a power of 2).");
+  ringCmd.SetParameterName("records", false);
+  ringCmd.SetRange("records>0");
+
+  auto& checkpointCmd = fMessenger->DeclareProperty("checkpointFile", fCheckpointFile,
+    "Checkpoint file, rewritten periodically during the run; a preempted job\n"
+    "continues with exampleB4c --resume <file> and the same macro. Empty disables it.");
+  checkpointCmd.SetParameterName("name", true);
+  checkpointCmd.SetDefaultValue("");
+
+  auto& checkpointEventsCmd = fMessenger->DeclareProperty("checkpointEvents", fCheckpointEvents,
+    "Events after which a thread hands its completed events to the next checkpoint.");
+  checkpointEventsCmd.SetParameterName("events", false);
+  checkpointEventsCmd.SetRange("events>0");
+
+  auto& checkpointIntervalCmd = fMessenger->DeclarePropertyWithUnit("checkpointInterval", "s",
+    fCheckpointInterval, "Time between two writes of the checkpoint file.");
+  checkpointIntervalCmd.SetParameterName("interval", false);
+  checkpointIntervalCmd.SetRange("interval>0.");
+
+  auto& phaseSpaceCmd = fMessenger->DeclareProperty("phaseSpaceFile", fPhaseSpaceFileName,
+    "Base name of the prompt-gamma phase-space file(s); empty disables writing.\n"
+    "Worker threads write <name>_t<threadID>.phsp, sequential runs <name>.phsp.");
+  phaseSpaceCmd.SetParameterName("name", true);
+  phaseSpaceCmd.SetDefaultValue("");
+
+  auto& metricsCmd = fMessenger->DeclareProperty("metricsFile", fMetricsFile,
+    "JSON-lines file receiving live throughput metrics (events, steps, prompt\n"
+    "gammas, coincidences and bytes written) during the run; empty disables it.");
+  metricsCmd.SetParameterName("name", true);
+  metricsCmd.SetDefaultValue("");
+
+  auto& metricsIntervalCmd = fMessenger->DeclarePropertyWithUnit("metricsInterval", "s",
+    fMetricsInterval, "Time between two samples of the metrics file.");
+  metricsIntervalCmd.SetParameterName("interval", false);
+  metricsIntervalCmd.SetRange("interval>0.");
 }
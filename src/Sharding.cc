@@ -0,0 +1,88 @@
+#include "Sharding.hh"
+
+#include "G4Event.hh"
+#include "Randomize.hh"
+
+#include <limits>
+
+namespace
+{
+// splitmix64 finalizer, decorrelates consecutive inputs
+std::uint64_t Mix(std::uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Sharding* Sharding::Instance()
+{
+  static Sharding instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Sharding::Configure(std::uint64_t masterSeed, G4int shardIndex, G4int nofShards)
+{
+  fMasterSeed = masterSeed;
+  fShardIndex = shardIndex;
+  fNofShards = nofShards;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Sharding::BeginRun(G4int runID, G4int nofEvents)
+{
+  // Event IDs are G4int, the whole sharded run has to fit into them
+  auto offset = static_cast<std::int64_t>(fShardIndex) * nofEvents;
+  if (static_cast<std::int64_t>(fNofShards) * nofEvents > std::numeric_limits<G4int>::max()) {
+    G4ExceptionDescription msg;
+    msg << fNofShards << " shards of " << nofEvents << " events overflow the event ID.";
+    G4Exception("Sharding::BeginRun()", "MyCode0009", FatalException, msg);
+  }
+
+  fRunID.store(runID);
+  fEventOffset.store(static_cast<G4int>(offset));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Sharding::SeedEvent(G4Event* event) const
+{
+  auto globalEventID = event->GetEventID() + fEventOffset.load(std::memory_order_relaxed);
+  event->SetEventID(globalEventID);
+
+  auto key = Mix(Mix(fMasterSeed) ^ static_cast<std::uint64_t>(fRunID.load()));
+  key = Mix(key ^ static_cast<std::uint64_t>(globalEventID));
+
+  // Two positive 31-bit seeds, zero terminated as the engines expect
+  long seeds[3] = {static_cast<long>(key & 0x7fffffff), static_cast<long>((key >> 32) & 0x7fffffff),
+                   0};
+  if (seeds[0] == 0) seeds[0] = 1;
+  if (seeds[1] == 0) seeds[1] = 1;
+  G4Random::setTheSeeds(seeds);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String Sharding::TagFileName(const G4String& name) const
+{
+  if (fNofShards <= 1) return name;
+
+  G4String tagged = name;
+  auto tag = "_shard" + std::to_string(fShardIndex);
+  auto extension = tagged.rfind('.');
+  auto slash = tagged.rfind('/');
+  if (extension == std::string::npos || (slash != std::string::npos && extension < slash)) {
+    tagged += tag;
+  }
+  else {
+    tagged.insert(extension, tag);
+  }
+  return tagged;
+}
@@ -0,0 +1,190 @@
+#include "StackingAction.hh"
+
+#include "EventAction.hh"
+
+#include "G4Event.hh"
+#include "G4EventManager.hh"
+#include "G4Gamma.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4Box.hh"
+#include "G4Neutron.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Track.hh"
+#include "G4TrackingManager.hh"
+#include "G4VProcess.hh"
+#include "Randomize.hh"
+
+#include <cmath>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+StackingAction::StackingAction(EventAction* eventAction) : fEventAction(eventAction)
+{
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+StackingAction::~StackingAction()
+{
+  delete fMessenger;
+  delete fBiasMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ClassificationOfNewTrack StackingAction::ClassifyNewTrack(const G4Track* track)
+{
+  if (!fTargetLV) {
+    fGamma = G4Gamma::Definition();
+    fNeutron = G4Neutron::Definition();
+    fTargetLV = G4LogicalVolumeStore::GetInstance()->GetVolume("Target");
+    SetCamera();
+  }
+
+  if (track->GetDefinition() == fNeutron) return ClassifyNeutron(track);
+
+  if (track->GetDefinition() != fGamma || track->GetParentID() == 0) return fUrgent;
+
+  // Secondaries carry the touchable of the step that created them
+  auto volume = track->GetVolume();
+  if (!volume || volume->GetLogicalVolume() != fTargetLV) return fUrgent;
+
+  auto eventManager = G4EventManager::GetEventManager();
+  auto event = eventManager->GetConstCurrentEvent();
+
+  EventAction::PromptGamma pg;
+  pg.eventID = event ? event->GetEventID() : -1;
+  pg.energy = track->GetKineticEnergy();
+  pg.position = track->GetPosition();
+  pg.direction = track->GetMomentumDirection();
+  pg.time = track->GetGlobalTime();
+  pg.weight = track->GetWeight();
+
+  auto creator = track->GetCreatorProcess();
+  if (creator) pg.creatorProcess = creator->GetProcessSubType();
+
+  // Secondaries are stacked when their parent has been tracked, so the
+  // tracking manager still holds the parent
+  auto parent = eventManager->GetTrackingManager()->GetTrack();
+  if (parent && parent->GetTrackID() == track->GetParentID()) {
+    pg.parentPDG = parent->GetDefinition()->GetPDGEncoding();
+  }
+
+  fEventAction->AddPromptGamma(pg);
+
+  // Not tracked yet, the direction and weight may still be changed
+  if (fConeProbability > 0. && creator && creator->GetProcessType() == fHadronic) {
+    BiasDirection(const_cast<G4Track*>(track));
+  }
+
+  return fUrgent;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ClassificationOfNewTrack StackingAction::ClassifyNeutron(const G4Track* track) const
+{
+  if (fNeutronCreationTimeCut > 0. && track->GetGlobalTime() > fNeutronCreationTimeCut) {
+    return fKill;
+  }
+
+  auto energy = track->GetKineticEnergy();
+  if (energy < fNeutronEnergyCut) return fKill;
+
+  if (energy < fRouletteEnergy) {
+    if (G4UniformRand() >= fRouletteSurvival) return fKill;
+    // the track is not tracked yet, its weight may still be changed
+    const_cast<G4Track*>(track)->SetWeight(track->GetWeight() / fRouletteSurvival);
+  }
+  return fUrgent;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void StackingAction::SetCamera()
+{
+  // Centre and half diagonal of the scatter face
+  auto scatPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("Scat", false);
+  if (!scatPV) return;
+  auto scatBox = dynamic_cast<G4Box*>(scatPV->GetLogicalVolume()->GetSolid());
+  if (!scatBox) return;
+  fCameraCenter = scatPV->GetTranslation();
+  fCameraRadius = std::hypot(scatBox->GetXHalfLength(), scatBox->GetYHalfLength());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void StackingAction::BiasDirection(G4Track* track) const
+{
+  // Cone from the emission point that contains the whole scatter face
+  auto toCamera = fCameraCenter - track->GetPosition();
+  auto distance = toCamera.mag();
+  if (fCameraRadius <= 0. || distance <= fCameraRadius) return;
+  auto cosCone = std::sqrt(1. - fCameraRadius * fCameraRadius / (distance * distance));
+  auto coneFraction = (1. - cosCone) / 2.;  // of the full solid angle
+
+  // Uniform inside the cone with fConeProbability, outside it otherwise
+  G4double cosTheta;
+  auto weight = track->GetWeight();
+  if (G4UniformRand() < fConeProbability) {
+    cosTheta = 1. - G4UniformRand() * (1. - cosCone);
+    weight *= coneFraction / fConeProbability;
+  }
+  else {
+    cosTheta = -1. + G4UniformRand() * (1. + cosCone);
+    weight *= (1. - coneFraction) / (1. - fConeProbability);
+  }
+  auto sinTheta = std::sqrt(1. - cosTheta * cosTheta);
+  auto phi = twopi * G4UniformRand();
+  G4ThreeVector direction(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+  direction.rotateUz(toCamera / distance);
+
+  track->SetMomentumDirection(direction);
+  track->SetWeight(weight);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void StackingAction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/neutron/", "Secondary neutron cuts");
+
+  // Tested when the neutron is stacked: its global time of creation, not
+  // the time it reaches while it is transported
+  auto& timeCmd = fMessenger->DeclarePropertyWithUnit("creationTimeCut", "ns",
+    fNeutronCreationTimeCut,
+    "Kill neutrons created later than this global time; 0 disables the cut.");
+  timeCmd.SetParameterName("time", false);
+  timeCmd.SetRange("time>=0.");
+
+  auto& energyCmd = fMessenger->DeclarePropertyWithUnit("energyCut", "MeV", fNeutronEnergyCut,
+    "Kill neutrons created with a lower kinetic energy; 0 disables the cut.");
+  energyCmd.SetParameterName("energy", false);
+  energyCmd.SetRange("energy>=0.");
+
+  auto& rouletteCmd = fMessenger->DeclarePropertyWithUnit("rouletteEnergy", "MeV",
+    fRouletteEnergy,
+    "Russian roulette for neutrons created below this kinetic energy; survivors\n"
+    "and their secondaries (prompt gammas included) get the weight 1/survival.\n"
+    "0 disables the roulette.");
+  rouletteCmd.SetParameterName("energy", false);
+  rouletteCmd.SetRange("energy>=0.");
+
+  auto& survivalCmd = fMessenger->DeclareProperty("rouletteSurvival", fRouletteSurvival,
+    "Survival probability of the Russian roulette.");
+  survivalCmd.SetParameterName("probability", false);
+  survivalCmd.SetRange("probability>0. && probability<=1.");
+
+  fBiasMessenger = new G4GenericMessenger(this, "/B4c/bias/", "Prompt-gamma directional biasing");
+
+  auto& coneCmd = fBiasMessenger->DeclareProperty("coneProbability", fConeProbability,
+    "Probability to emit a prompt gamma into the cone covering the scatter;\n"
+    "hits, coincidences and spectra carry the compensating weight. 0 disables it.");
+  coneCmd.SetParameterName("probability", false);
+  coneCmd.SetRange("probability>=0. && probability<1.");
+}
@@ -0,0 +1,171 @@
+#include "Startup.hh"
+
+#include "G4StateManager.hh"
+#include "G4VStateDependent.hh"
+#include "G4VUserPhysicsList.hh"
+
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+// Written once all tables are stored, a partly filled cache is not used
+const char* kCompleteMarker = "cache_complete";
+
+G4double Seconds(std::chrono::steady_clock::duration duration)
+{
+  return std::chrono::duration<G4double>(duration).count();
+}
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Registered with the state manager of the master, which deletes it
+class Startup::StateObserver : public G4VStateDependent
+{
+  public:
+    explicit StateObserver(Startup* startup) : fStartup(startup) {}
+
+    G4bool Notify(G4ApplicationState requestedState) override
+    {
+      // Called before the change, the current state is still the previous one
+      fStartup->StateChanged(G4StateManager::GetStateManager()->GetCurrentState(), requestedState);
+      return true;
+    }
+
+  private:
+    Startup* fStartup;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Startup* Startup::Instance()
+{
+  static Startup instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Startup::Startup() : fStart(Clock::now())
+{
+  new StateObserver(this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool Startup::UsePhysicsTableCache(G4VUserPhysicsList* physicsList, const G4String& directory,
+                                     const G4String& physicsListName)
+{
+  fPhysicsList = physicsList;
+  fTableDirectory = directory + "/" + physicsListName;
+  fTablesCached = std::ifstream(fTableDirectory + "/" + kCompleteMarker).good();
+  if (fTablesCached) {
+    physicsList->SetPhysicsTableRetrieved(fTableDirectory);
+  }
+  return fTablesCached;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Startup::GeometryDone()
+{
+  if (fStage == 1) fGeometryDone = Clock::now();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Startup::StateChanged(G4ApplicationState previousState, G4ApplicationState newState)
+{
+  // PreInit -> Init -> Idle: /run/initialize, geometry then physics;
+  // Idle -> Init -> Idle: first run initialization, building the tables
+  auto now = Clock::now();
+  if (fStage == 0 && previousState == G4State_PreInit && newState == G4State_Init) {
+    fInitStart = fGeometryDone = now;
+    fStage = 1;
+  }
+  else if (fStage == 1 && previousState == G4State_Init && newState == G4State_Idle) {
+    fPhysicsDone = now;
+    fStage = 2;
+  }
+  else if (fStage == 2 && previousState == G4State_Idle && newState == G4State_Init) {
+    fTablesStart = now;
+    fStage = 3;
+  }
+  else if (fStage == 3 && previousState == G4State_Init && newState == G4State_Idle) {
+    fTablesDone = now;
+    fStage = 4;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Startup::BeginRun()
+{
+  if (fReported.load() || fStage < 4) return;
+
+  fRunStart = Clock::now();
+  G4cout << G4endl << "--------------------Startup time----------------------------" << G4endl
+         << " setup (run manager, physics list, UI) : " << Seconds(fInitStart - fStart) << " s"
+         << G4endl << " geometry                              : "
+         << Seconds(fGeometryDone - fInitStart) << " s" << G4endl
+         << " physics                               : " << Seconds(fPhysicsDone - fGeometryDone)
+         << " s" << G4endl << " physics tables                        : "
+         << Seconds(fTablesDone - fTablesStart) << " s";
+  if (fPhysicsList) {
+    G4cout << (fTablesCached ? " (retrieved from " : " (built, cached in ") << fTableDirectory
+           << ")";
+  }
+  G4cout << G4endl << " until the run start                   : " << Seconds(fRunStart - fStart)
+         << " s" << G4endl << "------------------------------------------------------------"
+         << G4endl;
+
+  if (fPhysicsList && !fTablesCached) StorePhysicsTables();
+
+  // Events of the first run may start now
+  fReported.store(true);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Startup::FirstEvent()
+{
+  G4bool done = false;
+  if (!fFirstEventDone.compare_exchange_strong(done, true)) return;
+
+  auto now = Clock::now();
+  G4cout << "Startup: first event done " << Seconds(now - fRunStart)
+         << " s after the run start (worker initialization included), "
+         << Seconds(now - fStart) << " s after the job start" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Startup::StorePhysicsTables()
+{
+  // Written aside and renamed, so that concurrent jobs (shards) starting
+  // with an empty cache never see a partly written directory
+  auto temporary = fTableDirectory + ".tmp" + std::to_string(getpid());
+  std::error_code error;
+  std::filesystem::create_directories(temporary.c_str(), error);
+
+  auto start = Clock::now();
+  if (error || !fPhysicsList->StorePhysicsTable(temporary)) {
+    G4ExceptionDescription msg;
+    msg << "Cannot store the physics tables in " << temporary;
+    G4Exception("Startup::StorePhysicsTables()", "MyCode0011", JustWarning, msg);
+    std::filesystem::remove_all(temporary.c_str(), error);
+    return;
+  }
+  std::ofstream(temporary + "/" + kCompleteMarker) << "complete\n";
+
+  std::filesystem::rename(temporary.c_str(), fTableDirectory.c_str(), error);
+  if (error) {
+    // Another job filled the cache first
+    std::filesystem::remove_all(temporary.c_str(), error);
+    return;
+  }
+  G4cout << "Physics tables stored in " << fTableDirectory << " (" << Seconds(Clock::now() - start)
+         << " s)" << G4endl;
+}
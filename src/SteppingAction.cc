@@ -1,45 +1,52 @@
 #include "SteppingAction.hh"
 
-#include "DetectorConstruction.hh"
-#include "EventAction.hh"
-
 #include "G4Step.hh"
 #include "G4Track.hh"
-#include "G4EventManager.hh"
-#include "G4RunManager.hh"
-#include "G4SystemOfUnits.hh"
-#include "globals.hh"
+#include "G4VPhysicalVolume.hh"
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-SteppingAction::SteppingAction(EventAction* eventAction) : fEventAction(eventAction)
-{}
+SteppingAction::SteppingAction() : fFilter(AcceptanceFilter::Instance()) {}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void SteppingAction::UserSteppingAction(const G4Step* step)
 {
-  // Detect prompt gammas: first step of a gamma created in the Target with very small local time
   auto track = step->GetTrack();
-  if (track->GetDefinition()->GetParticleName() == "gamma") {
-    if (track->GetCurrentStepNumber() == 1 && track->GetParentID() != 0) {
-      auto creVol = step->GetPreStepPoint()->GetTouchableHandle()->GetVolume();
-      if (creVol && std::string(creVol->GetName()) == "Target") {
-        // extract kinematics
-        G4double energy = track->GetKineticEnergy();
-        G4ThreeVector pos = step->GetPreStepPoint()->GetPosition();
-        // get current event id
-        auto evt = G4EventManager::GetEventManager()->GetConstCurrentEvent();
-        G4int eventID = evt ? evt->GetEventID() : -1;
-
-        EventAction::PromptGamma pg;
-        pg.eventID = eventID;
-        pg.energy = energy;
-        pg.position = pos;
-        if (fEventAction) fEventAction->AddPromptGamma(pg);
-      }
+  if (track == fProbe && track->GetTrackID() == fProbeID) {
+    auto status = track->GetTrackStatus();
+    if (status == fStopAndKill || status == fKillTrackAndSecondaries) {
+      fFilter->CountProbe(fProbeCategory, track->GetCurrentStepNumber() - fProbeStart);
+      fProbe = nullptr;
     }
+    return;
   }
-}
 
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+  if (!fFilter->IsEnabled()) return;
+
+  // Only the step out of the Target, into the World
+  auto postStepPoint = step->GetPostStepPoint();
+  if (postStepPoint->GetStepStatus() != fGeomBoundary) return;
+  if (step->GetPreStepPoint()->GetPhysicalVolume()->GetLogicalVolume() != fFilter->GetTargetLV()) {
+    return;
+  }
+  if (track->GetTrackStatus() != fAlive) return;
+
+  auto category = fFilter->GetCategory(track->GetParticleDefinition());
+  switch (fFilter->Decide(category, postStepPoint->GetPosition(),
+                          postStepPoint->GetMomentumDirection()))
+  {
+    case AcceptanceFilter::kReject:
+      // The secondaries of this step are still stacked
+      const_cast<G4Track*>(track)->SetTrackStatus(fStopAndKill);
+      break;
+    case AcceptanceFilter::kProbe:
+      fProbe = track;
+      fProbeID = track->GetTrackID();
+      fProbeStart = track->GetCurrentStepNumber();
+      fProbeCategory = category;
+      break;
+    case AcceptanceFilter::kPass:
+      break;
+  }
+}
@@ -0,0 +1,125 @@
+#include "Telemetry.hh"
+
+#include "ColumnOutput.hh"
+#include "Sharding.hh"
+
+#include <cstdio>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Telemetry* Telemetry::Instance()
+{
+  static Telemetry instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Telemetry::~Telemetry()
+{
+  Stop();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Telemetry::Totals Telemetry::Sum()
+{
+  Totals totals;
+  fCounters.ForEach([&totals](const Counters& counters) {
+    totals.events += counters.events.load(std::memory_order_relaxed);
+    totals.steps += counters.steps.load(std::memory_order_relaxed);
+    totals.promptGammas += counters.promptGammas.load(std::memory_order_relaxed);
+    totals.coincidences += counters.coincidences.load(std::memory_order_relaxed);
+    totals.bytes += counters.bytes.load(std::memory_order_relaxed);
+  });
+  totals.bytes += ColumnOutput::Instance()->GetBytesWritten();
+  return totals;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Telemetry::Start(const G4String& fileName, G4double interval, G4int runID, G4int nofEvents)
+{
+  Stop();
+  if (fileName.empty()) return;
+
+  // Appended, the samples of all runs of a job go to one file
+  auto name = Sharding::Instance()->TagFileName(fileName);
+  fFile = std::fopen(name.c_str(), "a");
+  if (!fFile) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open metrics file " << name;
+    G4Exception("Telemetry::Start()", "MyCode0012", JustWarning, msg);
+    return;
+  }
+
+  fInterval = std::chrono::duration<G4double>(interval);
+  fRunID = runID;
+  fNofEvents = nofEvents;
+  fRunStart = fLastTime = std::chrono::steady_clock::now();
+  fRunBase = fLast = Sum();
+
+  fStopRequested = false;
+  fSampler = std::thread(&Telemetry::SampleLoop, this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Telemetry::Stop()
+{
+  if (!fSampler.joinable()) return;
+
+  {
+    std::lock_guard<std::mutex> lock(fStopMutex);
+    fStopRequested = true;
+  }
+  fStopCondition.notify_all();
+  fSampler.join();
+
+  WriteSample(true);
+  std::fclose(fFile);
+  fFile = nullptr;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Telemetry::SampleLoop()
+{
+  std::unique_lock<std::mutex> lock(fStopMutex);
+  while (!fStopCondition.wait_for(lock, fInterval, [this]() { return fStopRequested; })) {
+    lock.unlock();
+    WriteSample(false);
+    lock.lock();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Telemetry::WriteSample(G4bool last)
+{
+  auto now = std::chrono::steady_clock::now();
+  auto totals = Sum();
+  auto seconds = std::chrono::duration<G4double>(now - fLastTime).count();
+  auto rate = [seconds](std::uint64_t current, std::uint64_t previous) {
+    return seconds > 0. ? (current - previous) / seconds : 0.;
+  };
+
+  // Rates over the last interval, counts since the start of the run
+  std::fprintf(fFile,
+               "{\"time\": %.3f, \"run\": %d, \"shard\": %d, \"events\": %llu, "
+               "\"eventsToProcess\": %d, \"events_per_s\": %.2f, \"steps_per_s\": %.1f, "
+               "\"prompt_gammas_per_s\": %.2f, \"coincidences_per_s\": %.2f, "
+               "\"bytes_written\": %llu, \"bytes_per_s\": %.1f, \"final\": %s}\n",
+               std::chrono::duration<G4double>(now - fRunStart).count(), fRunID,
+               Sharding::Instance()->GetShardIndex(),
+               static_cast<unsigned long long>(totals.events - fRunBase.events), fNofEvents,
+               rate(totals.events, fLast.events), rate(totals.steps, fLast.steps),
+               rate(totals.promptGammas, fLast.promptGammas),
+               rate(totals.coincidences, fLast.coincidences),
+               static_cast<unsigned long long>(totals.bytes - fRunBase.bytes),
+               rate(totals.bytes, fLast.bytes), last ? "true" : "false");
+  std::fflush(fFile);
+
+  fLast = totals;
+  fLastTime = now;
+}
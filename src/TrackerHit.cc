@@ -38,7 +38,10 @@ void TrackerHit::Print()
 {
   G4cout << "  trackID: " << fTrackID << "Edep: " << std::setw(7)
          << G4BestUnit(fEdep, "Energy") << " Position: " << std::setw(7)
-         << G4BestUnit(fPos, "Length") << G4endl;
+         << G4BestUnit(fPos, "Length") << " Time: " << G4BestUnit(fTime, "Time");
+  if (fNofInteractions > 1) G4cout << " Interactions: " << fNofInteractions;
+  if (fWeight != 1.) G4cout << " Weight: " << fWeight;
+  G4cout << G4endl;
 }
 
 
@@ -1,16 +1,30 @@
 #include "TrackerSD.hh"
 
 #include "G4EventManager.hh"
+#include "G4GenericMessenger.hh"
 #include "G4HCofThisEvent.hh"
 #include "G4SDManager.hh"
 #include "G4Step.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 TrackerSD::TrackerSD(const G4String& name, const G4String& hitsCollectionName)
- : G4VSensitiveDetector(name)
+ : G4VSensitiveDetector(name), fMergeDistance(5. * mm)
 {
   collectionName.insert(hitsCollectionName);
+
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+TrackerSD::~TrackerSD()
+{
+  delete fMessenger;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -23,6 +37,11 @@ void TrackerSD::Initialize(G4HCofThisEvent* hce)
   // Add these collections in hce
   auto hcID = G4SDManager::GetSDMpointer()->GetCollectionID(collectionName[0]);
   hce->AddHitsCollection(hcID, fHitsCollection);
+
+  for (std::size_t i = 0; i < fNofClusters; ++i) {
+    fClusters[i] = Cluster();
+  }
+  fNofClusters = 0;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -30,16 +49,23 @@ void TrackerSD::Initialize(G4HCofThisEvent* hce)
 G4bool TrackerSD::ProcessHits(G4Step* step, G4TouchableHistory*)
 {
   // energy deposit
-  auto track = step->GetTrack();
   G4double edep = step->GetTotalEnergyDeposit();
 
   if (edep == 0.) return false;
 
+  if (fClustering != Clustering::None) {
+    AddToClusters(step->GetTrack()->GetTrackID(), edep, step->GetPostStepPoint()->GetPosition(),
+                  step->GetPostStepPoint()->GetGlobalTime(), step->GetTrack()->GetWeight());
+    return true;
+  }
+
   auto newHit = new TrackerHit();
 
   newHit->SetTrackID(step->GetTrack()->GetTrackID());
   newHit->SetEdep(edep);
   newHit->SetPos(step->GetPostStepPoint()->GetPosition());
+  newHit->SetTime(step->GetPostStepPoint()->GetGlobalTime());
+  newHit->SetWeight(step->GetTrack()->GetWeight());
 
   fHitsCollection->insert(newHit);
 
@@ -48,8 +74,78 @@ G4bool TrackerSD::ProcessHits(G4Step* step, G4TouchableHistory*)
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+void TrackerSD::AddToClusters(G4int trackID, G4double edep, const G4ThreeVector& pos,
+                              G4double time, G4double weight)
+{
+  // Find the cluster whose centroid is nearest to this deposit, among the
+  // clusters of the same time; in single mode any of them will do
+  std::size_t closest = fNofClusters;
+  G4double minDistance2 = DBL_MAX;
+  for (std::size_t i = 0; i < fNofClusters; ++i) {
+    const auto& cluster = fClusters[i];
+    if (std::abs(cluster.time - time) > fMergeTime) continue;
+    if (fClustering == Clustering::Single) {
+      closest = i;
+      minDistance2 = 0.;
+      break;
+    }
+    auto distance2 = (cluster.weightedPos / cluster.edep - pos).mag2();
+    if (distance2 < minDistance2) {
+      minDistance2 = distance2;
+      closest = i;
+    }
+  }
+
+  // A new cluster beyond the merge distance, or when none is close in time;
+  // once all are in use the closest one, or else the nearest in time
+  std::size_t nearest = closest;
+  if (closest == fNofClusters || minDistance2 > fMergeDistance * fMergeDistance) {
+    nearest = fNofClusters;
+  }
+  if (nearest == kMaxClusters) {
+    nearest = closest;
+    if (nearest == kMaxClusters) {
+      G4double minTime = DBL_MAX;
+      for (std::size_t i = 0; i < fNofClusters; ++i) {
+        if (std::abs(fClusters[i].time - time) < minTime) {
+          minTime = std::abs(fClusters[i].time - time);
+          nearest = i;
+        }
+      }
+    }
+  }
+
+  if (nearest == fNofClusters) {
+    fClusters[nearest].trackID = trackID;
+    fClusters[nearest].time = time;
+    fClusters[nearest].weight = weight;
+    ++fNofClusters;
+  }
+
+  auto& cluster = fClusters[nearest];
+  cluster.time = std::min(cluster.time, time);
+  cluster.edep += edep;
+  cluster.weightedPos += edep * pos;
+  ++cluster.nofInteractions;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 void TrackerSD::EndOfEvent(G4HCofThisEvent*)
 {
+  // One hit per cluster, with the energy-weighted centroid as position
+  for (std::size_t i = 0; i < fNofClusters; ++i) {
+    const auto& cluster = fClusters[i];
+    auto newHit = new TrackerHit();
+    newHit->SetTrackID(cluster.trackID);
+    newHit->SetEdep(cluster.edep);
+    newHit->SetPos(cluster.weightedPos / cluster.edep);
+    newHit->SetNofInteractions(cluster.nofInteractions);
+    newHit->SetTime(cluster.time);
+    newHit->SetWeight(cluster.weight);
+    fHitsCollection->insert(newHit);
+  }
+
   if (verboseLevel > 1) {
     auto nofHits = fHitsCollection->entries();
     G4cout << G4endl << "-------->Hits Collection: in this event they are " << nofHits
@@ -59,3 +155,42 @@ void TrackerSD::EndOfEvent(G4HCofThisEvent*)
   }
 }
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void TrackerSD::SetClustering(const G4String& mode)
+{
+  if (mode == "single") {
+    fClustering = Clustering::Single;
+  }
+  else if (mode == "multi") {
+    fClustering = Clustering::Multi;
+  }
+  else {
+    fClustering = Clustering::None;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void TrackerSD::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B4c/" + SensitiveDetectorName + "/",
+                                      "Control of the " + SensitiveDetectorName + " hits");
+
+  auto& clusteringCmd = fMessenger->DeclareMethod("clustering", &TrackerSD::SetClustering,
+    "Hit clustering: none (one hit per step), single (one centroid per event)\n"
+    "or multi (centroids merged within mergeDistance).");
+  clusteringCmd.SetParameterName("mode", false);
+  clusteringCmd.SetCandidates("none single multi");
+
+  auto& distanceCmd = fMessenger->DeclarePropertyWithUnit("mergeDistance", "mm", fMergeDistance,
+    "Maximum distance of a deposit to a cluster centroid in multi clustering.");
+  distanceCmd.SetParameterName("distance", false);
+  distanceCmd.SetRange("distance>=0.");
+
+  auto& timeCmd = fMessenger->DeclarePropertyWithUnit("mergeTime", "ns", fMergeTime,
+    "Maximum time between a deposit and the start of a cluster it joins;\n"
+    "set it to the detector resolving time in bunch mode.");
+  timeCmd.SetParameterName("time", false);
+  timeCmd.SetRange("time>0.");
+}
@@ -0,0 +1,12 @@
+#include "TrackingAction.hh"
+
+#include "Telemetry.hh"
+
+#include "G4Track.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void TrackingAction::PostUserTrackingAction(const G4Track* track)
+{
+  Telemetry::Instance()->CountSteps(track->GetCurrentStepNumber());
+}
@@ -0,0 +1,138 @@
+#include "TreatmentPlan.hh"
+
+#include "G4AutoLock.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace
+{
+G4Mutex planMutex = G4MUTEX_INITIALIZER;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::shared_ptr<const TreatmentPlan> TreatmentPlan::Load(const G4String& fileName)
+{
+  // All worker threads running the same plan share one alias table
+  static std::map<G4String, std::weak_ptr<const TreatmentPlan>> plans;
+
+  G4AutoLock lock(&planMutex);
+  auto plan = plans[fileName].lock();
+  if (plan) return plan;
+
+  auto newPlan = std::shared_ptr<TreatmentPlan>(new TreatmentPlan);
+  newPlan->Read(fileName);
+  newPlan->BuildAliasTable();
+
+  std::set<G4double> layers;
+  G4double totalWeight = 0.;
+  for (const auto& spot : newPlan->fSpots) {
+    layers.insert(spot.energy);
+    totalWeight += spot.weight;
+  }
+  G4cout << "Treatment plan: " << newPlan->fSpots.size() << " spots in " << layers.size()
+         << " energy layers, " << totalWeight << " MU, read from " << fileName << G4endl;
+
+  plans[fileName] = newPlan;
+  return newPlan;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void TreatmentPlan::Read(const G4String& fileName)
+{
+  std::ifstream file(fileName);
+  if (!file) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open treatment plan " << fileName;
+    G4Exception("TreatmentPlan::Read()", "MyCode0014", FatalException, msg);
+    return;
+  }
+
+  std::string line;
+  G4int lineNumber = 0;
+  while (std::getline(file, line)) {
+    ++lineNumber;
+    auto comment = line.find('#');
+    if (comment != std::string::npos) line.erase(comment);
+
+    std::istringstream fields(line);
+    std::vector<G4double> values;
+    G4double value;
+    while (fields >> value) {
+      values.push_back(value);
+    }
+    if (values.empty() && fields.eof()) continue;
+
+    if (!fields.eof() || values.size() < 4 || values.size() > 9 || values[0] <= 0.
+        || values[3] < 0.)
+    {
+      G4ExceptionDescription msg;
+      msg << fileName << ":" << lineNumber << ": expected energy y z weight [sigmaE sigmaY "
+          << "sigmaZ divY divZ], with a positive energy and a weight >= 0";
+      G4Exception("TreatmentPlan::Read()", "MyCode0014", FatalException, msg);
+      return;
+    }
+    values.resize(9, 0.);
+    if (values[5] == 0.) values[5] = 1.;  // default spot size, that of the pencil beam
+    if (values[6] == 0.) values[6] = 1.;
+
+    fSpots.push_back({values[0] * MeV, values[1] * mm, values[2] * mm, values[3],
+                      values[4] * MeV, values[5] * mm, values[6] * mm, values[7] * mrad,
+                      values[8] * mrad});
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void TreatmentPlan::BuildAliasTable()
+{
+  // Vose's alias method: column i keeps its own spot with probability
+  // fProbability[i] and otherwise hands over to fAlias[i]
+  auto n = fSpots.size();
+  G4double totalWeight = 0.;
+  for (const auto& spot : fSpots) {
+    totalWeight += spot.weight;
+  }
+  if (n == 0 || totalWeight <= 0.) {
+    G4Exception("TreatmentPlan::BuildAliasTable()", "MyCode0014", FatalException,
+                "The treatment plan has no spot with a positive weight.");
+    return;
+  }
+
+  fProbability.resize(n);
+  fAlias.resize(n);
+  std::vector<G4double> scaled(n);
+  std::vector<std::uint32_t> small, large;
+  for (std::size_t i = 0; i < n; ++i) {
+    scaled[i] = fSpots[i].weight * n / totalWeight;
+    (scaled[i] < 1. ? small : large).push_back(static_cast<std::uint32_t>(i));
+  }
+
+  while (!small.empty() && !large.empty()) {
+    auto less = small.back();
+    small.pop_back();
+    auto more = large.back();
+    fProbability[less] = scaled[less];
+    fAlias[less] = more;
+    scaled[more] -= 1. - scaled[less];
+    if (scaled[more] < 1.) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+
+  // Left over columns are full, up to rounding
+  for (auto i : large) {
+    fProbability[i] = 1.;
+    fAlias[i] = i;
+  }
+  for (auto i : small) {
+    fProbability[i] = 1.;
+    fAlias[i] = i;
+  }
+}
@@ -0,0 +1,122 @@
+// List-mode MLEM/OSEM reconstruction of the prompt-gamma emission from
+// the Detection table of the columnar output (/B4c/output/columnDirectory).
+//
+// The table is streamed from disk once per iteration; the image is
+// written as <output>.bin and <output>.json, readable with
+// load_emission_map of load_columns.py.
+//
+// Usage: comptonRecon [options] columnDirectory output
+//   -j nThreads             threads (default: all cores)
+//   -n iterations           (default 10)
+//   -s subsets              OSEM subsets (default 1, MLEM)
+//   --voxel mm              voxel size (default 2)
+//   --grid x0 x1 y0 y1 z0 z1  image box in mm (default: the Target)
+//   --sigma deg             angular resolution of the cones (default 3)
+//   --emin MeV, --emax MeV  total energy window of the coincidences
+//   --scatter-size mm       side of the scatter face at z = 0 (default 100)
+
+#include "ColumnReader.hh"
+#include "ListModeMLEM.hh"
+#include "VoxelGrid.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void PrintUsage()
+{
+  std::cerr << " Usage: " << std::endl;
+  std::cerr << " comptonRecon [-j nThreads] [-n iterations] [-s subsets] [--voxel mm]" << std::endl
+            << "              [--grid x0 x1 y0 y1 z0 z1] [--sigma deg] [--emin MeV] [--emax MeV]"
+            << std::endl
+            << "              [--scatter-size mm] columnDirectory output" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ListModeMLEM::Options options;
+  options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  double voxelSize = 2.;
+  double box[6] = {-90., 90., -20., 20., 80., 120.};
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto hasValues = [&](int n) { return i + n < argc; };
+    if (arg == "-j" && hasValues(1)) {
+      options.threads = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "-n" && hasValues(1)) {
+      options.iterations = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "-s" && hasValues(1)) {
+      options.subsets = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--voxel" && hasValues(1)) {
+      voxelSize = std::atof(argv[++i]);
+    }
+    else if (arg == "--grid" && hasValues(6)) {
+      for (auto& value : box) {
+        value = std::atof(argv[++i]);
+      }
+    }
+    else if (arg == "--sigma" && hasValues(1)) {
+      options.sigmaAngle = std::atof(argv[++i]) * std::acos(-1.) / 180.;
+    }
+    else if (arg == "--emin" && hasValues(1)) {
+      options.energyMin = std::atof(argv[++i]);
+    }
+    else if (arg == "--emax" && hasValues(1)) {
+      options.energyMax = std::atof(argv[++i]);
+    }
+    else if (arg == "--scatter-size" && hasValues(1)) {
+      options.scatterSize = std::atof(argv[++i]);
+    }
+    else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() != 2 || voxelSize <= 0. || options.sigmaAngle <= 0.) {
+    PrintUsage();
+    return 1;
+  }
+
+  VoxelGrid grid;
+  for (int axis = 0; axis < 3; ++axis) {
+    auto low = box[2 * axis];
+    auto high = box[2 * axis + 1];
+    auto n = std::max(1, static_cast<int>(std::lround((high - low) / voxelSize)));
+    grid.origin[axis] = low;
+    grid.voxel[axis] = (high - low) / n;
+    (axis == 0 ? grid.nx : axis == 1 ? grid.ny : grid.nz) = n;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  try {
+    ColumnReader detections(args[0], "Detection");
+    std::cout << "Reconstructing " << detections.GetNofRows() << " coincidences on a "
+              << grid.nx << " x " << grid.ny << " x " << grid.nz << " grid with "
+              << options.threads << " thread(s)" << std::endl;
+
+    ListModeMLEM mlem(grid, options);
+    mlem.Run(detections);
+    mlem.Write(args[1]);
+  }
+  catch (const std::exception& e) {
+    std::cerr << "comptonRecon: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Image written to " << args[1] << ".bin in " << elapsed.count() << " s"
+            << std::endl;
+  return 0;
+}
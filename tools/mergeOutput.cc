@@ -0,0 +1,109 @@
+// Merges the analysis files written with /B4c/output/perThreadFiles:
+// ntuples are concatenated and histograms are summed.
+//
+// The inputs are split into groups that are merged concurrently into
+// temporary partial files, which are then combined with a fast (basket
+// copying) merge into the final output.
+//
+// Usage: mergeOutput [-j nThreads] output.root input.root [input.root ...]
+
+#include "TFileMerger.h"
+#include "TROOT.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void PrintUsage()
+{
+  std::cerr << " Usage: " << std::endl;
+  std::cerr << " mergeOutput [-j nThreads] output.root input.root [input.root ...]" << std::endl;
+}
+
+bool MergeFiles(const std::string& output, const std::vector<std::string>& inputs, bool fast)
+{
+  TFileMerger merger(false, false);
+  merger.SetPrintLevel(0);
+  merger.SetFastMethod(fast);
+  if (!merger.OutputFile(output.c_str(), "RECREATE")) return false;
+  for (const auto& input : inputs) {
+    if (!merger.AddFile(input.c_str(), false)) return false;
+  }
+  return merger.Merge();
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      nThreads = std::max(1, std::atoi(argv[++i]));
+    }
+    else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() < 2) {
+    PrintUsage();
+    return 1;
+  }
+
+  const std::string output = args.front();
+  const std::vector<std::string> inputs(args.begin() + 1, args.end());
+
+  auto start = std::chrono::steady_clock::now();
+
+  // Each group should hold at least two files to be worth a thread
+  auto nGroups = std::min<std::size_t>(nThreads, inputs.size() / 2);
+  bool ok = true;
+  if (nGroups <= 1) {
+    ok = MergeFiles(output, inputs, false);
+  }
+  else {
+    ROOT::EnableThreadSafety();
+
+    std::vector<std::vector<std::string>> groups(nGroups);
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+      groups[i * nGroups / inputs.size()].push_back(inputs[i]);
+    }
+
+    std::vector<std::string> partials(nGroups);
+    std::vector<char> status(nGroups, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < nGroups; ++i) {
+      partials[i] = output + ".part" + std::to_string(i);
+      threads.emplace_back([&, i]() { status[i] = MergeFiles(partials[i], groups[i], false); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ok = std::all_of(status.begin(), status.end(), [](char s) { return s != 0; });
+
+    // Partial files share compression settings, so baskets are copied as is
+    if (ok) ok = MergeFiles(output, partials, true);
+
+    for (const auto& partial : partials) {
+      std::remove(partial.c_str());
+    }
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (!ok) {
+    std::cerr << "mergeOutput: merging into " << output << " failed." << std::endl;
+    return 1;
+  }
+  std::cout << "Merged " << inputs.size() << " files into " << output << " in "
+            << elapsed.count() << " s using " << std::max<std::size_t>(nGroups, 1)
+            << " thread(s)" << std::endl;
+  return 0;
+}